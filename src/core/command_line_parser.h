@@ -64,6 +64,10 @@ class Command_Line_Parser
             }
         }
 
+        Command_Line_Parser (const std::vector<std::string> &tokens) : tokens(tokens)
+        {
+        }
+
         std::string get_option(const std::string &option) const
         {
             std::vector<std::string>::const_iterator itr;
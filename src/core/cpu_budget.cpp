@@ -0,0 +1,212 @@
+/***
+Copyright (c) 2016, UChicago Argonne, LLC. All rights reserved.
+
+Copyright 2016. UChicago Argonne, LLC. This software was produced
+under U.S. Government contract DE-AC02-06CH11357 for Argonne National
+Laboratory (ANL), which is operated by UChicago Argonne, LLC for the
+U.S. Department of Energy. The U.S. Government has rights to use,
+reproduce, and distribute this software.  NEITHER THE GOVERNMENT NOR
+UChicago Argonne, LLC MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR
+ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  If software is
+modified to produce derivative works, such modified software should
+be clearly marked, so as not to confuse it with the version available
+from ANL.
+
+Additionally, redistribution and use in source and binary forms, with
+or without modification, are permitted provided that the following
+conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the name of UChicago Argonne, LLC, Argonne National
+      Laboratory, ANL, the U.S. Government, nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY UChicago Argonne, LLC AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL UChicago
+Argonne, LLC OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+***/
+
+#include "core/cpu_budget.h"
+
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#if defined(__linux__)
+#include <sched.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+std::atomic<Cpu_Budget*> Cpu_Budget::_this_inst(nullptr);
+
+static std::mutex cpu_budget_mutex;
+
+//-----------------------------------------------------------------------------
+
+// parse a sysfs cpu list such as "0-15,32-47"
+static std::vector<int> parse_cpu_list(const std::string& list)
+{
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ','))
+    {
+        if (range.empty() || range == "\n")
+        {
+            continue;
+        }
+        try
+        {
+            size_t dash = range.find('-');
+            int first = std::stoi(range.substr(0, dash));
+            int last = (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+            for (int c = first; c <= last; c++)
+            {
+                cpus.push_back(c);
+            }
+        }
+        catch (...)
+        {
+            return std::vector<int>();
+        }
+    }
+    return cpus;
+}
+
+//-----------------------------------------------------------------------------
+
+Cpu_Budget::Cpu_Budget() : _num_threads(std::thread::hardware_concurrency()), _busy_tasks(0), _serial_omp(false)
+{
+#if defined(__linux__)
+    std::ifstream online("/sys/devices/system/node/online");
+    std::string line;
+    if (online.is_open() && std::getline(online, line))
+    {
+        for (int node : parse_cpu_list(line))
+        {
+            std::ifstream cpulist("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            std::string cpus;
+            if (cpulist.is_open() && std::getline(cpulist, cpus))
+            {
+                std::vector<int> node_cpus = parse_cpu_list(cpus);
+                // memory only nodes have no cpus to pin to
+                if (node_cpus.size() > 0)
+                {
+                    _numa_nodes.push_back(node_cpus);
+                }
+            }
+        }
+    }
+#endif
+    if (_numa_nodes.size() == 0)
+    {
+        std::vector<int> cpus;
+        for (int c = 0; c < (int)std::max(1u, std::thread::hardware_concurrency()); c++)
+        {
+            cpus.push_back(c);
+        }
+        _numa_nodes.push_back(cpus);
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+Cpu_Budget* Cpu_Budget::inst()
+{
+    // called from hot OpenMP paths, only lock while creating
+    if (_this_inst == nullptr)
+    {
+        std::lock_guard<std::mutex> lock(cpu_budget_mutex);
+        if (_this_inst == nullptr)
+        {
+            _this_inst = new Cpu_Budget();
+        }
+    }
+    return _this_inst;
+}
+
+//-----------------------------------------------------------------------------
+
+int Cpu_Budget::omp_threads() const
+{
+    int max_threads = 1;
+#ifdef _OPENMP
+    max_threads = omp_get_max_threads();
+#endif
+    size_t num_threads = _num_threads;
+    if (_serial_omp)
+    {
+        return 1;
+    }
+    if (num_threads == 0)
+    {
+        return max_threads;
+    }
+    size_t busy = _busy_tasks;
+    size_t threads = num_threads;
+    if (busy > 0)
+    {
+        // split the idle part of the budget between the running tasks
+        threads = 1 + ((num_threads > busy) ? (num_threads - busy) / busy : 0);
+    }
+    return (int)std::max((size_t)1, std::min(threads, (size_t)max_threads));
+}
+
+//-----------------------------------------------------------------------------
+
+const std::vector<std::vector<int>>& Cpu_Budget::numa_nodes()
+{
+    return _numa_nodes;
+}
+
+//-----------------------------------------------------------------------------
+
+int Cpu_Budget::pin_worker(size_t worker_idx, size_t num_workers)
+{
+    size_t nodes = std::min(_numa_nodes.size(), num_workers);
+    if (nodes < 2)
+    {
+        return -1;
+    }
+    // contiguous blocks of workers per node, same split ThreadPool uses for rows
+    size_t node = (worker_idx * nodes) / num_workers;
+#if defined(__linux__)
+    // the whole node, omp teams started from the worker inherit the mask and spread over it
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for (int cpu : _numa_nodes[node])
+    {
+        CPU_SET(cpu, &mask);
+    }
+    if (sched_setaffinity(0, sizeof(mask), &mask) != 0)
+    {
+        return -1;
+    }
+    return (int)node;
+#else
+    return -1;
+#endif
+}
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,106 @@
+/***
+Copyright (c) 2016, UChicago Argonne, LLC. All rights reserved.
+
+Copyright 2016. UChicago Argonne, LLC. This software was produced
+under U.S. Government contract DE-AC02-06CH11357 for Argonne National
+Laboratory (ANL), which is operated by UChicago Argonne, LLC for the
+U.S. Department of Energy. The U.S. Government has rights to use,
+reproduce, and distribute this software.  NEITHER THE GOVERNMENT NOR
+UChicago Argonne, LLC MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR
+ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  If software is
+modified to produce derivative works, such modified software should
+be clearly marked, so as not to confuse it with the version available
+from ANL.
+
+Additionally, redistribution and use in source and binary forms, with
+or without modification, are permitted provided that the following
+conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the name of UChicago Argonne, LLC, Argonne National
+      Laboratory, ANL, the U.S. Government, nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY UChicago Argonne, LLC AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL UChicago
+Argonne, LLC OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+***/
+
+#ifndef __CPU_BUDGET__
+#define __CPU_BUDGET__
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+#include "core/defines.h"
+
+/**
+ * @brief The Cpu_Budget class : One process wide thread budget shared by ThreadPool workers and the OpenMP
+ *        regions underneath them. Pool workers report when they run a task, OpenMP regions ask omp_threads()
+ *        how many threads they may start. With every worker busy the regions run serially, with few tasks in
+ *        flight they expand to the idle part of the budget.
+ */
+class DLL_EXPORT Cpu_Budget
+{
+public:
+
+    static Cpu_Budget* inst();
+
+    ~Cpu_Budget() = default;
+
+    /// total threads for the process, 0 disables the budget and OpenMP uses its own default
+    void set_num_threads(size_t num_threads) { _num_threads = num_threads; }
+
+    size_t num_threads() const { return _num_threads; }
+
+    void task_started() { _busy_tasks++; }
+
+    void task_finished() { _busy_tasks--; }
+
+    size_t busy_tasks() const { return _busy_tasks; }
+
+    /// keep every OpenMP region on its calling thread, set in forked children whose OpenMP runtime hangs if it starts threads again
+    void set_serial_omp(bool val) { _serial_omp = val; }
+
+    /// threads an OpenMP region started from the calling thread may use, its own thread plus a fair share of the idle ones
+    int omp_threads() const;
+
+    /// cpus of each numa node, read once from sysfs. A single node holding every cpu where that is not available
+    const std::vector<std::vector<int>>& numa_nodes();
+
+    /// pin the calling pool worker to the cpus of the node it is assigned to, returns the node or -1 if not pinned
+    int pin_worker(size_t worker_idx, size_t num_workers);
+
+private:
+
+    Cpu_Budget();
+
+    static std::atomic<Cpu_Budget*> _this_inst;
+
+    std::atomic<size_t> _num_threads;
+
+    std::atomic<size_t> _busy_tasks;
+
+    std::atomic<bool> _serial_omp;
+
+    std::vector<std::vector<int>> _numa_nodes;
+};
+
+#endif
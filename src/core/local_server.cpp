@@ -0,0 +1,418 @@
+/***
+Copyright (c) 2016, UChicago Argonne, LLC. All rights reserved.
+
+Copyright 2016. UChicago Argonne, LLC. This software was produced
+under U.S. Government contract DE-AC02-06CH11357 for Argonne National
+Laboratory (ANL), which is operated by UChicago Argonne, LLC for the
+U.S. Department of Energy. The U.S. Government has rights to use,
+reproduce, and distribute this software.  NEITHER THE GOVERNMENT NOR
+UChicago Argonne, LLC MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR
+ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  If software is
+modified to produce derivative works, such modified software should
+be clearly marked, so as not to confuse it with the version available
+from ANL.
+
+Additionally, redistribution and use in source and binary forms, with
+or without modification, are permitted provided that the following
+conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the name of UChicago Argonne, LLC, Argonne National
+      Laboratory, ANL, the U.S. Government, nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY UChicago Argonne, LLC AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL UChicago
+Argonne, LLC OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+***/
+
+
+#include "core/local_server.h"
+
+#include <chrono>
+#include <cstring>
+#if !defined(_WIN32)
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+//-----------------------------------------------------------------------------
+
+#if !defined(_WIN32)
+//seconds a client may take to send its request before the server drops it
+static const int REQUEST_TIMEOUT_SEC = 10;
+
+//larger requests are not command lines
+static const size_t MAX_REQUEST_BYTES = 1 << 20;
+
+static bool write_all(int fd, const std::string& data)
+{
+    int flags = 0;
+#ifdef MSG_NOSIGNAL
+    //a client that went away must not kill the process with SIGPIPE
+    flags = MSG_NOSIGNAL;
+#endif
+    size_t done = 0;
+    while (done < data.size())
+    {
+        ssize_t n = ::send(fd, data.data() + done, data.size() - done, flags);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        done += (size_t)n;
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+static void no_sigpipe(int fd)
+{
+#if defined(SO_NOSIGPIPE)
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#else
+    (void)fd;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+
+/**
+ * @brief encode_request : number of tokens on the first line, then each token as its length on a line followed by its bytes,
+ *                         so empty tokens and tokens with new lines survive.
+ */
+static std::string encode_request(const std::vector<std::string>& tokens)
+{
+    std::string request = std::to_string(tokens.size()) + "\n";
+    for (const auto& token : tokens)
+    {
+        request += std::to_string(token.size()) + "\n" + token;
+    }
+    return request;
+}
+
+//-----------------------------------------------------------------------------
+
+static bool read_length(const std::string& data, size_t& pos, size_t& out_len)
+{
+    size_t nl = data.find('\n', pos);
+    if (nl == std::string::npos || nl == pos || nl - pos > 12)
+    {
+        return false;
+    }
+    out_len = 0;
+    for (size_t i = pos; i < nl; i++)
+    {
+        if (data[i] < '0' || data[i] > '9')
+        {
+            return false;
+        }
+        out_len = out_len * 10 + (size_t)(data[i] - '0');
+    }
+    pos = nl + 1;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+/// true once data holds a whole request
+static bool decode_request(const std::string& data, std::vector<std::string>& tokens)
+{
+    tokens.clear();
+    size_t pos = 0;
+    size_t num_tokens = 0;
+    if (false == read_length(data, pos, num_tokens))
+    {
+        return false;
+    }
+    for (size_t i = 0; i < num_tokens; i++)
+    {
+        size_t len = 0;
+        if (false == read_length(data, pos, len) || data.size() - pos < len)
+        {
+            tokens.clear();
+            return false;
+        }
+        tokens.push_back(data.substr(pos, len));
+        pos += len;
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+static bool fill_address(const std::string& socket_path, sockaddr_un& addr)
+{
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socket_path.length() >= sizeof(addr.sun_path))
+    {
+        logE << "Socket path too long: " << socket_path << "\n";
+        return false;
+    }
+    strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+//only a socket left behind by a server that is gone is removed, never a regular file or a live server's socket
+static bool remove_stale_socket(const std::string& socket_path, const sockaddr_un& addr)
+{
+    struct stat st;
+    if (lstat(socket_path.c_str(), &st) != 0)
+    {
+        if (errno == ENOENT)
+        {
+            return true;
+        }
+        logE << "Could not stat " << socket_path << " : " << strerror(errno) << "\n";
+        return false;
+    }
+    if (false == S_ISSOCK(st.st_mode))
+    {
+        logE << socket_path << " exists and is not a socket\n";
+        return false;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        logE << "Could not create socket " << socket_path << "\n";
+        return false;
+    }
+    int ret = connect(fd, (const sockaddr*)&addr, sizeof(addr));
+    int connect_errno = errno;
+    ::close(fd);
+    if (ret == 0)
+    {
+        logE << "Another server is listening on " << socket_path << "\n";
+        return false;
+    }
+    if (connect_errno != ECONNREFUSED)
+    {
+        logE << "Could not check socket " << socket_path << " : " << strerror(connect_errno) << "\n";
+        return false;
+    }
+    if (unlink(socket_path.c_str()) != 0)
+    {
+        logE << "Could not remove stale socket " << socket_path << " : " << strerror(errno) << "\n";
+        return false;
+    }
+    return true;
+}
+#endif
+
+//-----------------------------------------------------------------------------
+
+Local_Server::Local_Server(const std::string& socket_path) : _socket_path(socket_path), _listen_fd(-1), _conn_fd(-1)
+{
+
+}
+
+//-----------------------------------------------------------------------------
+
+Local_Server::~Local_Server()
+{
+    close();
+}
+
+//-----------------------------------------------------------------------------
+
+bool Local_Server::supported()
+{
+#if !defined(_WIN32)
+    return true;
+#else
+    return false;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+
+bool Local_Server::open()
+{
+#if !defined(_WIN32)
+    sockaddr_un addr;
+    if (false == fill_address(_socket_path, addr) || false == remove_stale_socket(_socket_path, addr))
+    {
+        return false;
+    }
+    _listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (_listen_fd < 0)
+    {
+        logE << "Could not create socket " << _socket_path << "\n";
+        return false;
+    }
+    if (bind(_listen_fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(_listen_fd, 16) != 0)
+    {
+        logE << "Could not listen on " << _socket_path << " : " << strerror(errno) << "\n";
+        close();
+        return false;
+    }
+    logI << "Listening on " << _socket_path << "\n";
+    return true;
+#else
+    return false;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+
+bool Local_Server::next_request(std::vector<std::string>& tokens)
+{
+#if !defined(_WIN32)
+    tokens.clear();
+    while (_listen_fd > -1)
+    {
+        _conn_fd = accept(_listen_fd, nullptr, nullptr);
+        if (_conn_fd < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            logE << "Accept failed on " << _socket_path << " : " << strerror(errno) << "\n";
+            return false;
+        }
+        no_sigpipe(_conn_fd);
+        //a client that stops sending is dropped instead of blocking the server
+        timeval timeout;
+        timeout.tv_sec = REQUEST_TIMEOUT_SEC;
+        timeout.tv_usec = 0;
+        setsockopt(_conn_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(REQUEST_TIMEOUT_SEC);
+
+        std::string data;
+        char buf[4096];
+        bool complete = false;
+        while (false == complete && std::chrono::steady_clock::now() < deadline && data.size() < MAX_REQUEST_BYTES)
+        {
+            ssize_t n = ::read(_conn_fd, buf, sizeof(buf));
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                break;
+            }
+            data.append(buf, (size_t)n);
+            complete = decode_request(data, tokens);
+        }
+        if (false == complete)
+        {
+            logW << "Dropping incomplete request\n";
+            ::close(_conn_fd);
+            _conn_fd = -1;
+            continue;
+        }
+        return true;
+    }
+#endif
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+
+void Local_Server::reply(const std::string& msg)
+{
+#if !defined(_WIN32)
+    if (_conn_fd > -1)
+    {
+        write_all(_conn_fd, msg + "\n");
+        ::close(_conn_fd);
+        _conn_fd = -1;
+    }
+#endif
+}
+
+//-----------------------------------------------------------------------------
+
+void Local_Server::close()
+{
+#if !defined(_WIN32)
+    if (_conn_fd > -1)
+    {
+        ::close(_conn_fd);
+        _conn_fd = -1;
+    }
+    if (_listen_fd > -1)
+    {
+        ::close(_listen_fd);
+        _listen_fd = -1;
+        unlink(_socket_path.c_str());
+    }
+#endif
+}
+
+//-----------------------------------------------------------------------------
+
+bool Local_Server::send_request(const std::string& socket_path, const std::vector<std::string>& tokens, std::string& out_reply)
+{
+#if !defined(_WIN32)
+    sockaddr_un addr;
+    if (false == fill_address(socket_path, addr))
+    {
+        return false;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0)
+    {
+        logE << "Could not connect to " << socket_path << " : " << strerror(errno) << "\n";
+        if (fd > -1)
+        {
+            ::close(fd);
+        }
+        return false;
+    }
+    no_sigpipe(fd);
+    bool ok = write_all(fd, encode_request(tokens));
+    out_reply.clear();
+    char buf[4096];
+    ssize_t n;
+    while (ok && ((n = ::read(fd, buf, sizeof(buf))) > 0 || (n < 0 && errno == EINTR)))
+    {
+        if (n > 0)
+        {
+            out_reply.append(buf, (size_t)n);
+        }
+    }
+    ::close(fd);
+    while (out_reply.size() > 0 && out_reply.back() == '\n')
+    {
+        out_reply.pop_back();
+    }
+    return ok && out_reply.size() > 0;
+#else
+    return false;
+#endif
+}
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,94 @@
+/***
+Copyright (c) 2016, UChicago Argonne, LLC. All rights reserved.
+
+Copyright 2016. UChicago Argonne, LLC. This software was produced
+under U.S. Government contract DE-AC02-06CH11357 for Argonne National
+Laboratory (ANL), which is operated by UChicago Argonne, LLC for the
+U.S. Department of Energy. The U.S. Government has rights to use,
+reproduce, and distribute this software.  NEITHER THE GOVERNMENT NOR
+UChicago Argonne, LLC MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR
+ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  If software is
+modified to produce derivative works, such modified software should
+be clearly marked, so as not to confuse it with the version available
+from ANL.
+
+Additionally, redistribution and use in source and binary forms, with
+or without modification, are permitted provided that the following
+conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the name of UChicago Argonne, LLC, Argonne National
+      Laboratory, ANL, the U.S. Government, nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY UChicago Argonne, LLC AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL UChicago
+Argonne, LLC OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+***/
+
+
+#ifndef __LOCAL_SERVER__
+#define __LOCAL_SERVER__
+
+#include <string>
+#include <vector>
+#include "core/defines.h"
+
+/**
+ * @brief The Local_Server class : Unix domain socket that takes one job at a time from local clients.
+ *        A request is the job's command line options, sent as the token count and then each token's length and bytes.
+ *        The server answers with one line of text and closes the connection. Only available where Unix sockets are, supported() is
+ *        false elsewhere.
+ */
+class DLL_EXPORT Local_Server
+{
+public:
+
+    Local_Server(const std::string& socket_path);
+
+    /// closes the socket and removes its file
+    ~Local_Server();
+
+    static bool supported();
+
+    /// bind and listen, a stale socket file left by a killed server is replaced
+    bool open();
+
+    /// block until a client sends a request, false if the socket failed. Clients that take too long to send are dropped
+    bool next_request(std::vector<std::string>& tokens);
+
+    /// answer the current request and close its connection
+    void reply(const std::string& msg);
+
+    void close();
+
+    /// client side, send one request and wait for the answer
+    static bool send_request(const std::string& socket_path, const std::vector<std::string>& tokens, std::string& out_reply);
+
+private:
+
+    std::string _socket_path;
+
+    int _listen_fd;
+
+    int _conn_fd;
+};
+
+#endif
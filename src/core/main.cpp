@@ -48,7 +48,13 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "core/command_line_parser.h"
 #include "core/process_streaming.h"
 #include "core/process_whole.h"
+#include "core/process_batch.h"
+#include "core/cpu_budget.h"
+#include "core/mem_info.h"
+#include "core/local_server.h"
 #include <cctype>
+#include <map>
+#include <sys/stat.h>
 
 
 #define MAX_DETECTORS 7
@@ -60,7 +66,10 @@ void help()
     logit_s<<"Help: \n";
     logit_s<<"Usage: xrf_maps [Options] --dir [dataset directory] \n\n";
     logit_s<<"Options: \n";
-    logit_s<<"--nthreads : <int> number of threads to use (default is all system threads) \n";
+    logit_s<<"--nthreads : <int> number of threads to use (default is all system threads). Thread pools and OpenMP regions share this budget.\n";
+    logit_s<<"--pixels-per-task : <int> Pixels fitted by one thread task (default is to time each fit routine on the first row and pick).\n";
+    logit_s<<"--numa-pin : Pin fitting threads to the cpus of each NUMA node and keep each row's spectra and results on the node that fits it. No effect on single node machines.\n";
+    logit_s<<"--row-shards : <int> Fit each dataset in this many processes, each with its own block of rows and an equal share of --nthreads. Results are merged into one file. Not used with low rank fitting. Linux/macOS only.\n";
     logit_s<<"--quantify-with : <standard.txt> File to use as quantification standard \n";
     logit_s<<"--quantify-fit <routines,>: If you want to perform quantification without having to re-fit all datasets. See --fit for routine options \n";
     logit_s<<"--detectors : <int,..> Detectors to process, Defaults to 0,1,2,3 for 4 detector \n";
@@ -74,30 +83,49 @@ void help()
 	logit_s << "--update-amps <us_amp>,<ds_amp>: Updates upstream and downstream amps if they changed inbetween scans.\n";
 	logit_s << "--update-quant-amps <us_amp>,<ds_amp>: Updates upstream and downstream amps for quantification if they changed inbetween scans.\n";
     logit_s<<"--quick-and-dirty : Integrate the detector range into 1 spectra.\n";
-//	logit_s<< "--mem-limit <limit> : Limit the memory usage. Append M for megabytes or G for gigabytes\n";
+    logit_s<< "--mem-limit <limit> : Memory budget for the spectra volumes loaded at once in --batch. Append M for megabytes or G for gigabytes\n";
     logit_s<<"--optimize-fit-override-params : <int> Integrate the 8 largest mda datasets and fit with multiple params.\n"<<
                "  0 = use override file\n  1 = matrix batch fit\n  2 = batch fit without tails\n  3 = batch fit with tails\n  4 = batch fit with free E, everything else fixed \n  5 = batch fit without tails, and fit energy quadratic\n";
+    logit_s<<"--optimize-num-starts : <int> Run this many optimizations per preset in parallel, all but the first start from perturbed peak shape params. Best residual is kept.\n";
+    logit_s<<"--optimize-dataset-workers : <int> Number of dataset and detector optimizations run at the same time (default is --nthreads). Averaged output is the same for any count.\n";
+    logit_s<<"--optimize-multi-start-presets : <int,> Extra presets (same numbers as --optimize-fit-override-params) to optimize next to the selected one. Best residual is kept.\n";
     logit_s<<"--optimize-fit-routine : <general,hybrid> General (default): passes elements amplitudes as fit parameters. Hybrid only passes fit parameters and fits element amplitudes using NNLS\n";
     logit_s<<"--optimizer <lmfit, mpfit> : Choose which optimizer to use for --optimize-fit-override-params or matrix fit routine \n";
     logit_s<<"--optimizer-fx-tols <tol_override_val> : F_TOL, X_TOL, Default is LM_FIT = " << DP_LM_USERTOL << " , MP_FIT = " << 1.192e-10 << "\n";
     logit_s<<"--optimizer-fxg-tols <tol_override_val> : F_TOL, X_TOL, G_TOL, Default is LM_FIT = " << DP_LM_USERTOL << " , MP_FIT = " << 1.192e-10 << "\n";
     logit_s<<"--optimizer-use-weights : Calculate and use weights for residual error function.\n";
+    logit_s<<"--warm-start-fits : Seed each pixel of the tails fit with the fit parameters of its left neighbour.\n";
+    logit_s<<"--mixed-precision : Fit in float but run the optimizer and nnls solve in double.\n";
+    logit_s<<"--parallel-jacobian : Evaluate the finite difference jacobian columns in parallel for integrated spectra optimizations.\n";
     logit_s<<"--optimize-rois : Looks in 'rois' directory and performs --optimize-fit-override-params on each roi separately. Needs to have --quantify-rois-with <maps_standardinfo.txt> and --quantify-fit <routines,>  \n";
+    logit_s<<"--optimize-rois-workers : <int> Number of rois optimized at the same time (default is --nthreads). Output is the same for any count.\n";
     logit_s<<"Fitting Routines: \n";
 	logit_s<< "--fit <routines,> comma seperated \n";
     logit_s<<"  roi : element energy region of interest \n";
     logit_s<<"  roi_plus : SVD method \n";
     logit_s<<"  nnls : Non-Negative Least Squares \n";
     logit_s<<"  tails : Fit with multiple parameters \n";
-    logit_s<<"  matrix : Fit with locked parameters \n\n";
+    logit_s<<"  matrix : Fit with locked parameters \n";
+    logit_s<<"--preview-bins : <int,> Before the full fit, fit and save maps of pixels binned by these sizes (coarsest first) as <routine>_Bin<N>. ex 8,4\n";
+    logit_s<<"--low-rank : <int> nnls and roi_plus fit at most this many basis spectra factorized from the volume instead of every pixel. Residual map is the model error.\n";
+    logit_s<<"--fit-cache : <dir> Keep the element models of matrix, nnls and svd fits in this (existing) directory so later runs with the same parameters skip generating them.\n";
+    logit_s<<"--no-fit-cache : Regenerate the element models for every dataset and detector instead of reusing them.\n";
+    logit_s<<"--series : --files are a series of scans (energy or theta) with the same detector and elements. Fit routines are set up once and only updated for what changed. A series is never detected from the files, pass --series for one.\n";
+    logit_s<<"--series-energies : <file> Implies --series. Lines of '<dataset file> <incident energy keV>' for scans that differ from the override file, only energy dependent element models are regenerated.\n";
+    logit_s<<"--low-rank-variance : <float> Use the smallest rank that keeps this fraction of the volume energy, keep it under the noise floor ex 0.98 (default 1 = always max rank)\n\n";
     logit_s<<"Dataset: "<<"\n";
     logit_s<<"--dir : Dataset directory \n";
     logit_s<<"--files : Dataset files: comma (',') separated if multiple \n";
+    logit_s<<"--batch : <manifest.txt> Fit many datasets with one scheduler. Each line holds the options of one job (--dir, --files, --fit, --detectors ...), '#' starts a comment.\n"<<
+               "  Options given next to --batch apply to every line unless the line sets them. Output is the same as running each line on its own.\n";
 #ifdef _BUILD_WITH_ZMQ
     logit_s<<"Network: \n";
     logit_s<<"--streamin [source ip] : Accept a ZMQ stream of spectra to process. Source ip defaults to localhost (must compile with -DBUILD_WITH_ZMQ option) \n";
     logit_s<<"--streamout [port]: Streams the analysis counts over a ZMQ stream (must compile with -DBUILD_WITH_ZMQ option) \n\n";
 #endif
+    logit_s<<"Server: \n";
+    logit_s<<"--server : <socket> Keep running on this Unix socket and take jobs from --connect. Reference files and initialized fit jobs stay loaded between jobs, changed reference and override files are reloaded. Linux/macOS only.\n";
+    logit_s<<"--connect : <socket> Send the other options to a running --server as one job and wait for it to finish. Use absolute --dir paths. --connect <socket> --shutdown stops the server.\n\n";
     logit_s<<"Examples: \n";
     logit_s<<"   Perform roi and matrix analysis on the directory /data/dataset1 \n";
     logit_s<<"xrf_maps --fit roi,matrix --dir /data/dataset1 \n";
@@ -111,6 +139,41 @@ void help()
 
 // ----------------------------------------------------------------------------
 
+bool str_to_fit_params_preset(const std::string& opt, fitting::models::Fit_Params_Preset& out_preset)
+{
+    if (opt == "0")
+    {
+        out_preset = fitting::models::Fit_Params_Preset::NOT_SET; // use tags from override file
+    }
+    else if (opt == "1")
+    {
+        out_preset = fitting::models::Fit_Params_Preset::MATRIX_BATCH_FIT;
+    }
+    else if (opt == "2")
+    {
+        out_preset = fitting::models::Fit_Params_Preset::BATCH_FIT_NO_TAILS;
+    }
+    else if (opt == "3")
+    {
+        out_preset = fitting::models::Fit_Params_Preset::BATCH_FIT_WITH_TAILS;
+    }
+    else if (opt == "4")
+    {
+        out_preset = fitting::models::Fit_Params_Preset::BATCH_FIT_WITH_FREE_ENERGY;
+    }
+    else if (opt == "5")
+    {
+        out_preset = fitting::models::Fit_Params_Preset::BATCH_FIT_NO_TAILS_E_QUAD;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
 template <typename T_real>
 void set_optimizer(Command_Line_Parser& clp, data_struct::Analysis_Job<T_real>& analysis_job)
 {
@@ -118,6 +181,8 @@ void set_optimizer(Command_Line_Parser& clp, data_struct::Analysis_Job<T_real>&
     bool fxg_exists = clp.option_exists("--optimizer-fxg-tols");
 
     analysis_job.use_weights = clp.option_exists("--optimizer-use-weights");
+    analysis_job.warm_start_fits = clp.option_exists("--warm-start-fits");
+    analysis_job.mixed_precision = clp.option_exists("--mixed-precision");
 
     //Which optimizer do we want to pick. Default is lmfit
     if (clp.option_exists("--optimizer"))
@@ -125,6 +190,42 @@ void set_optimizer(Command_Line_Parser& clp, data_struct::Analysis_Job<T_real>&
         analysis_job.set_optimizer(clp.get_option("--optimizer"));
     }
 
+    if (clp.option_exists("--optimize-num-starts"))
+    {
+        analysis_job.optimize_num_starts = std::stoi(clp.get_option("--optimize-num-starts"));
+    }
+
+    if (clp.option_exists("--optimize-dataset-workers"))
+    {
+        analysis_job.optimize_dataset_workers = std::stoi(clp.get_option("--optimize-dataset-workers"));
+    }
+
+    if (clp.option_exists("--optimize-multi-start-presets"))
+    {
+        std::stringstream ss;
+        ss.str(clp.get_option("--optimize-multi-start-presets"));
+        std::string item;
+        while (std::getline(ss, item, ','))
+        {
+            fitting::models::Fit_Params_Preset preset;
+            if (str_to_fit_params_preset(item, preset))
+            {
+                analysis_job.optimize_multi_start_presets.push_back(preset);
+            }
+            else
+            {
+                logW << "Unknown fit params preset " << item << "\n";
+            }
+        }
+    }
+
+    // only the double (integrated spectra) jobs, per pixel fits are already parallel over pixels
+    if (std::is_same<T_real, double>::value && clp.option_exists("--parallel-jacobian"))
+    {
+        logI << "Using parallel jacobian\n";
+        analysis_job.optimizer()->set_parallel_jacobian(true);
+    }
+
     if (clp.option_exists("--optimize-fit-routine"))
     {
         std::string opt = clp.get_option("--optimize-fit-routine");
@@ -186,19 +287,27 @@ void set_mem_limit(Command_Line_Parser& clp, data_struct::Analysis_Job<T_real>&
     if (clp.option_exists("--mem-limit"))
     {
         std::string memlimit = clp.get_option("--mem-limit");
-        if (memlimit.rfind('M'))
+        long long scale = 0;
+        if (memlimit.length() > 1 && std::toupper(memlimit.back()) == 'M')
         {
-
+            scale = 1024LL * 1024LL;
         }
-        else if (memlimit.rfind('G'))
+        else if (memlimit.length() > 1 && std::toupper(memlimit.back()) == 'G')
         {
-
+            scale = 1024LL * 1024LL * 1024LL;
         }
-        else
+        try
         {
-            logW << "Could not parse --mem-limit parameter. Make sure to use M for megabytes or G for gigabytes. ex 200M\n";
+            if (scale > 0)
+            {
+                analysis_job.mem_limit = std::stoll(memlimit.substr(0, memlimit.length() - 1)) * scale;
+                return;
+            }
         }
-        //analysis_job.mem_limit = ;
+        catch (std::exception&)
+        {
+        }
+        logW << "Could not parse --mem-limit parameter. Make sure to use M for megabytes or G for gigabytes. ex 200M\n";
     }
 }
 
@@ -211,6 +320,20 @@ void set_num_threads(Command_Line_Parser& clp, data_struct::Analysis_Job<T_real>
     {
         analysis_job.num_threads = std::stoi(clp.get_option("--nthreads"));
     }
+    if (clp.option_exists("--pixels-per-task"))
+    {
+        analysis_job.pixels_per_task = std::stoi(clp.get_option("--pixels-per-task"));
+    }
+    if (clp.option_exists("--numa-pin"))
+    {
+        analysis_job.numa_pin_threads = true;
+    }
+    if (clp.option_exists("--row-shards"))
+    {
+        analysis_job.row_shards = std::stoi(clp.get_option("--row-shards"));
+    }
+    // thread pools and the openmp regions under them share this many threads
+    Cpu_Budget::inst()->set_num_threads(analysis_job.num_threads);
 }
 
 // ----------------------------------------------------------------------------
@@ -275,6 +398,43 @@ void set_detectors(Command_Line_Parser& clp, data_struct::Analysis_Job<T_real>&
 
 // ----------------------------------------------------------------------------
 
+/**
+ * @brief load_series_energies : Read "<dataset file> <incident energy keV>" lines, '#' starts a comment.
+ */
+template <typename T_real>
+bool load_series_energies(const std::string& filename, std::map<std::string, T_real>& series_energies)
+{
+    std::ifstream in(filename);
+    if (false == in.is_open())
+    {
+        logE << "Could not open series energies " << filename << "\n";
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line))
+    {
+        size_t hash = line.find('#');
+        if (hash != std::string::npos)
+        {
+            line = line.substr(0, hash);
+        }
+        std::stringstream ss(line);
+        std::string dataset_file;
+        T_real energy;
+        if (ss >> dataset_file >> energy)
+        {
+            series_energies[dataset_file] = energy;
+        }
+        else if (dataset_file.length() > 0)
+        {
+            logW << "Skipping series energies line: " << line << "\n";
+        }
+    }
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
 template <typename T_real>
 void set_fit_routines(Command_Line_Parser& clp, data_struct::Analysis_Job<T_real>& analysis_job)
 {
@@ -315,6 +475,10 @@ void set_fit_routines(Command_Line_Parser& clp, data_struct::Analysis_Job<T_real
                 {
                     analysis_job.fitting_routines.push_back(data_struct::Fitting_Routines::GAUSS_MATRIX);
                 }
+                else if (item == STR_FIT_GAUSS_TAILS || item == "TAILS")
+                {
+                    analysis_job.fitting_routines.push_back(data_struct::Fitting_Routines::GAUSS_TAILS);
+                }
             }
         }
         else
@@ -340,8 +504,54 @@ void set_fit_routines(Command_Line_Parser& clp, data_struct::Analysis_Job<T_real
             {
                 analysis_job.fitting_routines.push_back(data_struct::Fitting_Routines::GAUSS_MATRIX);
             }
+            else if (fitting == STR_FIT_GAUSS_TAILS || fitting == "TAILS")
+            {
+                analysis_job.fitting_routines.push_back(data_struct::Fitting_Routines::GAUSS_TAILS);
+            }
         }
     }
+
+    if (clp.option_exists("--preview-bins"))
+    {
+        std::stringstream ss;
+        ss.str(clp.get_option("--preview-bins"));
+        std::string item;
+        while (std::getline(ss, item, ','))
+        {
+            analysis_job.preview_bin_sizes.push_back(std::stoi(item));
+        }
+    }
+
+    if (clp.option_exists("--low-rank"))
+    {
+        analysis_job.low_rank_max_rank = std::stoi(clp.get_option("--low-rank"));
+    }
+
+    if (clp.option_exists("--low-rank-variance"))
+    {
+        analysis_job.low_rank_variance = std::stod(clp.get_option("--low-rank-variance"));
+    }
+
+    if (clp.option_exists("--fit-cache"))
+    {
+        analysis_job.fit_routine_cache_dir = clp.get_option("--fit-cache");
+    }
+
+    if (clp.option_exists("--no-fit-cache"))
+    {
+        analysis_job.use_fit_routine_cache = false;
+    }
+
+    if (clp.option_exists("--series"))
+    {
+        analysis_job.series = true;
+    }
+
+    if (clp.option_exists("--series-energies"))
+    {
+        analysis_job.series = true;
+        load_series_energies(clp.get_option("--series-energies"), analysis_job.series_energies);
+    }
 }
 
 // ----------------------------------------------------------------------------
@@ -558,31 +768,7 @@ int run_optimization(Command_Line_Parser& clp)
     if (clp.option_exists("--optimize-fit-override-params"))
     {
         std::string opt = clp.get_option("--optimize-fit-override-params");
-        if (opt == "0")
-        {
-            analysis_job.optimize_fit_params_preset = fitting::models::Fit_Params_Preset::NOT_SET; // use tags from override file
-        }
-        else if (opt == "1")
-        {
-            analysis_job.optimize_fit_params_preset = fitting::models::Fit_Params_Preset::MATRIX_BATCH_FIT;
-        }
-        else if (opt == "2")
-        {
-            analysis_job.optimize_fit_params_preset = fitting::models::Fit_Params_Preset::BATCH_FIT_NO_TAILS;
-        }
-        else if (opt == "3")
-        {
-            analysis_job.optimize_fit_params_preset = fitting::models::Fit_Params_Preset::BATCH_FIT_WITH_TAILS;
-        }
-        else if (opt == "4")
-        {
-            analysis_job.optimize_fit_params_preset = fitting::models::Fit_Params_Preset::BATCH_FIT_WITH_FREE_ENERGY;
-        }
-        else if (opt == "5")
-        {
-            analysis_job.optimize_fit_params_preset = fitting::models::Fit_Params_Preset::BATCH_FIT_NO_TAILS_E_QUAD;
-        }
-        else
+        if (false == str_to_fit_params_preset(opt, analysis_job.optimize_fit_params_preset))
         {
             logI << "Defaulting optimize_fit_params_preset to batch fit without tails" << "\n";
         }
@@ -663,6 +849,11 @@ int run_optimize_rois(Command_Line_Parser& clp)
         return -1;
     }
     set_fit_routines(clp, analysis_job);
+
+    if (clp.option_exists("--optimize-rois-workers"))
+    {
+        analysis_job.optimize_roi_workers = std::stoi(clp.get_option("--optimize-rois-workers"));
+    }
     /*
     if (analysis_job.fitting_routines.size() == 0)
     {
@@ -735,11 +926,8 @@ int run_streaming(Command_Line_Parser& clp)
 
 // ----------------------------------------------------------------------------
 
-int run_fits(Command_Line_Parser& clp)
+int init_fit_job(Command_Line_Parser& clp, data_struct::Analysis_Job<float>& analysis_job)
 {
-    //main structure for analysis job information
-    data_struct::Analysis_Job<float> analysis_job;
-
     if (set_general_options(clp, analysis_job) == -1)
     {
         return -1;
@@ -779,28 +967,47 @@ int run_fits(Command_Line_Parser& clp)
     }
     */
 
-    // init our job and run
-    if (io::file::init_analysis_job_detectors(&analysis_job))
+    // init our job
+    if (false == io::file::init_analysis_job_detectors(&analysis_job))
     {
-        io::file::File_Scan::inst()->populate_netcdf_hdf5_files(analysis_job.dataset_directory);
-        
-        if (analysis_job.fitting_routines.size() > 0)
-        {
-            process_dataset_files(&analysis_job);
-            analysis_job.generate_average_h5 = true;
-        }
-        else
-        {
-            logW << "No fitting routines picked! Please select from [--fit roi,nnls,matrix]\n";
-        }
+        logE << "Error initalizing detectors!\n";
+        return -1;
+    }
+    return 0;
+}
 
-        //iterate_datasets_and_update(analysis_job);
+// ----------------------------------------------------------------------------
+
+void fit_datasets(data_struct::Analysis_Job<float>& analysis_job)
+{
+    io::file::File_Scan::inst()->populate_netcdf_hdf5_files(analysis_job.dataset_directory);
+
+    if (analysis_job.fitting_routines.size() > 0)
+    {
+        process_dataset_files(&analysis_job);
+        analysis_job.generate_average_h5 = true;
+        logI << "Fit routine setup total elapsed time: " << analysis_job.fit_routine_init_seconds() << "s\n";
     }
     else
     {
-        logE << "Error initalizing detectors!\n";
+        logW << "No fitting routines picked! Please select from [--fit roi,nnls,matrix]\n";
+    }
+
+    //iterate_datasets_and_update(analysis_job);
+}
+
+// ----------------------------------------------------------------------------
+
+int run_fits(Command_Line_Parser& clp)
+{
+    //main structure for analysis job information
+    data_struct::Analysis_Job<float> analysis_job;
+
+    if (init_fit_job(clp, analysis_job) == -1)
+    {
         return -1;
     }
+    fit_datasets(analysis_job);
     return 0;
 }
 
@@ -892,60 +1099,259 @@ int run_h5_file_updates(Command_Line_Parser& clp)
 
 // ----------------------------------------------------------------------------
 
-int main(int argc, char* argv[])
+/**
+ * @brief run_batch : Read the --batch manifest, set up one fit job per line and process them all with one scheduler.
+ */
+int run_batch(Command_Line_Parser& clp, const std::vector<std::string>& global_tokens)
 {
-    
-    std::string whole_command_line = "";
-    for (int i = 0; i < argc; i++)
+    std::string manifest = clp.get_option("--batch");
+    std::ifstream in(manifest);
+    if (false == in.is_open())
     {
-        whole_command_line += std::string(argv[i]) + " ";
+        logE << "Could not open batch manifest " << manifest << "\n";
+        return -1;
     }
-    logI << whole_command_line << "\n";
 
-    //Performance measure
-    std::chrono::time_point<std::chrono::system_clock> start, end;
+    //options next to --batch are defaults for every line, the line's own come first so they win
+    std::vector<std::string> defaults;
+    for (size_t i = 0; i < global_tokens.size(); i++)
+    {
+        if (global_tokens[i] == "--batch")
+        {
+            i++;
+            continue;
+        }
+        defaults.push_back(global_tokens[i]);
+    }
 
-    // get location of where we are running from and use it to find ref files
-    std::string exe_loc = std::string(argv[0]);
-    int prog_idx = exe_loc.find("xrf_maps");
-    if (prog_idx > 0)
+    std::vector<Command_Line_Parser> line_clps;
+    std::vector<data_struct::Analysis_Job<float>*> analysis_jobs;
+    std::string line;
+    size_t line_num = 0;
+    while (std::getline(in, line))
     {
-        exe_loc = exe_loc.substr(0, prog_idx);
+        line_num++;
+        size_t hash = line.find('#');
+        if (hash != std::string::npos)
+        {
+            line = line.substr(0, hash);
+        }
+        std::stringstream ss(line);
+        std::vector<std::string> tokens;
+        std::string token;
+        while (ss >> token)
+        {
+            tokens.push_back(token);
+        }
+        if (tokens.size() == 0)
+        {
+            continue;
+        }
+        tokens.insert(tokens.end(), defaults.begin(), defaults.end());
+        Command_Line_Parser line_clp(tokens);
+
+        data_struct::Analysis_Job<float>* analysis_job = new data_struct::Analysis_Job<float>();
+        if (set_general_options(line_clp, *analysis_job) == -1)
+        {
+            logW << "Skipping batch line " << line_num << "\n";
+            delete analysis_job;
+            continue;
+        }
+        set_fit_routines(line_clp, *analysis_job);
+        set_mem_limit(line_clp, *analysis_job);
+        if (line_clp.option_exists("--quick-and-dirty"))
+        {
+            analysis_job->quick_and_dirty = true;
+        }
+        if (analysis_job->fitting_routines.size() == 0 || false == io::file::init_analysis_job_detectors(analysis_job))
+        {
+            logW << "Skipping batch line " << line_num << ", no fit routines or could not initalize detectors\n";
+            delete analysis_job;
+            continue;
+        }
+        analysis_jobs.push_back(analysis_job);
+        line_clps.push_back(line_clp);
     }
 
-    //////// HENKE and ELEMENT INFO /////////////
-    const std::string element_csv_filename = exe_loc + "../reference/xrf_library.csv";
-    const std::string element_henke_filename = exe_loc + "../reference/henke.xdr";
-    const std::string scaler_lookup_yaml = exe_loc + "../reference/Scaler_to_PV_map.yaml";
+    //threads and memory are for the whole batch, the lines may have set their own
+    data_struct::Analysis_Job<float> batch_job;
+    set_num_threads(clp, batch_job);
+    set_mem_limit(clp, batch_job);
+    long long mem_budget = batch_job.mem_limit;
+    if (mem_budget <= 0)
+    {
+        mem_budget = (long long)(get_available_mem() * 3 / 4);
+    }
 
-    start = std::chrono::system_clock::now();
+    process_batch(analysis_jobs, batch_job.num_threads, batch_job.numa_pin_threads, mem_budget);
+
+    for (auto* analysis_job : analysis_jobs)
+    {
+        delete analysis_job;
+    }
+    //averages, v9 layout, exchange ... per line once everything is fitted
+    for (auto& line_clp : line_clps)
+    {
+        run_h5_file_updates(line_clp);
+    }
+    return 0;
+}
 
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief Reference_Data : Reference files every job needs, with the signatures they were loaded at.
+ */
+struct Reference_Data
+{
+    std::string element_csv_filename;
+    std::string element_henke_filename;
+    std::string scaler_lookup_yaml;
+    std::vector<std::string> signatures;
+    double load_seconds = 0.0;
+};
 
-    if (false == io::file::load_scalers_lookup(scaler_lookup_yaml))
+// ----------------------------------------------------------------------------
+
+//modification time and size, empty if the file does not exist
+std::string file_signature(const std::string& path)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
     {
-        logE << " Could not load " << scaler_lookup_yaml << ". Won't be able to translate from PV to Label for scalers!\n";
+        return "";
+    }
+    return std::to_string((long long)st.st_mtime) + ":" + std::to_string((long long)st.st_size);
+}
+
+// ----------------------------------------------------------------------------
+
+std::vector<std::string> reference_signatures(const Reference_Data& reference_data)
+{
+    return { file_signature(reference_data.element_csv_filename), file_signature(reference_data.element_henke_filename), file_signature(reference_data.scaler_lookup_yaml) };
+}
+
+// ----------------------------------------------------------------------------
+
+bool load_reference_data(Reference_Data& reference_data)
+{
+    std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now();
+    reference_data.signatures = reference_signatures(reference_data);
+
+    if (false == io::file::load_scalers_lookup(reference_data.scaler_lookup_yaml))
+    {
+        logE << " Could not load " << reference_data.scaler_lookup_yaml << ". Won't be able to translate from PV to Label for scalers!\n";
     }
 
     //load element information
-    if (false == io::file::load_element_info<float>(element_henke_filename, element_csv_filename))
+    if (false == io::file::load_element_info<float>(reference_data.element_henke_filename, reference_data.element_csv_filename))
     {
         logE << "loading element information: " << "\n";
-        return -1;
+        return false;
     }
-    if (false == io::file::load_element_info<double>(element_henke_filename, element_csv_filename))
+    if (false == io::file::load_element_info<double>(reference_data.element_henke_filename, reference_data.element_csv_filename))
     {
         logE << "loading element information: " << "\n";
-        return -1;
+        return false;
     }
-    
-    Command_Line_Parser clp(argc, argv);
 
-    if (clp.option_exists("-h"))
+    std::chrono::duration<double> elapsed_seconds = std::chrono::system_clock::now() - start;
+    reference_data.load_seconds = elapsed_seconds.count();
+    logI << "Reference data elapsed time: " << reference_data.load_seconds << "s\n";
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief Server_Job : Fit job kept initialized by the server, with the override files it was set up from.
+ */
+struct Server_Job
+{
+    data_struct::Analysis_Job<float>* analysis_job = nullptr;
+    std::vector<std::string> override_signatures;
+};
+
+// ----------------------------------------------------------------------------
+
+//every override file init_analysis_job_detectors may have read
+std::vector<std::string> override_signatures(const data_struct::Analysis_Job<float>& analysis_job)
+{
+    std::vector<std::string> signatures;
+    for (const std::string& dir : { analysis_job.dataset_directory, std::string("./") })
     {
-        help();
-        return 0;
+        signatures.push_back(file_signature(dir + "maps_fit_parameters_override.txt"));
+        for (size_t detector_num : analysis_job.detector_num_arr)
+        {
+            signatures.push_back(file_signature(dir + "maps_fit_parameters_override.txt" + std::to_string(detector_num)));
+        }
+    }
+    return signatures;
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief run_server_fits : run_fits for the server. Jobs with the same options apart from --files reuse one analysis job,
+ *                          so the override parameters, detector models and fit routine element models are only set up once.
+ */
+int run_server_fits(Command_Line_Parser& clp, const std::vector<std::string>& tokens, std::map<std::string, Server_Job>& server_jobs)
+{
+    std::string key;
+    for (size_t i = 0; i < tokens.size(); i++)
+    {
+        if (tokens[i] == "--files")
+        {
+            i++;
+            continue;
+        }
+        key += tokens[i] + "\n";
     }
 
+    auto itr = server_jobs.find(key);
+    if (itr != server_jobs.end())
+    {
+        data_struct::Analysis_Job<float>* analysis_job = itr->second.analysis_job;
+        if (override_signatures(*analysis_job) == itr->second.override_signatures)
+        {
+            logI << "Reusing initialized job for " << analysis_job->dataset_directory << "\n";
+            analysis_job->dataset_files.clear();
+            analysis_job->optimize_dataset_files.clear();
+            //another job may have changed the thread budget
+            set_num_threads(clp, *analysis_job);
+            if (set_dir_and_files(clp, *analysis_job) == -1)
+            {
+                return -1;
+            }
+            fit_datasets(*analysis_job);
+            return 0;
+        }
+        logI << "Override parameters changed, reloading " << analysis_job->dataset_directory << "\n";
+        delete analysis_job;
+        server_jobs.erase(itr);
+    }
+
+    Server_Job server_job;
+    server_job.analysis_job = new data_struct::Analysis_Job<float>();
+    if (init_fit_job(clp, *server_job.analysis_job) == -1)
+    {
+        delete server_job.analysis_job;
+        return -1;
+    }
+    server_job.override_signatures = override_signatures(*server_job.analysis_job);
+    fit_datasets(*server_job.analysis_job);
+    server_jobs[key] = server_job;
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief run_command : Everything one command line asks for. The server passes its job cache, the command line passes nullptr.
+ */
+int run_command(Command_Line_Parser& clp, const std::vector<std::string>& tokens, std::map<std::string, Server_Job>* server_jobs)
+{
+    int ret = 0;
     if (clp.option_exists("--optimize-fit-override-params"))
     {
         run_optimization(clp);
@@ -955,9 +1361,20 @@ int main(int argc, char* argv[])
     {
         run_streaming(clp);
     }
+    else if (clp.option_exists("--batch"))
+    {
+        ret = run_batch(clp, tokens);
+    }
     else if (clp.option_exists("--fit") )
     {
-        run_fits(clp);
+        if (server_jobs != nullptr)
+        {
+            ret = run_server_fits(clp, tokens, *server_jobs);
+        }
+        else
+        {
+            ret = run_fits(clp);
+        }
     }
 
     if (clp.option_exists("--quantify-with"))
@@ -970,7 +1387,196 @@ int main(int argc, char* argv[])
         run_optimize_rois(clp);
     }
 
-    run_h5_file_updates(clp);
+    //batch lines are updated by run_batch
+    if (false == clp.option_exists("--batch"))
+    {
+        run_h5_file_updates(clp);
+    }
+    return ret;
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief run_server : Take jobs from --connect clients one at a time until one sends --shutdown.
+ */
+int run_server(Command_Line_Parser& clp, Reference_Data& reference_data)
+{
+    if (false == Local_Server::supported())
+    {
+        logE << "--server needs Unix domain sockets, not available on this platform\n";
+        return -1;
+    }
+    Local_Server server(clp.get_option("--server"));
+    if (false == server.open())
+    {
+        return -1;
+    }
+
+    std::map<std::string, Server_Job> server_jobs;
+    std::vector<std::string> tokens;
+    size_t job_num = 0;
+    while (server.next_request(tokens))
+    {
+        Command_Line_Parser job_clp(tokens);
+        if (job_clp.option_exists("--shutdown"))
+        {
+            server.reply("OK shutting down");
+            break;
+        }
+        if (job_clp.option_exists("--server") || job_clp.option_exists("--streamin") || job_clp.option_exists("--streamout"))
+        {
+            server.reply("ERROR --server, --streamin and --streamout can not run as server jobs");
+            continue;
+        }
+
+        job_num++;
+        std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now();
+        int ret = 0;
+        try
+        {
+            if (reference_signatures(reference_data) != reference_data.signatures)
+            {
+                logI << "Reference files changed, reloading\n";
+                //the cached jobs point into the element info
+                for (auto& itr : server_jobs)
+                {
+                    delete itr.second.analysis_job;
+                }
+                server_jobs.clear();
+                data_struct::Element_Info_Map<float>::inst()->clear();
+                data_struct::Element_Info_Map<double>::inst()->clear();
+                data_struct::Scaler_Lookup::inst()->clear();
+                if (false == load_reference_data(reference_data))
+                {
+                    ret = -1;
+                }
+            }
+            if (ret == 0)
+            {
+                ret = run_command(job_clp, tokens, &server_jobs);
+            }
+        }
+        catch (std::exception& e)
+        {
+            logE << "Server job " << job_num << " failed: " << e.what() << "\n";
+            ret = -1;
+        }
+        std::chrono::duration<double> elapsed_seconds = std::chrono::system_clock::now() - start;
+        logI << "Server job " << job_num << " elapsed time: " << elapsed_seconds.count() << "s\n";
+
+        std::stringstream ss;
+        ss << (ret == 0 ? "OK" : "ERROR") << " job " << job_num << " elapsed " << elapsed_seconds.count() << "s, reference data load skipped " << reference_data.load_seconds << "s";
+        server.reply(ss.str());
+    }
+
+    for (auto& itr : server_jobs)
+    {
+        delete itr.second.analysis_job;
+    }
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief run_client : Send this command line to a --server and print its answer.
+ */
+int run_client(const std::vector<std::string>& tokens)
+{
+    std::string socket_path;
+    std::vector<std::string> job_tokens;
+    for (size_t i = 0; i < tokens.size(); i++)
+    {
+        if (tokens[i] == "--connect")
+        {
+            if (i + 1 < tokens.size())
+            {
+                socket_path = tokens[i + 1];
+            }
+            i++;
+            continue;
+        }
+        if (tokens[i] == "--dir" && i + 1 < tokens.size() && tokens[i + 1].length() > 0 && tokens[i + 1][0] != DIR_END_CHAR)
+        {
+            logW << "Relative --dir " << tokens[i + 1] << " is looked up from the server's working directory\n";
+        }
+        job_tokens.push_back(tokens[i]);
+    }
+
+    std::string reply;
+    if (false == Local_Server::send_request(socket_path, job_tokens, reply))
+    {
+        logE << "No answer from server " << socket_path << "\n";
+        return -1;
+    }
+    logI << reply << "\n";
+    return (reply.compare(0, 2, "OK") == 0) ? 0 : -1;
+}
+
+// ----------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+    
+    std::string whole_command_line = "";
+    for (int i = 0; i < argc; i++)
+    {
+        whole_command_line += std::string(argv[i]) + " ";
+    }
+    logI << whole_command_line << "\n";
+
+    //Performance measure
+    std::chrono::time_point<std::chrono::system_clock> start, end;
+
+    // get location of where we are running from and use it to find ref files
+    std::string exe_loc = std::string(argv[0]);
+    int prog_idx = exe_loc.find("xrf_maps");
+    if (prog_idx > 0)
+    {
+        exe_loc = exe_loc.substr(0, prog_idx);
+    }
+
+    std::vector<std::string> tokens;
+    for (int i = 1; i < argc; i++)
+    {
+        tokens.push_back(std::string(argv[i]));
+    }
+    Command_Line_Parser clp(tokens);
+
+    if (clp.option_exists("-h"))
+    {
+        help();
+        return 0;
+    }
+
+    //the server has the reference data loaded already
+    if (clp.option_exists("--connect"))
+    {
+        return run_client(tokens);
+    }
+
+    //////// HENKE and ELEMENT INFO /////////////
+    Reference_Data reference_data;
+    reference_data.element_csv_filename = exe_loc + "../reference/xrf_library.csv";
+    reference_data.element_henke_filename = exe_loc + "../reference/henke.xdr";
+    reference_data.scaler_lookup_yaml = exe_loc + "../reference/Scaler_to_PV_map.yaml";
+
+    start = std::chrono::system_clock::now();
+
+    if (false == load_reference_data(reference_data))
+    {
+        return -1;
+    }
+
+    if (clp.option_exists("--server"))
+    {
+        run_server(clp, reference_data);
+    }
+    else
+    {
+        run_command(clp, tokens, nullptr);
+    }
 
     end = std::chrono::system_clock::now();
     std::chrono::duration<double> elapsed_seconds = end - start;
@@ -0,0 +1,287 @@
+/***
+Copyright (c) 2016, UChicago Argonne, LLC. All rights reserved.
+
+Copyright 2016. UChicago Argonne, LLC. This software was produced
+under U.S. Government contract DE-AC02-06CH11357 for Argonne National
+Laboratory (ANL), which is operated by UChicago Argonne, LLC for the
+U.S. Department of Energy. The U.S. Government has rights to use,
+reproduce, and distribute this software.  NEITHER THE GOVERNMENT NOR
+UChicago Argonne, LLC MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR
+ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  If software is
+modified to produce derivative works, such modified software should
+be clearly marked, so as not to confuse it with the version available
+from ANL.
+
+Additionally, redistribution and use in source and binary forms, with
+or without modification, are permitted provided that the following
+conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the name of UChicago Argonne, LLC, Argonne National
+      Laboratory, ANL, the U.S. Government, nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY UChicago Argonne, LLC AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL UChicago
+Argonne, LLC OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+***/
+
+
+#ifndef PROCESS_BATCH
+#define PROCESS_BATCH
+
+#include <algorithm>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <thread>
+
+#include "core/process_whole.h"
+#include "io/file/file_scan.h"
+#include "io/file/mda_io.h"
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief Batch_Unit : One dataset and detector of a batch job. Loaded and saved on the io thread, fitted on its own driver thread.
+ */
+template<typename T_real>
+struct Batch_Unit
+{
+    data_struct::Analysis_Job<T_real>* analysis_job = nullptr;
+    std::string dataset_file;
+    size_t detector_num = 0;
+    long long est_bytes = 0;
+
+    data_struct::Spectra_Volume<T_real>* spectra_volume = nullptr;
+    bool loaded_from_analyzed_hdf5 = false;
+    std::vector<std::pair<data_struct::Fitting_Routines, fitting::routines::Base_Fit_Routine<T_real>*>> fit_routines;
+    std::vector<data_struct::Fit_Count_Dict<T_real>*> fit_counts;
+    std::thread driver;
+    double fit_seconds = 0.0;
+};
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief estimate_dataset_bytes : Size of a loaded spectra volume, from the mda dimensions or else the file size. -1 if unknown.
+ */
+template<typename T_real>
+DLL_EXPORT long long estimate_dataset_bytes(const std::string& dataset_directory, const std::string& dataset_file)
+{
+    std::string ending = ".mda";
+    if (dataset_file.length() > ending.length() && dataset_file.compare(dataset_file.length() - ending.length(), ending.length(), ending) == 0)
+    {
+        long dims = io::file::mda_get_multiplied_dims(dataset_directory + "mda" + DIR_END_CHAR + dataset_file);
+        if (dims > -1)
+        {
+            return (long long)dims * sizeof(T_real);
+        }
+    }
+    std::ifstream in((dataset_directory + dataset_file).c_str(), std::ifstream::ate | std::ifstream::binary);
+    return (long long)in.tellg();
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief fit_batch_unit : Driver thread body. Fits every routine of the detector with routines owned by the unit, on the shared pool.
+ */
+template<typename T_real>
+DLL_EXPORT void fit_batch_unit(Batch_Unit<T_real>* unit, ThreadPool* tp)
+{
+    std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now();
+    data_struct::Detector<T_real>* detector = unit->analysis_job->get_detector(unit->detector_num);
+    data_struct::Params_Override<T_real>* override_params = &(detector->fit_params_override_dict);
+
+    //same order as proc_spectra
+    for (auto& itr : detector->fit_routines)
+    {
+        if (override_params->elements_to_fit.size() < 1)
+        {
+            logE << "No elements to fit. Check  maps_fit_parameters_override.txt0 - 3 exist" << "\n";
+            continue;
+        }
+        fitting::routines::Base_Fit_Routine<T_real>* fit_routine = io::file::generate_fit_routine<T_real>(itr.first, unit->analysis_job->optimizer());
+        if (fit_routine == nullptr)
+        {
+            continue;
+        }
+        unit->analysis_job->init_fit_routine(unit->detector_num, itr.first, fit_routine, unit->spectra_volume->samples_size());
+        logI << "Processing  " << unit->dataset_file << " detector " << unit->detector_num << " " << fit_routine->get_name() << "\n";
+        unit->fit_routines.push_back({ itr.first, fit_routine });
+        unit->fit_counts.push_back(fit_spectra_volume(itr.first, fit_routine, detector->model, unit->spectra_volume, &override_params->elements_to_fit, tp));
+    }
+
+    std::chrono::duration<double> elapsed_seconds = std::chrono::system_clock::now() - start;
+    unit->fit_seconds = elapsed_seconds.count();
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief process_batch : Process every dataset and detector of several jobs with one scheduler.
+ *  Units are started largest first. All hdf5 and file loading stays on the calling thread, which loads the next unit while
+ *  earlier ones fit on the shared pool, as long as the loaded volumes stay inside mem_budget bytes (0 = no limit).
+ *  Each unit saves to the same file with the same contents as process_dataset_files.
+ */
+template<typename T_real>
+DLL_EXPORT void process_batch(std::vector<data_struct::Analysis_Job<T_real>*>& analysis_jobs, size_t num_threads, bool numa_pin, long long mem_budget)
+{
+    //one unit being fitted, one loaded and waiting, one saving
+    const size_t max_in_flight = 3;
+
+    std::chrono::time_point<std::chrono::system_clock> batch_start = std::chrono::system_clock::now();
+    double load_seconds = 0.0;
+    double fit_seconds = 0.0;
+    double save_seconds = 0.0;
+
+    std::list<Batch_Unit<T_real>*> pending;
+    for (auto* analysis_job : analysis_jobs)
+    {
+        analysis_job->prepare_fit_routine_init();
+        if (analysis_job->quick_and_dirty || analysis_job->preview_bin_sizes.size() > 0 || analysis_job->row_shards > 1)
+        {
+            logW << "Quick and dirty, preview bins and row shards are not used in batch mode: " << analysis_job->dataset_directory << "\n";
+        }
+        for (const auto& dataset_file : analysis_job->dataset_files)
+        {
+            long long est_bytes = estimate_dataset_bytes<T_real>(analysis_job->dataset_directory, dataset_file);
+            for (size_t detector_num : analysis_job->detector_num_arr)
+            {
+                Batch_Unit<T_real>* unit = new Batch_Unit<T_real>();
+                unit->analysis_job = analysis_job;
+                unit->dataset_file = dataset_file;
+                unit->detector_num = detector_num;
+                unit->est_bytes = std::max(est_bytes, 0LL);
+                pending.push_back(unit);
+            }
+        }
+    }
+    //largest first so the small ones fill in the tail
+    pending.sort([](const Batch_Unit<T_real>* a, const Batch_Unit<T_real>* b) { return a->est_bytes > b->est_bytes; });
+    size_t num_units = pending.size();
+    logI << "Batch of " << analysis_jobs.size() << " jobs, " << num_units << " dataset detectors, memory budget " << (mem_budget / (1024 * 1024)) << " MB\n";
+
+    ThreadPool tp(num_threads, numa_pin);
+
+    std::mutex done_mutex;
+    std::condition_variable done_cond;
+    std::list<Batch_Unit<T_real>*> done;
+    size_t in_flight = 0;
+    long long in_flight_bytes = 0;
+    std::string scanned_directory;
+
+    while (pending.size() > 0 || in_flight > 0)
+    {
+        //save whatever finished first so its memory is freed before the next load
+        std::list<Batch_Unit<T_real>*> to_save;
+        {
+            std::unique_lock<std::mutex> lock(done_mutex);
+            bool can_load = pending.size() > 0 && in_flight < max_in_flight
+                && (in_flight == 0 || mem_budget <= 0 || in_flight_bytes + pending.front()->est_bytes <= mem_budget);
+            if (false == can_load)
+            {
+                done_cond.wait(lock, [&done]() { return done.size() > 0; });
+            }
+            to_save.swap(done);
+        }
+
+        for (auto* unit : to_save)
+        {
+            std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now();
+            unit->driver.join();
+            data_struct::Detector<T_real>* detector = unit->analysis_job->get_detector(unit->detector_num);
+            io::file::HDF5_IO::inst()->start_save_seq(dataset_save_path(unit->analysis_job, unit->dataset_file, unit->detector_num), false);
+            for (size_t i = 0; i < unit->fit_routines.size(); i++)
+            {
+                save_fit_routine_results(unit->fit_routines[i].first, unit->fit_routines[i].second, unit->fit_counts[i], unit->spectra_volume, detector);
+                unit->fit_counts[i]->clear();
+                delete unit->fit_counts[i];
+                delete unit->fit_routines[i].second;
+            }
+            save_proc_spectra_end(unit->spectra_volume, detector, !unit->loaded_from_analyzed_hdf5);
+            std::chrono::duration<double> elapsed_seconds = std::chrono::system_clock::now() - start;
+            save_seconds += elapsed_seconds.count();
+            fit_seconds += unit->fit_seconds;
+
+            in_flight--;
+            in_flight_bytes -= unit->est_bytes;
+            delete unit->spectra_volume;
+            delete unit;
+        }
+
+        if (pending.size() == 0 || in_flight >= max_in_flight
+            || (in_flight > 0 && mem_budget > 0 && in_flight_bytes + pending.front()->est_bytes > mem_budget))
+        {
+            continue;
+        }
+
+        Batch_Unit<T_real>* unit = pending.front();
+        pending.pop_front();
+        data_struct::Analysis_Job<T_real>* analysis_job = unit->analysis_job;
+        data_struct::Detector<T_real>* detector = analysis_job->get_detector(unit->detector_num);
+        std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now();
+
+        //netcdf / hdf5 lookups are per directory
+        if (scanned_directory != analysis_job->dataset_directory)
+        {
+            io::file::File_Scan::inst()->populate_netcdf_hdf5_files(analysis_job->dataset_directory);
+            scanned_directory = analysis_job->dataset_directory;
+        }
+
+        unit->spectra_volume = new data_struct::Spectra_Volume<T_real>();
+        io::file::HDF5_IO::inst()->set_filename(dataset_save_path(analysis_job, unit->dataset_file, unit->detector_num));
+        bool loaded = detector != nullptr && io::file::load_spectra_volume(analysis_job->dataset_directory, unit->dataset_file, unit->detector_num, unit->spectra_volume, &detector->fit_params_override_dict, &unit->loaded_from_analyzed_hdf5, true);
+        //the save reopens the file once the fits are done
+        io::file::HDF5_IO::inst()->end_save_seq();
+        if (false == loaded)
+        {
+            logW << "Skipping " << unit->dataset_file << " detector " << unit->detector_num << "\n";
+            delete unit->spectra_volume;
+            delete unit;
+            continue;
+        }
+        rehome_spectra_volume(unit->spectra_volume, &tp);
+        std::chrono::duration<double> elapsed_seconds = std::chrono::system_clock::now() - start;
+        load_seconds += elapsed_seconds.count();
+
+        //account what was actually loaded
+        unit->est_bytes = (long long)unit->spectra_volume->rows() * unit->spectra_volume->cols() * unit->spectra_volume->samples_size() * sizeof(T_real);
+        in_flight++;
+        in_flight_bytes += unit->est_bytes;
+
+        unit->driver = std::thread([unit, &tp, &done_mutex, &done_cond, &done]()
+        {
+            fit_batch_unit(unit, &tp);
+            std::lock_guard<std::mutex> lock(done_mutex);
+            done.push_back(unit);
+            done_cond.notify_one();
+        });
+    }
+
+    std::chrono::duration<double> elapsed_seconds = std::chrono::system_clock::now() - batch_start;
+    logI << "Batch stage totals: load " << load_seconds << "s, fit " << fit_seconds << "s, save " << save_seconds << "s\n";
+    logI << "Batch of " << num_units << " dataset detectors makespan: " << elapsed_seconds.count() << "s\n";
+}
+
+// ----------------------------------------------------------------------------
+
+#endif
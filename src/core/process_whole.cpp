@@ -47,88 +47,299 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "core/process_whole.h"
 #include <algorithm>
+#include <random>
 
 using namespace std::placeholders; //for _1, _2,
 
 // ----------------------------------------------------------------------------
 // ----------------------------------------------------------------------------
 
-bool optimize_integrated_fit_params(data_struct::Analysis_Job<double> * analysis_job,
-                                    const data_struct::Spectra<double>& int_spectra,
-                                    size_t detector_num,
-                                    const data_struct::Params_Override<double>* const params_override,
-                                    std::string save_filename,
-                                    data_struct::Fit_Parameters<double>& out_fitp,
-                                    Callback_Func_Status_Def* status_callback)
+bool integrated_fit_outcome_ok(fitting::optimizers::OPTIMIZER_OUTCOME outcome)
+{
+    switch (outcome)
+    {
+    case fitting::optimizers::OPTIMIZER_OUTCOME::CONVERGED:
+    case fitting::optimizers::OPTIMIZER_OUTCOME::F_TOL_LT_TOL:
+    case fitting::optimizers::OPTIMIZER_OUTCOME::X_TOL_LT_TOL:
+    case fitting::optimizers::OPTIMIZER_OUTCOME::G_TOL_LT_TOL:
+    case fitting::optimizers::OPTIMIZER_OUTCOME::EXHAUSTED:
+        return true;
+    case fitting::optimizers::OPTIMIZER_OUTCOME::CRASHED:
+    case fitting::optimizers::OPTIMIZER_OUTCOME::EXPLODED:
+    case fitting::optimizers::OPTIMIZER_OUTCOME::FAILED:
+    case fitting::optimizers::OPTIMIZER_OUTCOME::FOUND_NAN:
+    case fitting::optimizers::OPTIMIZER_OUTCOME::FOUND_ZERO:
+    case fitting::optimizers::OPTIMIZER_OUTCOME::STOPPED:
+    case fitting::optimizers::OPTIMIZER_OUTCOME::TRAPPED:
+        return false;
+    }
+    return false;
+}
+
+// ----------------------------------------------------------------------------
+
+fitting::optimizers::Optimizer<double>* clone_optimizer(fitting::optimizers::Optimizer<double>* optimizer)
+{
+    fitting::optimizers::Optimizer<double>* clone;
+    if (dynamic_cast<fitting::optimizers::MPFit_Optimizer<double>*>(optimizer) != nullptr)
+    {
+        clone = new fitting::optimizers::MPFit_Optimizer<double>();
+    }
+    else
+    {
+        clone = new fitting::optimizers::LMFit_Optimizer<double>();
+    }
+    clone->set_options(optimizer->get_options());
+    clone->set_parallel_jacobian(optimizer->parallel_jacobian());
+    fitting::optimizers::LMFit_Optimizer<double>* lmfit = dynamic_cast<fitting::optimizers::LMFit_Optimizer<double>*>(optimizer);
+    if (lmfit != nullptr)
+    {
+        ((fitting::optimizers::LMFit_Optimizer<double>*)clone)->set_mixed_precision(lmfit->mixed_precision());
+    }
+    return clone;
+}
+
+// ----------------------------------------------------------------------------
+
+fitting::optimizers::OPTIMIZER_OUTCOME fit_integrated_spectra(data_struct::Analysis_Job<double>* analysis_job,
+                                                              fitting::optimizers::Optimizer<double>* optimizer,
+                                                              const data_struct::Spectra<double>& int_spectra,
+                                                              const data_struct::Params_Override<double>* const params_override,
+                                                              fitting::models::Fit_Params_Preset preset,
+                                                              unsigned int perturb_seed,
+                                                              bool print_params,
+                                                              data_struct::Fit_Parameters<double>& out_fitp,
+                                                              Callback_Func_Status_Def* status_callback)
 {
     fitting::models::Gaussian_Model<double> model;
-    bool ret_val = false;
 
-    if (params_override != nullptr)
+    //Range of energy in spectra to fit
+    fitting::models::Range energy_range = data_struct::get_energy_range<double>(int_spectra.size(), &(params_override->fit_params));
+
+    //Fitting routines
+    fitting::routines::Param_Optimized_Fit_Routine<double>* fit_routine;
+
+    if (analysis_job->optimize_fit_routine == OPTIMIZE_FIT_ROUTINE::HYBRID)
     {
-        //Range of energy in spectra to fit
-        fitting::models::Range energy_range = data_struct::get_energy_range<double>(int_spectra.size(), &(params_override->fit_params));
+        fit_routine = new fitting::routines::Hybrid_Param_NNLS_Fit_Routine<double>();
+    }
+    else
+    {
+        fit_routine = new fitting::routines::Param_Optimized_Fit_Routine<double>();
+    }
 
-        //Fitting routines
-        fitting::routines::Param_Optimized_Fit_Routine<double>* fit_routine;
+    fit_routine->set_optimizer(optimizer);
+    fit_routine->set_update_coherent_amplitude_on_fit(false);
 
+    //reset model fit parameters to defaults
+    model.reset_to_default_fit_params();
+    //Update fit parameters by override values
+    model.update_fit_params_values(&(params_override->fit_params));
+    if (preset != fitting::models::Fit_Params_Preset::NOT_SET)
+    {
+        //set fixed/fit preset
+        model.set_fit_params_preset(preset);
+    }
 
-        if (analysis_job->optimize_fit_routine == OPTIMIZE_FIT_ROUTINE::HYBRID)
+    if (perturb_seed > 0)
+    {
+        // scale the free peak shape parameters by +-25%, energy calibration and amplitudes keep their start values
+        std::mt19937 rng(perturb_seed);
+        std::uniform_real_distribution<double> scale(0.75, 1.25);
+        data_struct::Fit_Parameters<double> start_params = model.fit_parameters();
+        for (const auto& itr : model.fit_parameters())
         {
-            fit_routine = new fitting::routines::Hybrid_Param_NNLS_Fit_Routine<double>();
+            const data_struct::Fit_Param<double>& param = itr.second;
+            if (param.bound_type == data_struct::E_Bound_Type::FIXED
+                || itr.first == STR_ENERGY_OFFSET || itr.first == STR_ENERGY_SLOPE || itr.first == STR_ENERGY_QUADRATIC
+                || itr.first == STR_COHERENT_SCT_ENERGY || itr.first == STR_COHERENT_SCT_AMPLITUDE || itr.first == STR_COMPTON_AMPLITUDE)
+            {
+                continue;
+            }
+            double value = param.value * scale(rng);
+            if (param.bound_type == data_struct::E_Bound_Type::LIMITED_LO_HI || param.bound_type == data_struct::E_Bound_Type::LIMITED_LO)
+            {
+                value = std::max(value, param.min_val);
+            }
+            if (param.bound_type == data_struct::E_Bound_Type::LIMITED_LO_HI || param.bound_type == data_struct::E_Bound_Type::LIMITED_HI)
+            {
+                value = std::min(value, param.max_val);
+            }
+            start_params[itr.first].value = value;
         }
-        else
+        model.update_fit_params_values(&start_params);
+    }
+
+    if (print_params)
+    {
+        model.print_fit_params();
+    }
+
+    //Initialize the fit routine
+    fit_routine->initialize(&model, &params_override->elements_to_fit, energy_range);
+
+    //Fit the spectra saving the element counts in element_fit_count_dict
+    fitting::optimizers::OPTIMIZER_OUTCOME outcome = fit_routine->fit_spectra_parameters(&model, &int_spectra, &params_override->elements_to_fit, analysis_job->use_weights, out_fitp, status_callback);
+    out_fitp.add_parameter(data_struct::Fit_Param<double>(STR_OUTCOME, double(outcome)));
+
+    delete fit_routine;
+    return outcome;
+}
+
+// ----------------------------------------------------------------------------
+
+fitting::optimizers::OPTIMIZER_OUTCOME fit_integrated_spectra_multi_start(data_struct::Analysis_Job<double>* analysis_job,
+                                                                          const data_struct::Spectra<double>& int_spectra,
+                                                                          const data_struct::Params_Override<double>* const params_override,
+                                                                          size_t num_threads,
+                                                                          data_struct::Fit_Parameters<double>& out_fitp)
+{
+    struct Candidate
+    {
+        fitting::models::Fit_Params_Preset preset;
+        unsigned int seed;
+        fitting::optimizers::Optimizer<double>* optimizer;
+        fitting::optimizers::OPTIMIZER_OUTCOME outcome;
+        data_struct::Fit_Parameters<double> fitp;
+    };
+
+    std::vector<fitting::models::Fit_Params_Preset> presets;
+    presets.push_back(analysis_job->optimize_fit_params_preset);
+    for (const auto& preset : analysis_job->optimize_multi_start_presets)
+    {
+        if (std::find(presets.begin(), presets.end(), preset) == presets.end())
         {
-            fit_routine = new fitting::routines::Param_Optimized_Fit_Routine<double>();
+            presets.push_back(preset);
         }
+    }
 
-        fit_routine->set_optimizer(analysis_job->optimizer());
-        fit_routine->set_update_coherent_amplitude_on_fit(false);
+    // seed 0 is the unperturbed start of each preset
+    std::vector<Candidate> candidates;
+    for (const auto& preset : presets)
+    {
+        for (unsigned int seed = 0; seed < (unsigned int)std::max((size_t)1, analysis_job->optimize_num_starts); seed++)
+        {
+            Candidate candidate;
+            candidate.preset = preset;
+            candidate.seed = seed;
+            candidate.outcome = fitting::optimizers::OPTIMIZER_OUTCOME::FAILED;
+            // each candidate gets its own optimizer so they can run at the same time
+            candidate.optimizer = clone_optimizer(analysis_job->optimizer());
+            candidates.push_back(candidate);
+        }
+    }
 
-        //reset model fit parameters to defaults
-        model.reset_to_default_fit_params();
-        //Update fit parameters by override values
-        model.update_fit_params_values(&(params_override->fit_params));
-        if (analysis_job->optimize_fit_params_preset != fitting::models::Fit_Params_Preset::NOT_SET)
+    num_threads = std::max((size_t)1, std::min(num_threads, candidates.size()));
+    logI << "Multi start optimization with " << candidates.size() << " candidates on " << num_threads << " threads\n";
+    std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now();
+    if (num_threads < 2)
+    {
+        for (auto& candidate : candidates)
+        {
+            candidate.outcome = fit_integrated_spectra(analysis_job, candidate.optimizer, int_spectra, params_override, candidate.preset, candidate.seed, false, candidate.fitp, nullptr);
+        }
+    }
+    else
+    {
+        ThreadPool tp(num_threads);
+        std::vector<std::future<fitting::optimizers::OPTIMIZER_OUTCOME>> jobs;
+        for (auto& candidate : candidates)
+        {
+            jobs.push_back(tp.enqueue([analysis_job, &int_spectra, params_override, &candidate]()
+            {
+                return fit_integrated_spectra(analysis_job, candidate.optimizer, int_spectra, params_override, candidate.preset, candidate.seed, false, candidate.fitp, nullptr);
+            }));
+        }
+        for (size_t i = 0; i < jobs.size(); i++)
         {
-            //set fixed/fit preset
-            model.set_fit_params_preset(analysis_job->optimize_fit_params_preset);
+            candidates[i].outcome = jobs[i].get();
         }
+    }
+    std::chrono::duration<double> elapsed_seconds = std::chrono::system_clock::now() - start;
+    logI << "Multi start elapsed time: " << elapsed_seconds.count() << "s\n";
 
-        model.print_fit_params();
+    // keep the lowest residual, prefer candidates with a usable outcome
+    int best = -1;
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+        const Candidate& candidate = candidates[i];
+        double residual = candidate.fitp.contains(STR_RESIDUAL) ? candidate.fitp.value(STR_RESIDUAL) : std::numeric_limits<double>::quiet_NaN();
+        double num_itr = candidate.fitp.contains(STR_NUM_ITR) ? candidate.fitp.value(STR_NUM_ITR) : 0.0;
+        logI << "Candidate " << i << " preset " << (int)candidate.preset << " start " << candidate.seed << " : outcome " << optimizer_outcome_to_str(candidate.outcome) << " residual " << residual << " iterations " << num_itr << "\n";
 
-        //Initialize the fit routine
-        fit_routine->initialize(&model, &params_override->elements_to_fit, energy_range);
+        if (false == std::isfinite(residual))
+        {
+            continue;
+        }
+        if (best == -1)
+        {
+            best = (int)i;
+            continue;
+        }
+        bool ok = integrated_fit_outcome_ok(candidate.outcome);
+        bool best_ok = integrated_fit_outcome_ok(candidates[best].outcome);
+        if ((ok && false == best_ok) || (ok == best_ok && residual < candidates[best].fitp.value(STR_RESIDUAL)))
+        {
+            best = (int)i;
+        }
+    }
+
+    if (best == -1)
+    {
+        // no finite residual anywhere, keep the unperturbed start of the main preset so callers still get every parameter
+        logW << "No multi start candidate has a finite residual, using candidate 0\n";
+        best = 0;
+    }
+    logI << "Best candidate " << best << " preset " << (int)candidates[best].preset << " start " << candidates[best].seed << "\n";
+    out_fitp = candidates[best].fitp;
+    fitting::optimizers::OPTIMIZER_OUTCOME outcome = candidates[best].outcome;
+
+    for (auto& candidate : candidates)
+    {
+        delete candidate.optimizer;
+    }
+    return outcome;
+}
+
+// ----------------------------------------------------------------------------
+
+fitting::optimizers::OPTIMIZER_OUTCOME fit_integrated_fit_params(data_struct::Analysis_Job<double>* analysis_job,
+                                                                 fitting::optimizers::Optimizer<double>* optimizer,
+                                                                 const data_struct::Spectra<double>& int_spectra,
+                                                                 const data_struct::Params_Override<double>* const params_override,
+                                                                 bool print_params,
+                                                                 size_t num_threads,
+                                                                 data_struct::Fit_Parameters<double>& out_fitp,
+                                                                 Callback_Func_Status_Def* status_callback)
+{
+    if (analysis_job->optimize_num_starts > 1 || analysis_job->optimize_multi_start_presets.size() > 0)
+    {
+        return fit_integrated_spectra_multi_start(analysis_job, int_spectra, params_override, num_threads, out_fitp);
+    }
+    return fit_integrated_spectra(analysis_job, optimizer, int_spectra, params_override, analysis_job->optimize_fit_params_preset, 0, print_params, out_fitp, status_callback);
+}
+
+// ----------------------------------------------------------------------------
+
+bool optimize_integrated_fit_params(data_struct::Analysis_Job<double> * analysis_job,
+                                    const data_struct::Spectra<double>& int_spectra,
+                                    size_t detector_num,
+                                    const data_struct::Params_Override<double>* const params_override,
+                                    std::string save_filename,
+                                    data_struct::Fit_Parameters<double>& out_fitp,
+                                    Callback_Func_Status_Def* status_callback)
+{
+    bool ret_val = false;
 
-        //Fit the spectra saving the element counts in element_fit_count_dict
-        fitting::optimizers::OPTIMIZER_OUTCOME outcome = fit_routine->fit_spectra_parameters(&model, &int_spectra, &params_override->elements_to_fit, analysis_job->use_weights, out_fitp, status_callback);
-        out_fitp.add_parameter(data_struct::Fit_Param<double>(STR_OUTCOME, double(outcome)));
+    if (params_override != nullptr)
+    {
+        fitting::optimizers::OPTIMIZER_OUTCOME outcome = fit_integrated_fit_params(analysis_job, analysis_job->optimizer(), int_spectra, params_override, true, analysis_job->num_threads, out_fitp, status_callback);
         std::string result = optimizer_outcome_to_str(outcome);
         logI << "Outcome = " << result << "\n";
-        switch (outcome)
-        {
-        case fitting::optimizers::OPTIMIZER_OUTCOME::CONVERGED:
-        case fitting::optimizers::OPTIMIZER_OUTCOME::F_TOL_LT_TOL:
-        case fitting::optimizers::OPTIMIZER_OUTCOME::X_TOL_LT_TOL:
-        case fitting::optimizers::OPTIMIZER_OUTCOME::G_TOL_LT_TOL:
-        case fitting::optimizers::OPTIMIZER_OUTCOME::EXHAUSTED:
-            // if we have a good fit, update our fit parameters so we are closer for the next fit
-            //params_override->fit_params.update_values(&out_fitp);
-            ret_val = true;
-            break;
-        case fitting::optimizers::OPTIMIZER_OUTCOME::CRASHED:
-        case fitting::optimizers::OPTIMIZER_OUTCOME::EXPLODED:
-        case fitting::optimizers::OPTIMIZER_OUTCOME::FAILED:
-        case fitting::optimizers::OPTIMIZER_OUTCOME::FOUND_NAN:
-        case fitting::optimizers::OPTIMIZER_OUTCOME::FOUND_ZERO:
-        case fitting::optimizers::OPTIMIZER_OUTCOME::STOPPED:
-        case fitting::optimizers::OPTIMIZER_OUTCOME::TRAPPED:
-            ret_val = false;
-            break;
-        }
+        // if we have a good fit, update our fit parameters so we are closer for the next fit
+        //params_override->fit_params.update_values(&out_fitp);
+        ret_val = integrated_fit_outcome_ok(outcome);
         io::file::save_optimized_fit_params(analysis_job->dataset_directory, save_filename, detector_num, result, &out_fitp, &int_spectra, &(params_override->elements_to_fit));
-
-        delete fit_routine;
     }
     
     return ret_val;
@@ -137,13 +348,50 @@ bool optimize_integrated_fit_params(data_struct::Analysis_Job<double> * analysis
 
 // ----------------------------------------------------------------------------
 
+struct Optimal_Params_Job
+{
+    std::string dataset;
+    size_t detector_num;
+    data_struct::Params_Override<double>* params_override;
+    data_struct::Spectra<double> int_spectra;
+    fitting::optimizers::OPTIMIZER_OUTCOME outcome;
+    data_struct::Fit_Parameters<double> fitp;
+};
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief optimal_params_workers : optimize_dataset_workers (or num_threads) capped so the concurrent fits fit in available memory
+ */
+size_t optimal_params_workers(data_struct::Analysis_Job<double>* analysis_job, const Optimal_Params_Job& job, size_t num_jobs)
+{
+    size_t num_workers = (analysis_job->optimize_dataset_workers > 0) ? analysis_job->optimize_dataset_workers : analysis_job->num_threads;
+    num_workers = std::max((size_t)1, std::min(num_workers, num_jobs));
+
+    // model, residual and jacobian columns per fit, times the multi start candidates each job runs
+    size_t num_starts = std::max((size_t)1, analysis_job->optimize_num_starts) * (analysis_job->optimize_multi_start_presets.size() + 1);
+    long long job_mem = (long long)job.int_spectra.size() * sizeof(double) * (job.params_override->fit_params.size() + job.params_override->elements_to_fit.size() + 8) * num_starts;
+    long long avail_mem = get_available_mem();
+    if (job_mem > 0 && avail_mem > 0)
+    {
+        size_t mem_workers = std::max((long long)1, (avail_mem / 2) / job_mem);
+        if (mem_workers < num_workers)
+        {
+            logW << "Limiting optimization workers to " << mem_workers << " by available memory " << avail_mem << "\n";
+            num_workers = mem_workers;
+        }
+    }
+    return num_workers;
+}
+
+// ----------------------------------------------------------------------------
+
 void generate_optimal_params(data_struct::Analysis_Job<double>* analysis_job)
 {
     std::unordered_map<int, data_struct::Fit_Parameters<double>> fit_params_avgs;
     std::unordered_map<int, data_struct::Params_Override<double>*> params;
     std::unordered_map<int, float> detector_file_cnt;
     data_struct::Params_Override<double>* params_override = nullptr;
-    data_struct::Spectra<double> int_spectra;
 
     std::string full_path = analysis_job->dataset_directory + DIR_END_CHAR + "maps_fit_parameters_override.txt";
 
@@ -152,6 +400,15 @@ void generate_optimal_params(data_struct::Analysis_Job<double>* analysis_job)
         detector_file_cnt[detector_num] = 0.0;
     }
 
+    // jobs hold the int spectra the workers fit, reserve so they never move
+    std::vector<Optimal_Params_Job> jobs;
+    jobs.reserve(analysis_job->optimize_dataset_files.size() * analysis_job->detector_num_arr.size());
+    std::vector<std::future<fitting::optimizers::OPTIMIZER_OUTCOME>> futures;
+    ThreadPool* tp = nullptr;
+    size_t num_workers = 1;
+
+    std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now();
+    // datasets are loaded here one at a time and fit on the pool while the next one loads
     for (auto& itr : analysis_job->optimize_dataset_files)
     {
         for (size_t detector_num : analysis_job->detector_num_arr)
@@ -182,26 +439,76 @@ void generate_optimal_params(data_struct::Analysis_Job<double>* analysis_job)
 				
             }
 
+            Optimal_Params_Job job;
+            job.dataset = itr;
+            job.detector_num = detector_num;
+            job.params_override = params_override;
+            job.outcome = fitting::optimizers::OPTIMIZER_OUTCOME::FAILED;
             //load the int spectra from the dataset.
-            if (io::file::load_and_integrate_spectra_volume(analysis_job->dataset_directory, itr, detector_num, &int_spectra, params_override))
+            if (false == io::file::load_and_integrate_spectra_volume(analysis_job->dataset_directory, itr, detector_num, &job.int_spectra, params_override))
             {
-                data_struct::Fit_Parameters<double> out_fitp;
-                if (optimize_integrated_fit_params(analysis_job, int_spectra, detector_num, params_override, itr, out_fitp, nullptr))
+                logE << "In optimize_integrated_dataset loading dataset" << itr << " for detector" << detector_num << "\n";
+                continue;
+            }
+            jobs.push_back(job);
+
+            if (tp == nullptr)
+            {
+                num_workers = optimal_params_workers(analysis_job, jobs.back(), jobs.capacity());
+                if (num_workers > 1)
                 {
-                    detector_file_cnt[detector_num] += 1.0;
-                    if (fit_params_avgs.count(detector_num) > 0)
-                    {
-                        fit_params_avgs[detector_num].sum_values(out_fitp);
-                    }
-                    else
-                    {
-                        fit_params_avgs[detector_num] = out_fitp;
-                    }
+                    logI << "Optimizing datasets with " << num_workers << " workers\n";
+                    tp = new ThreadPool(num_workers);
                 }
             }
+
+            Optimal_Params_Job* job_ptr = &jobs.back();
+            if (tp != nullptr)
+            {
+                //the workers share the threads with the multi start candidates each of them runs
+                size_t inner_threads = std::max((size_t)1, analysis_job->num_threads / num_workers);
+                futures.push_back(tp->enqueue([analysis_job, job_ptr, inner_threads]()
+                {
+                    fitting::optimizers::Optimizer<double>* optimizer = clone_optimizer(analysis_job->optimizer());
+                    fitting::optimizers::OPTIMIZER_OUTCOME outcome = fit_integrated_fit_params(analysis_job, optimizer, job_ptr->int_spectra, job_ptr->params_override, false, inner_threads, job_ptr->fitp, nullptr);
+                    delete optimizer;
+                    return outcome;
+                }));
+            }
             else
             {
-                logE << "In optimize_integrated_dataset loading dataset" << itr << " for detector" << detector_num << "\n";
+                job_ptr->outcome = fit_integrated_fit_params(analysis_job, analysis_job->optimizer(), job_ptr->int_spectra, job_ptr->params_override, true, analysis_job->num_threads, job_ptr->fitp, nullptr);
+            }
+        }
+    }
+
+    if (tp != nullptr)
+    {
+        for (size_t i = 0; i < futures.size(); i++)
+        {
+            jobs[i].outcome = futures[i].get();
+        }
+        delete tp;
+    }
+    std::chrono::duration<double> elapsed_seconds = std::chrono::system_clock::now() - start;
+    logI << "Dataset optimization elapsed time: " << elapsed_seconds.count() << "s\n";
+
+    // save and sum in dataset, detector order so the average does not depend on which fit finished first
+    for (auto& job : jobs)
+    {
+        std::string result = optimizer_outcome_to_str(job.outcome);
+        logI << job.dataset << " detector " << job.detector_num << " Outcome = " << result << "\n";
+        io::file::save_optimized_fit_params(analysis_job->dataset_directory, job.dataset, job.detector_num, result, &job.fitp, &job.int_spectra, &(job.params_override->elements_to_fit));
+        if (integrated_fit_outcome_ok(job.outcome))
+        {
+            detector_file_cnt[job.detector_num] += 1.0;
+            if (fit_params_avgs.count(job.detector_num) > 0)
+            {
+                fit_params_avgs[job.detector_num].sum_values(job.fitp);
+            }
+            else
+            {
+                fit_params_avgs[job.detector_num] = job.fitp;
             }
         }
     }
@@ -229,93 +536,60 @@ void generate_optimal_params(data_struct::Analysis_Job<double>* analysis_job)
 
 // ----------------------------------------------------------------------------
 
-void load_and_fit_quatification_datasets(data_struct::Analysis_Job<double>* analysis_job, size_t detector_num)
+/**
+ * @brief load_quantification_standard_spectra : Load the integrated spectra and scalers of one standard for a detector
+ */
+bool load_quantification_standard_spectra(data_struct::Analysis_Job<double>* analysis_job,
+                                          size_t detector_num,
+                                          Quantification_Standard<double>& standard_itr,
+                                          Quantification_Standard<double>* quantification_standard)
 {
-    fitting::models::Gaussian_Model<double> model;
-    quantification::models::Quantification_Model<double> quantification_model;
-    // Z number : count
-    std::unordered_map<int, float> element_amt_in_all_standards;
-
     data_struct::Detector<double>* detector = analysis_job->get_detector(detector_num);
     data_struct::Params_Override<double>* override_params = &(detector->fit_params_override_dict);
 
-    //Range of energy in spectra to fit
-    fitting::models::Range energy_range;
-    energy_range.min = 0;
-
-
-    for (Quantification_Standard<double>& standard_itr : analysis_job->standard_element_weights)
+    std::unordered_map<std::string, double> pv_map;
+    //load the quantification standard dataset
+    size_t fn_str_len = quantification_standard->standard_filename.length();
+    if (fn_str_len > 5 &&
+        quantification_standard->standard_filename[fn_str_len - 4] == '.' &&
+        quantification_standard->standard_filename[fn_str_len - 3] == 'm' &&
+        quantification_standard->standard_filename[fn_str_len - 2] == 'c' &&
+        quantification_standard->standard_filename[fn_str_len - 1] == 'a')
     {
-        // detecotr_struct descructor will delete this memory
-        detector->quantification_standards[standard_itr.standard_filename] = Quantification_Standard<double>(standard_itr.standard_filename, standard_itr.element_standard_weights);
-        Quantification_Standard<double>* quantification_standard = &(detector->quantification_standards[standard_itr.standard_filename]);
-
-        //Output of fits for elements specified
-        std::unordered_map<std::string, data_struct::Fit_Element_Map<double>*> elements_to_fit;
-        for (auto& itr : standard_itr.element_standard_weights)
+        //try with adding detector_num on the end for 2ide datasets
+        std::string qfilepath = analysis_job->dataset_directory + quantification_standard->standard_filename;
+        if (detector_num != -1)
         {
-            data_struct::Element_Info<double>* e_info = data_struct::Element_Info_Map<double>::inst()->get_element(itr.first);
-            elements_to_fit[itr.first] = new data_struct::Fit_Element_Map<double>(itr.first, e_info);
-            elements_to_fit[itr.first]->init_energy_ratio_for_detector_element(detector->detector_element, standard_itr.disable_Ka_for_quantification, standard_itr.disable_La_for_quantification);
-
-            if (element_amt_in_all_standards.count(e_info->number) > 0)
-            {
-                element_amt_in_all_standards[e_info->number] += 1.0;
-            }
-            else
-            {
-                element_amt_in_all_standards[e_info->number] = 1.0;
-            }
+            qfilepath += std::to_string(detector_num);
         }
-
-        std::unordered_map<std::string, double> pv_map;
-        //load the quantification standard dataset
-        size_t fn_str_len = quantification_standard->standard_filename.length();
-        if (fn_str_len > 5 &&
-            quantification_standard->standard_filename[fn_str_len - 4] == '.' &&
-            quantification_standard->standard_filename[fn_str_len - 3] == 'm' &&
-            quantification_standard->standard_filename[fn_str_len - 2] == 'c' &&
-            quantification_standard->standard_filename[fn_str_len - 1] == 'a')
+        if (false == io::file::mca::load_integrated_spectra(qfilepath, &quantification_standard->integrated_spectra, pv_map))
         {
-            //try with adding detector_num on the end for 2ide datasets
-            std::string qfilepath = analysis_job->dataset_directory + quantification_standard->standard_filename;
-            if (detector_num != -1)
+            //try without detector number on end 2idd
+            if (false == io::file::mca::load_integrated_spectra(analysis_job->dataset_directory + quantification_standard->standard_filename, &quantification_standard->integrated_spectra, pv_map))
             {
-                qfilepath += std::to_string(detector_num);
-            }
-            if (false == io::file::mca::load_integrated_spectra(qfilepath, &quantification_standard->integrated_spectra, pv_map))
-            {
-                //try without detector number on end 2idd
-                if (false == io::file::mca::load_integrated_spectra(analysis_job->dataset_directory + quantification_standard->standard_filename, &quantification_standard->integrated_spectra, pv_map))
-                {
 
-                    //legacy code would load mca files, check for mca and replace with mda
-                    size_t std_str_len = standard_itr.standard_filename.length();
-                    if (standard_itr.standard_filename[std_str_len - 4] == '.' && standard_itr.standard_filename[std_str_len - 3] == 'm' && standard_itr.standard_filename[std_str_len - 2] == 'c' && standard_itr.standard_filename[std_str_len - 1] == 'a')
+                //legacy code would load mca files, check for mca and replace with mda
+                size_t std_str_len = standard_itr.standard_filename.length();
+                if (standard_itr.standard_filename[std_str_len - 4] == '.' && standard_itr.standard_filename[std_str_len - 3] == 'm' && standard_itr.standard_filename[std_str_len - 2] == 'c' && standard_itr.standard_filename[std_str_len - 1] == 'a')
+                {
+                    standard_itr.standard_filename[std_str_len - 2] = 'd';
+                    quantification_standard->standard_filename = standard_itr.standard_filename;
+                    if (false == io::file::load_and_integrate_spectra_volume(analysis_job->dataset_directory, quantification_standard->standard_filename, detector_num, &quantification_standard->integrated_spectra, override_params))
                     {
-                        standard_itr.standard_filename[std_str_len - 2] = 'd';
-                        quantification_standard->standard_filename = standard_itr.standard_filename;
-                        if (false == io::file::load_and_integrate_spectra_volume(analysis_job->dataset_directory, quantification_standard->standard_filename, detector_num, &quantification_standard->integrated_spectra, override_params))
-                        {
-                            logE << "Could not load file " << standard_itr.standard_filename << " for detector" << detector_num << "\n";
-                            continue;
-                        }
-                        else
-                        {
-                            quantification_standard->sr_current = override_params->sr_current;
-                            quantification_standard->US_IC = override_params->US_IC;
-                            quantification_standard->DS_IC = override_params->DS_IC;
-                        }
+                        logE << "Could not load file " << standard_itr.standard_filename << " for detector" << detector_num << "\n";
+                        return false;
                     }
                     else
                     {
-                        logE << "Could not load file " << standard_itr.standard_filename << " for detector" << detector_num << "\n";
-                        continue;
+                        quantification_standard->sr_current = override_params->sr_current;
+                        quantification_standard->US_IC = override_params->US_IC;
+                        quantification_standard->DS_IC = override_params->DS_IC;
                     }
                 }
                 else
                 {
-                    find_quantifier_scalers(pv_map, quantification_standard);
+                    logE << "Could not load file " << standard_itr.standard_filename << " for detector" << detector_num << "\n";
+                    return false;
                 }
             }
             else
@@ -325,102 +599,286 @@ void load_and_fit_quatification_datasets(data_struct::Analysis_Job<double>* anal
         }
         else
         {
-            if (false == io::file::load_and_integrate_spectra_volume(analysis_job->dataset_directory, quantification_standard->standard_filename, detector_num, &quantification_standard->integrated_spectra, override_params))
+            find_quantifier_scalers(pv_map, quantification_standard);
+        }
+    }
+    else
+    {
+        if (false == io::file::load_and_integrate_spectra_volume(analysis_job->dataset_directory, quantification_standard->standard_filename, detector_num, &quantification_standard->integrated_spectra, override_params))
+        {
+            logE << "Could not load file " << standard_itr.standard_filename << " for detector " << detector_num << "\n";
+            return false;
+        }
+        else
+        {
+            quantification_standard->sr_current = override_params->sr_current;
+            quantification_standard->US_IC = override_params->US_IC;
+            quantification_standard->DS_IC = override_params->DS_IC;
+        }
+    }
+    
+    if (quantification_standard->integrated_spectra.size() == 0)
+    {
+        logE << "Spectra size == 0! Can't process it!\n";
+        return false;
+    }
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
+struct Quant_Routine_Fit
+{
+    std::string name;
+    Fit_Parameters<double> fit_params;
+    data_struct::ArrayTr<double> fitted_spectra;
+    data_struct::ArrayTr<double> fitted_background;
+};
+
+struct Quant_Standard_Fit
+{
+    Quantification_Standard<double>* standard_itr;
+    Quantification_Standard<double>* quantification_standard;
+    std::unordered_map<std::string, data_struct::Fit_Element_Map<double>*> elements_to_fit;
+    fitting::models::Range energy_range;
+    bool loaded;
+    std::unordered_map<Fitting_Routines, Quant_Routine_Fit> routine_fits;
+};
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief fit_quantification_standard : Load one standard and run every fit routine on it, each routine with its own model, routine and optimizer.
+ *                                      The routines run on up to num_threads workers.
+ */
+void fit_quantification_standard(data_struct::Analysis_Job<double>* analysis_job, size_t detector_num, size_t num_threads, std::mutex& load_mutex, Quant_Standard_Fit& std_fit)
+{
+    data_struct::Detector<double>* detector = analysis_job->get_detector(detector_num);
+    data_struct::Params_Override<double>* override_params = &(detector->fit_params_override_dict);
+    Quantification_Standard<double>* quantification_standard = std_fit.quantification_standard;
+
+    {
+        // file readers are not thread safe
+        std::lock_guard<std::mutex> lock(load_mutex);
+        std_fit.loaded = load_quantification_standard_spectra(analysis_job, detector_num, *std_fit.standard_itr, quantification_standard);
+    }
+    if (false == std_fit.loaded)
+    {
+        return;
+    }
+
+    std_fit.energy_range = get_energy_range(quantification_standard->integrated_spectra.size(), &(override_params->fit_params));
+
+    auto fit_routine_func = [analysis_job, override_params, quantification_standard, &std_fit](Fitting_Routines routine_type)
+    {
+        fitting::models::Gaussian_Model<double> model;
+        fitting::optimizers::Optimizer<double>* optimizer = clone_optimizer(analysis_job->optimizer());
+        fitting::routines::Base_Fit_Routine<double>* fit_routine = io::file::generate_fit_routine(routine_type, optimizer);
+        // same options as the detector routines get in init_fit_routines
+        analysis_job->apply_fit_routine_options(routine_type, fit_routine);
+        Quant_Routine_Fit& routine_fit = std_fit.routine_fits.at(routine_type);
+
+        //reset model fit parameters to defaults
+        model.reset_to_default_fit_params();
+        //Update fit parameters by override values
+        model.update_fit_params_values(&(override_params->fit_params));
+        //Initialize the fit routine
+        fit_routine->initialize(&model, &std_fit.elements_to_fit, std_fit.energy_range);
+        //Fit the spectra
+        fit_routine->fit_spectra(&model, &quantification_standard->integrated_spectra, &std_fit.elements_to_fit, quantification_standard->element_counts.at(routine_type));
+
+        routine_fit.name = fit_routine->get_name();
+        if (routine_type == Fitting_Routines::GAUSS_MATRIX || routine_type == Fitting_Routines::NNLS)
+        {
+            fitting::routines::Matrix_Optimized_Fit_Routine<double>* f_routine = (fitting::routines::Matrix_Optimized_Fit_Routine<double>*)fit_routine;
+            routine_fit.fit_params = model.fit_parameters();
+            routine_fit.fitted_spectra = f_routine->fitted_integrated_spectra();
+            routine_fit.fitted_background = f_routine->fitted_integrated_background();
+        }
+        delete fit_routine;
+        delete optimizer;
+    };
+
+    size_t num_workers = std::min(num_threads, detector->fit_routines.size());
+    if (num_workers < 2)
+    {
+        for (auto& fit_itr : detector->fit_routines)
+        {
+            fit_routine_func(fit_itr.first);
+        }
+    }
+    else
+    {
+        ThreadPool tp(num_workers);
+        std::vector<std::future<void>> futures;
+        for (auto& fit_itr : detector->fit_routines)
+        {
+            futures.push_back(tp.enqueue(fit_routine_func, fit_itr.first));
+        }
+        for (auto& future : futures)
+        {
+            future.get();
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+void load_and_fit_quatification_datasets(data_struct::Analysis_Job<double>* analysis_job, size_t detector_num)
+{
+    quantification::models::Quantification_Model<double> quantification_model;
+    // Z number : count
+    std::unordered_map<int, float> element_amt_in_all_standards;
+
+    data_struct::Detector<double>* detector = analysis_job->get_detector(detector_num);
+
+    // everything that touches the detector or the standards map is set up here, before the fits start
+    std::vector<Quant_Standard_Fit> std_fits;
+    for (Quantification_Standard<double>& standard_itr : analysis_job->standard_element_weights)
+    {
+        // detecotr_struct descructor will delete this memory
+        detector->quantification_standards[standard_itr.standard_filename] = Quantification_Standard<double>(standard_itr.standard_filename, standard_itr.element_standard_weights);
+
+        Quant_Standard_Fit std_fit;
+        std_fit.standard_itr = &standard_itr;
+        std_fit.quantification_standard = &(detector->quantification_standards[standard_itr.standard_filename]);
+        std_fit.loaded = false;
+
+        //Output of fits for elements specified
+        for (auto& itr : standard_itr.element_standard_weights)
+        {
+            data_struct::Element_Info<double>* e_info = data_struct::Element_Info_Map<double>::inst()->get_element(itr.first);
+            std_fit.elements_to_fit[itr.first] = new data_struct::Fit_Element_Map<double>(itr.first, e_info);
+            std_fit.elements_to_fit[itr.first]->init_energy_ratio_for_detector_element(detector->detector_element, standard_itr.disable_Ka_for_quantification, standard_itr.disable_La_for_quantification);
+
+            if (element_amt_in_all_standards.count(e_info->number) > 0)
             {
-                logE << "Could not load file " << standard_itr.standard_filename << " for detector " << detector_num << "\n";
-                continue;
+                element_amt_in_all_standards[e_info->number] += 1.0;
             }
             else
             {
-                quantification_standard->sr_current = override_params->sr_current;
-                quantification_standard->US_IC = override_params->US_IC;
-                quantification_standard->DS_IC = override_params->DS_IC;
+                element_amt_in_all_standards[e_info->number] = 1.0;
             }
         }
-        
-        if (quantification_standard->integrated_spectra.size() == 0)
+
+        for (auto& fit_itr : detector->fit_routines)
         {
-            logE << "Spectra size == 0! Can't process it!\n";
-            continue;
+            std_fit.routine_fits[fit_itr.first] = Quant_Routine_Fit();
+            for (auto& el_itr : standard_itr.element_standard_weights)
+            {
+                std_fit.quantification_standard->element_counts[fit_itr.first][el_itr.first] = 0;
+            }
         }
+        std_fits.push_back(std_fit);
+    }
 
-        //This is what IDL MAPS DID
-        if (quantification_standard->sr_current == 0.0 )
+    // load and fit the standards at the same time
+    std::mutex load_mutex;
+    size_t num_workers = std::min(analysis_job->num_threads, std_fits.size());
+    if (num_workers < 2)
+    {
+        for (auto& std_fit : std_fits)
         {
-            quantification_standard->sr_current = 100.0;
+            fit_quantification_standard(analysis_job, detector_num, analysis_job->num_threads, load_mutex, std_fit);
         }
-
-        energy_range = get_energy_range(quantification_standard->integrated_spectra.size(), &(override_params->fit_params));
-        //First we integrate the spectra and get the elemental counts
-        for (auto& fit_itr : detector->fit_routines)
+    }
+    else
+    {
+        logI << "Fitting " << std_fits.size() << " quantification standards with " << num_workers << " workers\n";
+        //the standards share the threads with the routines each of them fits
+        size_t routine_threads = std::max((size_t)1, analysis_job->num_threads / num_workers);
+        ThreadPool tp(num_workers);
+        std::vector<std::future<void>> futures;
+        for (auto& std_fit : std_fits)
         {
-
-            fitting::routines::Base_Fit_Routine<double>* fit_routine = fit_itr.second;
-            for (auto& el_itr : standard_itr.element_standard_weights)
+            futures.push_back(tp.enqueue([analysis_job, detector_num, routine_threads, &load_mutex, &std_fit]()
             {
-                quantification_standard->element_counts[fit_itr.first][el_itr.first] = 0;
+                fit_quantification_standard(analysis_job, detector_num, routine_threads, load_mutex, std_fit);
+            }));
+        }
+        for (auto& future : futures)
+        {
+            future.get();
+        }
+    }
 
-                detector->append_element(fit_itr.first, STR_SR_CURRENT, el_itr.first, el_itr.second);
-                detector->append_element(fit_itr.first, STR_US_IC, el_itr.first, el_itr.second);
-                detector->append_element(fit_itr.first, STR_DS_IC, el_itr.first, el_itr.second);
+    // update the calibration in standard order so the e_cal_ratio sums match a serial run
+    for (auto& std_fit : std_fits)
+    {
+        Quantification_Standard<double>* quantification_standard = std_fit.quantification_standard;
+        if (std_fit.loaded)
+        {
+            //This is what IDL MAPS DID
+            if (quantification_standard->sr_current == 0.0 )
+            {
+                quantification_standard->sr_current = 100.0;
             }
 
-            //reset model fit parameters to defaults
-            model.reset_to_default_fit_params();
-            //Update fit parameters by override values
-            model.update_fit_params_values(&(override_params->fit_params));
-            //Initialize the fit routine
-            fit_routine->initialize(&model, &elements_to_fit, energy_range);
-            //Fit the spectra
-            fit_routine->fit_spectra(&model, &quantification_standard->integrated_spectra, &elements_to_fit, quantification_standard->element_counts[fit_itr.first]);
+            for (auto& fit_itr : detector->fit_routines)
+            {
+                for (auto& el_itr : std_fit.standard_itr->element_standard_weights)
+                {
+                    detector->append_element(fit_itr.first, STR_SR_CURRENT, el_itr.first, el_itr.second);
+                    detector->append_element(fit_itr.first, STR_US_IC, el_itr.first, el_itr.second);
+                    detector->append_element(fit_itr.first, STR_DS_IC, el_itr.first, el_itr.second);
+                }
 
-            quantification_standard->normalize_counts_by_time(fit_itr.first);
+                quantification_standard->normalize_counts_by_time(fit_itr.first);
 
-            //Save csv and png if matrix or nnls
-            if (fit_itr.first == Fitting_Routines::GAUSS_MATRIX || fit_itr.first == Fitting_Routines::NNLS)
-            {
-                Fit_Parameters<double> fit_params = model.fit_parameters();
-                
-                //add elements to fit parameters if they don't exist
-                for (auto& itr2 : elements_to_fit)
+                //Save csv and png if matrix or nnls
+                if (fit_itr.first == Fitting_Routines::GAUSS_MATRIX || fit_itr.first == Fitting_Routines::NNLS)
                 {
-                    if (false == override_params->fit_params.contains(itr2.first))
+                    const Quant_Routine_Fit& routine_fit = std_fit.routine_fits.at(fit_itr.first);
+                    Fit_Parameters<double> fit_params = routine_fit.fit_params;
+                    fitting::models::Range energy_range = std_fit.energy_range;
+                    
+                    //add elements to fit parameters if they don't exist
+                    for (auto& itr2 : std_fit.elements_to_fit)
                     {
-                        fit_params.add_parameter(Fit_Param<double>(itr2.first, quantification_standard->element_counts.at(fit_itr.first).at(itr2.first)));
+                        if (false == detector->fit_params_override_dict.fit_params.contains(itr2.first))
+                        {
+                            fit_params.add_parameter(Fit_Param<double>(itr2.first, quantification_standard->element_counts.at(fit_itr.first).at(itr2.first)));
+                        }
                     }
-                }
-                fitting::routines::Matrix_Optimized_Fit_Routine<double>* f_routine = (fitting::routines::Matrix_Optimized_Fit_Routine<double>*)fit_routine;
-                double energy_offset = fit_params.value(STR_ENERGY_OFFSET);
-                double energy_slope = fit_params.value(STR_ENERGY_SLOPE);
-                double energy_quad = fit_params.value(STR_ENERGY_QUADRATIC);
+                    double energy_offset = fit_params.value(STR_ENERGY_OFFSET);
+                    double energy_slope = fit_params.value(STR_ENERGY_SLOPE);
+                    double energy_quad = fit_params.value(STR_ENERGY_QUADRATIC);
 
-                data_struct::ArrayTr<double> energy = data_struct::ArrayTr<double>::LinSpaced(energy_range.count(), energy_range.min, energy_range.max);
-                data_struct::ArrayTr<double> ev = energy_offset + (energy * energy_slope) + (Eigen::pow(energy, (double)2.0) * energy_quad);
-                data_struct::ArrayTr<double> sub_spectra = quantification_standard->integrated_spectra.segment(energy_range.min, energy_range.count());
+                    data_struct::ArrayTr<double> energy = data_struct::ArrayTr<double>::LinSpaced(energy_range.count(), energy_range.min, energy_range.max);
+                    data_struct::ArrayTr<double> ev = energy_offset + (energy * energy_slope) + (Eigen::pow(energy, (double)2.0) * energy_quad);
+                    data_struct::ArrayTr<double> sub_spectra = quantification_standard->integrated_spectra.segment(energy_range.min, energy_range.count());
+                    data_struct::ArrayTr<double> fitted_spectra = routine_fit.fitted_spectra;
+                    data_struct::ArrayTr<double> fitted_background = routine_fit.fitted_background;
 
-                std::string full_path = analysis_job->dataset_directory + DIR_END_CHAR + "output" + DIR_END_CHAR + "calib_" + fit_routine->get_name() + "_" + standard_itr.standard_filename;
-                if (detector_num != -1)
-                {
-                    full_path += std::to_string(detector_num);
+                    std::string full_path = analysis_job->dataset_directory + DIR_END_CHAR + "output" + DIR_END_CHAR + "calib_" + routine_fit.name + "_" + std_fit.standard_itr->standard_filename;
+                    if (detector_num != -1)
+                    {
+                        full_path += std::to_string(detector_num);
+                    }
+                    logI << full_path << "\n";
+                    #ifdef _BUILD_WITH_QT
+                    visual::SavePlotSpectrasFromConsole(full_path + ".png", &ev, &sub_spectra, &fitted_spectra, &fitted_background, true);
+                    #endif
+                    io::file::csv::save_fit_and_int_spectra(full_path + ".csv", &ev, &sub_spectra, &fitted_spectra, &fitted_background);
                 }
-                logI << full_path << "\n";
-                #ifdef _BUILD_WITH_QT
-                visual::SavePlotSpectrasFromConsole(full_path + ".png", &ev, &sub_spectra, (ArrayTr<double>*)(&f_routine->fitted_integrated_spectra()), (ArrayTr<double>*)(&f_routine->fitted_integrated_background()), true);
-                #endif
-                io::file::csv::save_fit_and_int_spectra(full_path + ".csv", &ev, &sub_spectra, (ArrayTr<double>*)(&f_routine->fitted_integrated_spectra()), (ArrayTr<double>*)(&f_routine->fitted_integrated_background()));
-            }
 
-            detector->update_element_quants(fit_itr.first, STR_SR_CURRENT, quantification_standard, &quantification_model, quantification_standard->sr_current);
-            detector->update_element_quants(fit_itr.first, STR_US_IC, quantification_standard, &quantification_model, quantification_standard->US_IC);
-            detector->update_element_quants(fit_itr.first, STR_DS_IC, quantification_standard, &quantification_model, quantification_standard->DS_IC);
+                detector->update_element_quants(fit_itr.first, STR_SR_CURRENT, quantification_standard, &quantification_model, quantification_standard->sr_current);
+                detector->update_element_quants(fit_itr.first, STR_US_IC, quantification_standard, &quantification_model, quantification_standard->US_IC);
+                detector->update_element_quants(fit_itr.first, STR_DS_IC, quantification_standard, &quantification_model, quantification_standard->DS_IC);
+            }
+        }
+        else
+        {
+            // nothing was fit for this standard
+            quantification_standard->element_counts.clear();
         }
 
         //cleanup
-        for (auto& itr3 : elements_to_fit)
+        for (auto& itr3 : std_fit.elements_to_fit)
         {
             delete itr3.second;
         }
-        elements_to_fit.clear();
+        std_fit.elements_to_fit.clear();
     }
 
     float divisor = (float)analysis_job->standard_element_weights.size();    
@@ -562,69 +1020,103 @@ bool perform_quantification(data_struct::Analysis_Job<double>* analysis_job, boo
 
 // ----------------------------------------------------------------------------
 
-bool find_and_optimize_roi(data_struct::Analysis_Job<double>& analysis_job,
-                            int detector_num,
-                            std::map<std::string, std::vector<std::pair<int, int>>>& rois,
-                            std::unordered_map<std::string, data_struct::Spectra<double> >& int_spectra_map,
-                            std::string search_filename,
-                            std::map<std::string, data_struct::Fit_Parameters<double>>& out_roi_fit_params,
-                            Callback_Func_Status_Def* status_callback)
+struct Roi_Fit_Job
+{
+    int detector_num;
+    std::string file_path;
+    // <dataset>_roi_<roi name>
+    std::string name;
+    size_t num_pixels;
+    data_struct::Spectra<double> int_spectra;
+    data_struct::Params_Override<double>* params_override;
+    double sr_current;
+    double us_ic;
+    double ds_ic;
+    double roi_area;
+    // per file amp sens, params_override only holds the last loaded file's
+    double us_amp_sens_num;
+    std::string us_amp_sens_unit;
+    double ds_amp_sens_num;
+    std::string ds_amp_sens_unit;
+    fitting::optimizers::OPTIMIZER_OUTCOME outcome;
+    data_struct::Fit_Parameters<double> fitp;
+};
+
+// ----------------------------------------------------------------------------
+
+bool find_roi_fit_jobs(data_struct::Analysis_Job<double>& analysis_job,
+                        int detector_num,
+                        std::map<std::string, std::vector<std::pair<int, int>>>& rois,
+                        std::unordered_map<std::string, data_struct::Spectra<double> >& int_spectra_map,
+                        std::string search_filename,
+                        std::vector<Roi_Fit_Job>& out_jobs)
 {
     int cnt = int_spectra_map.count(search_filename);
     std::vector<std::string> files = io::file::File_Scan::inst()->find_all_dataset_files(analysis_job.dataset_directory + "img.dat", search_filename);
     if (files.size() > 0 || cnt > 0)
     {
         std::string sfile_name;
+        std::string file_path = analysis_job.dataset_directory + "img.dat" + DIR_END_CHAR;
+        if (cnt > 0)
+        {
+            sfile_name = search_filename;
+        }
+        else if (files.size() == 1) // v9 will find just 1, 
+        {
+            sfile_name = files[0];
+        }
+        else // v10 finds more so we just use search name
+        {
+            sfile_name = search_filename;
+        }
+        file_path += sfile_name;
+
+        data_struct::Detector<double>* detector = analysis_job.get_detector(detector_num);
+        if (detector == nullptr)
+        {
+            logE << "Detector " << detector_num << " is not initialized, skipping..\n";
+            return true;
+        }
+
+        // one sweep over the spectra for every roi in this file
+        std::map<std::string, data_struct::Spectra<double>> roi_int_spectra;
+        if (cnt == 0)
+        {
+            if (false == io::file::HDF5_IO::inst()->load_integrated_spectra_analyzed_h5_rois(file_path, rois, roi_int_spectra))
+            {
+                logE << "Could not load int spectra for " << file_path << ".  skipping..\n";
+                return true;
+            }
+        }
+
+        data_struct::Params_Override<double>* params_override = &(detector->fit_params_override_dict);
+
+        /// If quant is not done also, Need to save more info from Quantification first, then we can finish implementing loading quant from hdf5 instead of rerunning each time roi's are done
+        ///io::file::HDF5_IO::inst()->load_quantification_analyzed_h5(file_path, detector);
+        // load scalers and scan info
+        data_struct::Scan_Info<double> scan_info;
+        io::file::HDF5_IO::inst()->load_scan_info_analyzed_h5(file_path, detector, scan_info);
+
+        std::map<std::string, data_struct::ArrayXXr<double>> scalers_map;
+        bool scalers_loaded = io::file::HDF5_IO::inst()->load_scalers_analyzed_h5(file_path, scalers_map);
+
         for (auto& roi_itr : rois)
         {
             data_struct::Spectra<double> int_spectra;
-
-            std::string file_path = analysis_job.dataset_directory + "img.dat" + DIR_END_CHAR; 
             if (cnt > 0)
             {
                 int_spectra = int_spectra_map.at(search_filename);
-                sfile_name = search_filename;
-                file_path += sfile_name;
             }
             else
             {
-                if (files.size() == 1) // v9 will find just 1, 
-                {
-                    sfile_name = files[0];
-                }
-                else // v10 finds more so we just use search name
-                {
-                    sfile_name = search_filename;
-                }
-                file_path += sfile_name;
-                if (false == io::file::HDF5_IO::inst()->load_integrated_spectra_analyzed_h5_roi(file_path, &int_spectra, roi_itr.second))
-                {
-                    logE << "Could not load int spectra for " << file_path << ".  skipping..\n";
-                    continue;
-                }
+                int_spectra = roi_int_spectra.at(roi_itr.first);
             }
 
-            data_struct::Detector<double>* detector = analysis_job.get_detector(detector_num);
-            if (detector == nullptr)
-            {
-                logE << "Detector " << detector_num << " is not initialized, skipping..\n";
-                continue;
-            }
-                
-            data_struct::Params_Override<double>* params_override = &(detector->fit_params_override_dict);
-                
-            /// If quant is not done also, Need to save more info from Quantification first, then we can finish implementing loading quant from hdf5 instead of rerunning each time roi's are done
-            ///io::file::HDF5_IO::inst()->load_quantification_analyzed_h5(file_path, detector);
-            // load scalers and scan info
-            data_struct::Scan_Info<double> scan_info;
-            io::file::HDF5_IO::inst()->load_scan_info_analyzed_h5(file_path, detector, scan_info);
-
             double sr_current = 1.0;
             double us_ic = 1.0;
             double ds_ic = 1.0;
 
-            std::map<std::string, data_struct::ArrayXXr<double>> scalers_map;
-            if (io::file::HDF5_IO::inst()->load_scalers_analyzed_h5(file_path, scalers_map))
+            if (scalers_loaded)
             {
                 std::string low_ds_ic = STR_DS_IC;
                 std::transform(low_ds_ic.begin(), low_ds_ic.end(), low_ds_ic.begin(), [](unsigned char c) { return std::tolower(c); });
@@ -670,53 +1162,28 @@ bool find_and_optimize_roi(data_struct::Analysis_Job<double>& analysis_job,
             }
 
 
-            data_struct::Fit_Parameters<double> out_fitp;
-            std::string roi_name = roi_itr.first;
-            if (false == optimize_integrated_fit_params(&analysis_job, int_spectra, detector_num, params_override, sfile_name + "_roi_" + roi_name + "_det_", out_fitp, status_callback))
-            {
-                logE << "Failed to optimize ROI "<< file_path<<" : "<< roi_name<<".\n";
-            }
-
-                
-            double total_counts = 0.0;
-            for (auto& itr : out_fitp)
-            {
-                if (data_struct::Element_Info_Map<double>::inst()->is_element(itr.first))
-                {
-                    total_counts += itr.second.value;
-                }
-            }
-                
-
-            double abs_err = std::abs(out_fitp.at(STR_RESIDUAL).value);
-            double rel_err = abs_err / int_spectra.sum();;
-            double roi_area = 0;
+            Roi_Fit_Job job;
+            job.detector_num = detector_num;
+            job.file_path = file_path;
+            job.name = sfile_name + "_roi_" + roi_itr.first;
+            job.num_pixels = roi_itr.second.size();
+            job.int_spectra = int_spectra;
+            job.params_override = params_override;
+            job.sr_current = sr_current;
+            job.us_ic = us_ic;
+            job.ds_ic = ds_ic;
+            job.us_amp_sens_num = params_override->us_amp_sens_num;
+            job.us_amp_sens_unit = params_override->us_amp_sens_unit;
+            job.ds_amp_sens_num = params_override->ds_amp_sens_num;
+            job.ds_amp_sens_unit = params_override->ds_amp_sens_unit;
+            job.roi_area = 0;
             if (scan_info.meta_info.x_axis.rows() > 0 && scan_info.meta_info.x_axis.cols() > 0
                 && scan_info.meta_info.y_axis.rows() > 0 && scan_info.meta_info.y_axis.cols() > 0)
             {
-                roi_area = roi_itr.second.size() * 1000.0 * 1000.0 * (scan_info.meta_info.x_axis.maxCoeff() - scan_info.meta_info.x_axis.minCoeff()) / (scan_info.meta_info.x_axis.size() - 1) * (scan_info.meta_info.y_axis.maxCoeff() - scan_info.meta_info.y_axis.minCoeff()) / (scan_info.meta_info.y_axis.size() - 1);
-            }
-            // add in other properties that will be saved to csv
-            out_fitp.add_parameter(data_struct::Fit_Param<double>("real_time", int_spectra.elapsed_realtime()));
-            out_fitp.add_parameter(data_struct::Fit_Param<double>("live_time", int_spectra.elapsed_livetime()));
-            out_fitp.add_parameter(data_struct::Fit_Param<double>("SRcurrent", sr_current));
-            out_fitp.add_parameter(data_struct::Fit_Param<double>(STR_US_IC, us_ic));
-            out_fitp.add_parameter(data_struct::Fit_Param<double>(STR_DS_IC, ds_ic));
-            out_fitp.add_parameter(data_struct::Fit_Param<double>("total_counts", total_counts));
-            out_fitp.add_parameter(data_struct::Fit_Param<double>("status", out_fitp.at(STR_OUTCOME).value));
-            out_fitp.add_parameter(data_struct::Fit_Param<double>("niter", out_fitp.at(STR_NUM_ITR).value));
-            out_fitp.add_parameter(data_struct::Fit_Param<double>("total_perror", out_fitp.at(STR_RESIDUAL).value));
-            out_fitp.add_parameter(data_struct::Fit_Param<double>("abs_error", abs_err));
-            out_fitp.add_parameter(data_struct::Fit_Param<double>("relative_error", rel_err));
-            out_fitp.add_parameter(data_struct::Fit_Param<double>("roi_areas", roi_area));
-            out_fitp.add_parameter(data_struct::Fit_Param<double>("roi_pixels", roi_itr.second.size()));
-            out_fitp.add_parameter(data_struct::Fit_Param<double>("US_num", params_override->us_amp_sens_num));
-            out_fitp.add_parameter(data_struct::Fit_Param<double>("US_unit", io::file::translate_back_sens_unit<double>(params_override->us_amp_sens_unit)));
-            out_fitp.add_parameter(data_struct::Fit_Param<double>("US_sensfactor", params_override->us_amp_sens_num));
-            out_fitp.add_parameter(data_struct::Fit_Param<double>("DS_num", params_override->ds_amp_sens_num));
-            out_fitp.add_parameter(data_struct::Fit_Param<double>("DS_unit", io::file::translate_back_sens_unit<double>(params_override->ds_amp_sens_unit)));
-            out_fitp.add_parameter(data_struct::Fit_Param<double>("DS_sensfactor", params_override->ds_amp_sens_num));
-            out_roi_fit_params[sfile_name + "_roi_" + roi_name] = out_fitp;
+                job.roi_area = roi_itr.second.size() * 1000.0 * 1000.0 * (scan_info.meta_info.x_axis.maxCoeff() - scan_info.meta_info.x_axis.minCoeff()) / (scan_info.meta_info.x_axis.size() - 1) * (scan_info.meta_info.y_axis.maxCoeff() - scan_info.meta_info.y_axis.minCoeff()) / (scan_info.meta_info.y_axis.size() - 1);
+            }
+            job.outcome = fitting::optimizers::OPTIMIZER_OUTCOME::FAILED;
+            out_jobs.push_back(job);
         }
         return true;
     }
@@ -730,11 +1197,107 @@ bool find_and_optimize_roi(data_struct::Analysis_Job<double>& analysis_job,
 
 // ----------------------------------------------------------------------------
 
-void optimize_single_roi(data_struct::Analysis_Job<double>& analysis_job,
-    std::string roi_file_name,
-    std::map<int, std::map<std::string,
-    data_struct::Fit_Parameters<double>>> & out_roi_fit_params,
-    Callback_Func_Status_Def* status_callback)
+void save_roi_fit_job(data_struct::Analysis_Job<double>& analysis_job, Roi_Fit_Job& job)
+{
+    data_struct::Fit_Parameters<double>& out_fitp = job.fitp;
+    data_struct::Params_Override<double>* params_override = job.params_override;
+    std::string result = optimizer_outcome_to_str(job.outcome);
+    logI << "Outcome = " << result << "\n";
+    io::file::save_optimized_fit_params(analysis_job.dataset_directory, job.name + "_det_", job.detector_num, result, &out_fitp, &job.int_spectra, &(params_override->elements_to_fit));
+    if (false == integrated_fit_outcome_ok(job.outcome))
+    {
+        logE << "Failed to optimize ROI " << job.file_path << " : " << job.name << ".\n";
+    }
+
+    double total_counts = 0.0;
+    for (auto& itr : out_fitp)
+    {
+        if (data_struct::Element_Info_Map<double>::inst()->is_element(itr.first))
+        {
+            total_counts += itr.second.value;
+        }
+    }
+
+    double abs_err = std::abs(out_fitp.at(STR_RESIDUAL).value);
+    double rel_err = abs_err / job.int_spectra.sum();
+    // add in other properties that will be saved to csv
+    out_fitp.add_parameter(data_struct::Fit_Param<double>("real_time", job.int_spectra.elapsed_realtime()));
+    out_fitp.add_parameter(data_struct::Fit_Param<double>("live_time", job.int_spectra.elapsed_livetime()));
+    out_fitp.add_parameter(data_struct::Fit_Param<double>("SRcurrent", job.sr_current));
+    out_fitp.add_parameter(data_struct::Fit_Param<double>(STR_US_IC, job.us_ic));
+    out_fitp.add_parameter(data_struct::Fit_Param<double>(STR_DS_IC, job.ds_ic));
+    out_fitp.add_parameter(data_struct::Fit_Param<double>("total_counts", total_counts));
+    out_fitp.add_parameter(data_struct::Fit_Param<double>("status", out_fitp.at(STR_OUTCOME).value));
+    out_fitp.add_parameter(data_struct::Fit_Param<double>("niter", out_fitp.at(STR_NUM_ITR).value));
+    out_fitp.add_parameter(data_struct::Fit_Param<double>("total_perror", out_fitp.at(STR_RESIDUAL).value));
+    out_fitp.add_parameter(data_struct::Fit_Param<double>("abs_error", abs_err));
+    out_fitp.add_parameter(data_struct::Fit_Param<double>("relative_error", rel_err));
+    out_fitp.add_parameter(data_struct::Fit_Param<double>("roi_areas", job.roi_area));
+    out_fitp.add_parameter(data_struct::Fit_Param<double>("roi_pixels", job.num_pixels));
+    out_fitp.add_parameter(data_struct::Fit_Param<double>("US_num", job.us_amp_sens_num));
+    out_fitp.add_parameter(data_struct::Fit_Param<double>("US_unit", io::file::translate_back_sens_unit<double>(job.us_amp_sens_unit)));
+    out_fitp.add_parameter(data_struct::Fit_Param<double>("US_sensfactor", job.us_amp_sens_num));
+    out_fitp.add_parameter(data_struct::Fit_Param<double>("DS_num", job.ds_amp_sens_num));
+    out_fitp.add_parameter(data_struct::Fit_Param<double>("DS_unit", io::file::translate_back_sens_unit<double>(job.ds_amp_sens_unit)));
+    out_fitp.add_parameter(data_struct::Fit_Param<double>("DS_sensfactor", job.ds_amp_sens_num));
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief run_roi_fit_jobs : Optimize the jobs on optimize_roi_workers threads, each with its own optimizer, then save them one by one in job order
+ */
+void run_roi_fit_jobs(data_struct::Analysis_Job<double>& analysis_job,
+                      std::vector<Roi_Fit_Job>& jobs,
+                      std::map<int, std::map<std::string, data_struct::Fit_Parameters<double>>>& out_roi_fit_params,
+                      Callback_Func_Status_Def* status_callback)
+{
+    size_t num_workers = (analysis_job.optimize_roi_workers > 0) ? analysis_job.optimize_roi_workers : analysis_job.num_threads;
+    num_workers = std::min(num_workers, jobs.size());
+
+    std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now();
+    if (num_workers < 2)
+    {
+        for (auto& job : jobs)
+        {
+            job.outcome = fit_integrated_fit_params(&analysis_job, analysis_job.optimizer(), job.int_spectra, job.params_override, true, analysis_job.num_threads, job.fitp, status_callback);
+        }
+    }
+    else
+    {
+        logI << "Optimizing " << jobs.size() << " rois with " << num_workers << " workers\n";
+        ThreadPool tp(num_workers);
+        std::vector<std::future<fitting::optimizers::OPTIMIZER_OUTCOME>> futures;
+        size_t inner_threads = std::max((size_t)1, analysis_job.num_threads / num_workers);
+        for (auto& job : jobs)
+        {
+            futures.push_back(tp.enqueue([&analysis_job, &job, inner_threads]()
+            {
+                fitting::optimizers::Optimizer<double>* optimizer = clone_optimizer(analysis_job.optimizer());
+                fitting::optimizers::OPTIMIZER_OUTCOME outcome = fit_integrated_fit_params(&analysis_job, optimizer, job.int_spectra, job.params_override, false, inner_threads, job.fitp, nullptr);
+                delete optimizer;
+                return outcome;
+            }));
+        }
+        for (size_t i = 0; i < futures.size(); i++)
+        {
+            jobs[i].outcome = futures[i].get();
+        }
+    }
+    std::chrono::duration<double> elapsed_seconds = std::chrono::system_clock::now() - start;
+    logI << "Roi optimization elapsed time: " << elapsed_seconds.count() << "s\n";
+
+    // saving plots and csv files is not thread safe, do it in job order
+    for (auto& job : jobs)
+    {
+        save_roi_fit_job(analysis_job, job);
+        out_roi_fit_params[job.detector_num][job.name] = job.fitp;
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+void collect_roi_fit_jobs(data_struct::Analysis_Job<double>& analysis_job, std::string roi_file_name, std::vector<Roi_Fit_Job>& out_jobs)
 {
     //std::map<int, std::vector<std::pair<unsigned int, unsigned int>>> rois;
     std::map<std::string, std::vector<std::pair<int, int>>> rois;
@@ -774,20 +1337,20 @@ void optimize_single_roi(data_struct::Analysis_Job<double>& analysis_job,
                     {
                         search_filename = base_file_name + ".mda.h5" + str_detector_num;
                     }
-                    if (false == find_and_optimize_roi(analysis_job, detector_num, rois, int_specs, search_filename, out_roi_fit_params[detector_num], status_callback))
+                    if (false == find_roi_fit_jobs(analysis_job, detector_num, rois, int_specs, search_filename, out_jobs))
                     {
                         // try v9 format
                         search_filename = base_file_name + ".h5" + str_detector_num;
-                        find_and_optimize_roi(analysis_job, detector_num, rois, int_specs, search_filename, out_roi_fit_params[detector_num], status_callback);
+                        find_roi_fit_jobs(analysis_job, detector_num, rois, int_specs, search_filename, out_jobs);
                     }
                 }
             }
             //now for the avg h5
             search_filename = base_file_name + ".mda.h5";
-            if (false == find_and_optimize_roi(analysis_job, -1, rois, int_specs, search_filename, out_roi_fit_params[-1], status_callback))
+            if (false == find_roi_fit_jobs(analysis_job, -1, rois, int_specs, search_filename, out_jobs))
             {
                 search_filename = base_file_name + ".h5";
-                find_and_optimize_roi(analysis_job, -1, rois, int_specs, search_filename, out_roi_fit_params[-1], status_callback);
+                find_roi_fit_jobs(analysis_job, -1, rois, int_specs, search_filename, out_jobs);
             }
         }
         else
@@ -821,20 +1384,20 @@ void optimize_single_roi(data_struct::Analysis_Job<double>& analysis_job,
                     {
                         std::string str_detector_num = std::to_string(detector_num);
                         search_filename = dataset_num + ".h5" + str_detector_num; // v9 save
-                        if (false == find_and_optimize_roi(analysis_job, detector_num, rois, int_specs, search_filename, out_roi_fit_params[detector_num], status_callback))
+                        if (false == find_roi_fit_jobs(analysis_job, detector_num, rois, int_specs, search_filename, out_jobs))
                         {
                             search_filename = dataset_num + ".mda.h5" + str_detector_num;
-                            find_and_optimize_roi(analysis_job, detector_num, rois, int_specs, search_filename, out_roi_fit_params[detector_num], status_callback);
+                            find_roi_fit_jobs(analysis_job, detector_num, rois, int_specs, search_filename, out_jobs);
                         }
                     }
                 }
                 //now for the avg h5
                 //detector = analysis_job.get_detector(-1); 
                 search_filename = dataset_num + ".h5"; // v9 save
-                if (false == find_and_optimize_roi(analysis_job, -1, rois, int_specs, search_filename, out_roi_fit_params[-1], status_callback))
+                if (false == find_roi_fit_jobs(analysis_job, -1, rois, int_specs, search_filename, out_jobs))
                 {
                     search_filename = dataset_num + ".mda.h5";
-                    find_and_optimize_roi(analysis_job, -1, rois, int_specs, search_filename, out_roi_fit_params[-1], status_callback);
+                    find_roi_fit_jobs(analysis_job, -1, rois, int_specs, search_filename, out_jobs);
                 }
             }
             else
@@ -852,6 +1415,19 @@ void optimize_single_roi(data_struct::Analysis_Job<double>& analysis_job,
 
 // ----------------------------------------------------------------------------
 
+void optimize_single_roi(data_struct::Analysis_Job<double>& analysis_job,
+    std::string roi_file_name,
+    std::map<int, std::map<std::string,
+    data_struct::Fit_Parameters<double>>> & out_roi_fit_params,
+    Callback_Func_Status_Def* status_callback)
+{
+    std::vector<Roi_Fit_Job> jobs;
+    collect_roi_fit_jobs(analysis_job, roi_file_name, jobs);
+    run_roi_fit_jobs(analysis_job, jobs, out_roi_fit_params, status_callback);
+}
+
+// ----------------------------------------------------------------------------
+
 void optimize_rois(data_struct::Analysis_Job<double>& analysis_job)
 {
      //       detector_num        file_name_roi           fit_params
@@ -866,17 +1442,20 @@ void optimize_rois(data_struct::Analysis_Job<double>& analysis_job)
         files_to_proc.push_back(itr);
     }
 
+    // loading is serial, the optimizations of all files, detectors and rois then share one pool
+    std::vector<Roi_Fit_Job> jobs;
     for (auto& itr : files_to_proc)
     {
-        optimize_single_roi(analysis_job, itr, roi_fit_params);
+        collect_roi_fit_jobs(analysis_job, itr, jobs);
     }
+    run_roi_fit_jobs(analysis_job, jobs, roi_fit_params, nullptr);
 
     // save all to csv
     for (auto detector_num : analysis_job.detector_num_arr)
     {
         std::string save_path = analysis_job.dataset_directory + "output/specfit_results" + std::to_string(detector_num) + ".csv";
         std::string quant_save_path = analysis_job.dataset_directory + "output/specfit_results" + std::to_string(detector_num) + "_quantified.csv";
-        io::file::csv::save_v9_specfit(save_path, roi_fit_params.at(detector_num));
+        io::file::csv::save_v9_specfit(save_path, roi_fit_params[detector_num]);
         if (analysis_job.get_detector(detector_num)->quantification_standards.size() > 0)
         {
             io::file::csv::save_v9_specfit_quantified(quant_save_path, analysis_job.get_detector(detector_num), analysis_job.fitting_routines, roi_fit_params.at(detector_num));
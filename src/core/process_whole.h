@@ -75,6 +75,9 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "workflow/threadpool.h"
 
+#include "core/row_shards.h"
+#include "core/mem_info.h"
+
 #include "io/file/hl_file_io.h"
 #include "io/file/mca_io.h"
 
@@ -90,6 +93,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "fitting/routines/svd_fit_routine.h"
 #include "fitting/routines/nnls_fit_routine.h"
 #include "fitting/routines/hybrid_param_nnls_fit_routine.h"
+#include "fitting/routines/low_rank_reduction.h"
 
 #include "fitting/optimizers/lmfit_optimizer.h"
 #include "fitting/optimizers/mpfit_optimizer.h"
@@ -104,6 +108,10 @@ POSSIBILITY OF SUCH DAMAGE.
 
 using namespace std::placeholders; //for _1, _2,
 
+//a row stops warm starting once at least this many warm starts were refit cold
+const size_t WARM_START_MIN_REFITS = 4;
+//and more than 1 in this many of its warm starts were
+const size_t WARM_START_MAX_REFIT_RATIO = 8;
 
 // ----------------------------------------------------------------------------
 
@@ -160,16 +168,13 @@ DLL_EXPORT data_struct::Fit_Count_Dict<T_real>* generate_fit_count_dict(const Fi
 // ----------------------------------------------------------------------------
 
 template<typename T_real>
-DLL_EXPORT bool fit_single_spectra(fitting::routines::Base_Fit_Routine<T_real>* fit_routine,
-                        const fitting::models::Base_Model<T_real>* const model,
+DLL_EXPORT void save_single_spectra_counts(std::unordered_map<std::string, T_real>& counts_dict,
                         const data_struct::Spectra<T_real>* const spectra,
                         const data_struct::Fit_Element_Map_Dict<T_real>* const elements_to_fit,
                         data_struct::Fit_Count_Dict<T_real>* out_fit_counts,
                         size_t i,
                         size_t j)
 {
-    std::unordered_map<std::string, T_real> counts_dict;
-    fit_routine->fit_spectra(model, spectra, elements_to_fit, counts_dict);
     //save count / sec
     for (auto& el_itr : *elements_to_fit)
     {
@@ -201,11 +206,519 @@ DLL_EXPORT bool fit_single_spectra(fitting::routines::Base_Fit_Routine<T_real>*
             (*out_fit_counts)[STR_TOTAL_FLUORESCENCE_YIELD](i, j) = spectra->sum() / spectra->elapsed_livetime();
         }
     }
+}
 
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+DLL_EXPORT bool fit_single_spectra(fitting::routines::Base_Fit_Routine<T_real>* fit_routine,
+                        const fitting::models::Base_Model<T_real>* const model,
+                        const data_struct::Spectra<T_real>* const spectra,
+                        const data_struct::Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                        data_struct::Fit_Count_Dict<T_real>* out_fit_counts,
+                        size_t i,
+                        size_t j)
+{
+    std::unordered_map<std::string, T_real> counts_dict;
+    fit_routine->fit_spectra(model, spectra, elements_to_fit, counts_dict);
+    save_single_spectra_counts(counts_dict, spectra, elements_to_fit, out_fit_counts, i, j);
     return true;
 }
 
+// ----------------------------------------------------------------------------
 
+/**
+ * @brief fit_pixel_range : Fit count pixels starting at flat index first (row major, may span rows) into out_fit_counts.
+ *                          One task per range keeps the queue overhead small for cheap routines.
+ */
+template<typename T_real>
+DLL_EXPORT bool fit_pixel_range(fitting::routines::Base_Fit_Routine<T_real>* fit_routine,
+                        const fitting::models::Base_Model<T_real>* const model,
+                        const data_struct::Spectra_Volume<T_real>* const spectra_volume,
+                        const data_struct::Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                        data_struct::Fit_Count_Dict<T_real>* out_fit_counts,
+                        size_t first,
+                        size_t count)
+{
+    const size_t cols = spectra_volume->cols();
+    std::unordered_map<std::string, T_real> counts_dict;
+    for (size_t p = first; p < first + count; p++)
+    {
+        counts_dict.clear();
+        const data_struct::Spectra<T_real>* spectra = &(*spectra_volume)[p / cols][p % cols];
+        fit_routine->fit_spectra(model, spectra, elements_to_fit, counts_dict);
+        save_single_spectra_counts(counts_dict, spectra, elements_to_fit, out_fit_counts, p / cols, p % cols);
+    }
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief zero_counts_on_failure : Run one fit job and zero its pixels (row major, first to first + count) if it fails or throws,
+ *                                 the counts are allocated without zeroing so a failed job would save whatever was in memory.
+ */
+template<typename T_real, class F>
+DLL_EXPORT bool zero_counts_on_failure(F&& fit_job, data_struct::Fit_Count_Dict<T_real>* out_fit_counts, size_t first, size_t count)
+{
+    auto zero_counts = [&]()
+    {
+        for (auto& itr : *out_fit_counts)
+        {
+            std::fill(itr.second.data() + first, itr.second.data() + first + count, (T_real)0.0);
+        }
+    };
+    bool ok = false;
+    try
+    {
+        ok = fit_job();
+    }
+    catch (...)
+    {
+        zero_counts();
+        throw;
+    }
+    if (false == ok)
+    {
+        zero_counts();
+    }
+    return ok;
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief fit_single_line_warm_start : Fit a row of spectra left to right, seeding each pixel with the converged
+ *                                     parameters of its left neighbour. Falls back to the default start when the
+ *                                     neighbour did not converge. A warm start that does not converge is refit cold,
+ *                                     so once more than 1 in WARM_START_MAX_REFIT_RATIO warm starts of the row (and at
+ *                                     least WARM_START_MIN_REFITS) needed that, the rest of the row is fit cold only.
+ *                                     Rows are independent so results do not depend on thread count.
+ */
+template<typename T_real>
+DLL_EXPORT bool fit_single_line_warm_start(fitting::routines::Param_Optimized_Fit_Routine<T_real>* fit_routine,
+                        const fitting::models::Base_Model<T_real>* const model,
+                        const data_struct::Spectra_Line<T_real>* const spectra_line,
+                        const data_struct::Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                        data_struct::Fit_Count_Dict<T_real>* out_fit_counts,
+                        size_t i)
+{
+    data_struct::Fit_Parameters<T_real> prev_fit_params;
+    bool has_seed = false;
+    bool warm_start = true;
+    size_t warm_starts = 0;
+    size_t cold_refits = 0;
+    for (size_t j = 0; j < spectra_line->size(); j++)
+    {
+        std::unordered_map<std::string, T_real> counts_dict;
+        data_struct::Fit_Parameters<T_real> fit_params;
+        const data_struct::Spectra<T_real>* spectra = &(*spectra_line)[j];
+        bool seeded = (warm_start && has_seed);
+        bool cold_refit = false;
+        fitting::optimizers::OPTIMIZER_OUTCOME outcome = fit_routine->fit_spectra_warm_start(model, spectra, elements_to_fit, (seeded ? &prev_fit_params : nullptr), fit_params, counts_dict, &cold_refit);
+        if (seeded)
+        {
+            warm_starts++;
+            cold_refits += cold_refit ? 1 : 0;
+            //bad seeds cost a warm and a cold fit each, stop paying twice once they are common in this row
+            if (cold_refits >= WARM_START_MIN_REFITS && cold_refits * WARM_START_MAX_REFIT_RATIO > warm_starts)
+            {
+                warm_start = false;
+            }
+        }
+        has_seed = fitting::optimizers::optimizer_outcome_converged(outcome);
+        if (has_seed)
+        {
+            prev_fit_params = fit_params;
+        }
+        save_single_spectra_counts(counts_dict, spectra, elements_to_fit, out_fit_counts, i, j);
+    }
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief fit_spectra_volume_low_rank : Factorize the background subtracted volume into a few basis spectra, fit only the
+ *                                      basis with the matrix routine and rebuild each pixel's counts from its weights.
+ *                                      Returns false if the routine or factorization can not be used, the dense copy of
+ *                                      the volume does not fit in memory or a row failed, the volume is fit per pixel then.
+ */
+template<typename T_real>
+DLL_EXPORT bool fit_spectra_volume_low_rank(fitting::routines::Matrix_Optimized_Fit_Routine<T_real>* fit_routine,
+                        const fitting::models::Base_Model<T_real>* const model,
+                        const data_struct::Spectra_Volume<T_real>* const spectra_volume,
+                        const data_struct::Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                        data_struct::Fit_Count_Dict<T_real>* out_fit_counts,
+                        bool non_negative,
+                        ThreadPool* tp)
+{
+    typedef typename fitting::routines::Low_Rank_Reduction<T_real>::Matrix_Type Matrix_Type;
+
+    const size_t rows = spectra_volume->rows();
+    const size_t cols = spectra_volume->cols();
+    const Eigen::Index num_channels = fit_routine->energy_range().count();
+
+    // dense copy of the volume, the factorization needs about as much again for its projections
+    long long data_mem = (long long)(rows * cols) * num_channels * sizeof(T_real);
+    long long avail_mem = get_available_mem();
+    if (avail_mem > 0 && data_mem * 2 > avail_mem)
+    {
+        logW << "Low rank [ " << fit_routine->get_name() << " ] needs " << data_mem * 2 << " bytes, only " << avail_mem << " available. Fitting per pixel.\n";
+        return false;
+    }
+    Matrix_Type data(rows * cols, num_channels);
+    std::vector<data_struct::ArrayTr<T_real>> row_background(rows);
+
+    // snip background is still per pixel, one job per row
+    workflow::Completion_Group background_jobs;
+    for (size_t i = 0; i < rows; i++)
+    {
+        tp->enqueue_detached(background_jobs.track([&, i]()
+        {
+            data_struct::ArrayTr<T_real> background;
+            data_struct::ArrayTr<T_real> spectra_sub_background;
+            row_background[i].setZero(num_channels);
+            for (size_t j = 0; j < cols; j++)
+            {
+                fit_routine->subtract_background(model, &(*spectra_volume)[i][j], background, spectra_sub_background);
+                data.row(i * cols + j) = spectra_sub_background.matrix().transpose();
+                row_background[i] += background;
+            }
+        }));
+    }
+    if (false == background_jobs.wait())
+    {
+        return false;
+    }
+
+    fitting::routines::Low_Rank_Reduction<T_real> reduction;
+    reduction.set_max_rank(fit_routine->low_rank_max_rank());
+    reduction.set_variance(fit_routine->low_rank_variance());
+    reduction.set_non_negative(non_negative);
+    if (false == reduction.factorize(data))
+    {
+        logW << "Low rank factorization failed for " << fit_routine->get_name() << "\n";
+        return false;
+    }
+    const Matrix_Type& weights = reduction.weights();
+    const Matrix_Type& basis = reduction.basis();
+    logI << "Low rank [ " << fit_routine->get_name() << " ] rank " << reduction.rank() << " explained variance " << reduction.explained_variance() << (non_negative ? " nmf iterations " : "") << (non_negative ? std::to_string(reduction.num_iter()) : "") << "\n";
+
+    std::vector<std::string> names;
+    for (const auto& itr : *elements_to_fit)
+    {
+        names.push_back(itr.first);
+    }
+
+    // element counts and model of each basis spectra
+    Matrix_Type basis_counts(reduction.rank(), names.size());
+    Matrix_Type basis_models(reduction.rank(), num_channels);
+    for (size_t r = 0; r < reduction.rank(); r++)
+    {
+        std::unordered_map<std::string, T_real> counts_dict;
+        data_struct::ArrayTr<T_real> rhs = basis.row(r).transpose().array();
+        data_struct::ArrayTr<T_real> basis_model;
+        if (false == fit_routine->fit_counts(rhs, elements_to_fit, counts_dict, basis_model))
+        {
+            return false;
+        }
+        for (size_t e = 0; e < names.size(); e++)
+        {
+            basis_counts(r, e) = counts_dict[names[e]];
+        }
+        basis_models.row(r) = basis_model.matrix().transpose();
+    }
+
+    workflow::Completion_Group count_jobs;
+    for (size_t i = 0; i < rows; i++)
+    {
+        tp->enqueue_detached(count_jobs.track([&, i]()
+        {
+            std::unordered_map<std::string, T_real> counts_dict;
+            for (size_t j = 0; j < cols; j++)
+            {
+                const Eigen::Index p = i * cols + j;
+                for (size_t e = 0; e < names.size(); e++)
+                {
+                    counts_dict[names[e]] = weights.row(p).dot(basis_counts.col(e));
+                }
+                counts_dict[STR_NUM_ITR] = 0;
+                counts_dict[STR_RESIDUAL] = (weights.row(p) * basis_models - data.row(p)).norm();
+                save_single_spectra_counts(counts_dict, &(*spectra_volume)[i][j], elements_to_fit, out_fit_counts, i, j);
+            }
+        }));
+    }
+    if (false == count_jobs.wait())
+    {
+        logW << "Low rank [ " << fit_routine->get_name() << " ] failed to save counts. Fitting per pixel.\n";
+        return false;
+    }
+
+    data_struct::ArrayTr<T_real> background;
+    background.setZero(num_channels);
+    for (const auto& itr : row_background)
+    {
+        background += itr;
+    }
+    data_struct::ArrayTr<T_real> fitted = (weights.colwise().sum() * basis_models).transpose().array();
+    fitted += background;
+    fit_routine->add_integrated_spectra(fitted, background);
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief tune_pixels_per_task : Fit the first row as one pixel jobs and time them. Returns the pixels per job that run about a
+ *                               millisecond while leaving every worker at least 8 jobs. fitted_pixels is set to the pixels already done.
+ */
+template<typename T_real>
+DLL_EXPORT size_t tune_pixels_per_task(fitting::routines::Base_Fit_Routine<T_real>* fit_routine,
+                                       const fitting::models::Base_Model<T_real>* const model,
+                                       const data_struct::Spectra_Volume<T_real>* const spectra_volume,
+                                       const data_struct::Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                                       data_struct::Fit_Count_Dict<T_real>* out_fit_counts,
+                                       ThreadPool* tp,
+                                       size_t& fitted_pixels)
+{
+    const size_t rows = spectra_volume->rows();
+    const size_t cols = spectra_volume->cols();
+    const size_t num_pixels = rows * cols;
+    const size_t workers = std::max((size_t)1, tp->size());
+    fitted_pixels = std::min(num_pixels, std::max(cols, 4 * workers));
+
+    std::atomic<long long> elapsed_ns(0);
+    workflow::Completion_Group jobs;
+    for (size_t p = 0; p < fitted_pixels; p++)
+    {
+        tp->enqueue_detached_on_node(tp->node_of_row(p / cols, rows), jobs.track([=, &elapsed_ns]()
+        {
+            std::chrono::time_point<std::chrono::steady_clock> start = std::chrono::steady_clock::now();
+            bool ok = zero_counts_on_failure<T_real>([=]() { return fit_pixel_range<T_real>(fit_routine, model, spectra_volume, elements_to_fit, out_fit_counts, p, 1); }, out_fit_counts, p, 1);
+            elapsed_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            return ok;
+        }));
+    }
+    if (false == jobs.wait())
+    {
+        logE << "Fitting [ " << fit_routine->get_name() << " ] " << jobs.num_failed() << " of " << jobs.size() << " timing jobs failed, their pixels are saved as 0\n";
+        for (const auto& err : jobs.errors())
+        {
+            logE << err << "\n";
+        }
+    }
+
+    double pixel_ns = std::max(1.0, (double)elapsed_ns / (double)std::max((size_t)1, fitted_pixels));
+    size_t pixels = (size_t)(1.0e6 / pixel_ns);
+    pixels = std::max((size_t)1, std::min(pixels, (num_pixels - fitted_pixels) / (8 * workers)));
+    logI << "Fitting [ " << fit_routine->get_name() << " ] " << pixel_ns / 1000.0 << " us per pixel, " << pixels << " pixels per job\n";
+    return pixels;
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief fit_spectra_volume : Fit every pixel of the volume with one routine on the thread pool. Caller owns the returned counts.
+ */
+template<typename T_real>
+DLL_EXPORT data_struct::Fit_Count_Dict<T_real>* fit_spectra_volume(data_struct::Fitting_Routines routine_type,
+                                                                   fitting::routines::Base_Fit_Routine<T_real>* fit_routine,
+                                                                   fitting::models::Base_Model<T_real>* model,
+                                                                   data_struct::Spectra_Volume<T_real>* spectra_volume,
+                                                                   const data_struct::Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                                                                   ThreadPool* tp,
+                                                                   Callback_Func_Status_Def* status_callback = nullptr)
+{
+    std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now();
+
+    //Allocate memeory to save fit counts, not zeroed so the owning workers first touch their rows
+    data_struct::Fit_Count_Dict<T_real>* element_fit_count_dict = generate_fit_count_dict(elements_to_fit, spectra_volume->rows(), spectra_volume->cols(), true);
+
+    const size_t rows = spectra_volume->rows();
+    const size_t num_pixels = rows * spectra_volume->cols();
+    bool warm_start = false;
+    if (routine_type == data_struct::Fitting_Routines::GAUSS_TAILS)
+    {
+        warm_start = ((fitting::routines::Param_Optimized_Fit_Routine<T_real>*)fit_routine)->warm_start();
+    }
+    bool low_rank = (false == warm_start)
+        && (routine_type == data_struct::Fitting_Routines::NNLS || routine_type == data_struct::Fitting_Routines::SVD)
+        && ((fitting::routines::Matrix_Optimized_Fit_Routine<T_real>*)fit_routine)->low_rank_max_rank() > 0
+        && fit_spectra_volume_low_rank((fitting::routines::Matrix_Optimized_Fit_Routine<T_real>*)fit_routine, model, spectra_volume, elements_to_fit, element_fit_count_dict, routine_type == data_struct::Fitting_Routines::NNLS, tp);
+
+    //pixel ranges per job, timed on the first row unless the routine has a fixed size
+    size_t pixels_per_task = 1;
+    size_t next_pixel = 0;
+    if (false == warm_start && false == low_rank)
+    {
+        pixels_per_task = fit_routine->pixels_per_task();
+        if (pixels_per_task == 0)
+        {
+            pixels_per_task = tune_pixels_per_task(fit_routine, model, spectra_volume, elements_to_fit, element_fit_count_dict, tp, next_pixel);
+        }
+    }
+    size_t num_jobs = warm_start ? rows : (low_rank ? 0 : (num_pixels - next_pixel + pixels_per_task - 1) / pixels_per_task);
+
+    //Counts finished jobs instead of keeping a future per pixel, progress is reported about a thousand times per volume
+    workflow::Completion_Group fit_jobs(num_jobs / 1000);
+
+    //Rows go to the workers of the numa node that owns them
+    if (warm_start)
+    {
+        //one job per row so each pixel can be seeded by its left neighbour
+        fitting::routines::Param_Optimized_Fit_Routine<T_real>* param_fit = (fitting::routines::Param_Optimized_Fit_Routine<T_real>*)fit_routine;
+        for (size_t i = 0; i < rows; i++)
+        {
+            data_struct::Spectra_Line<T_real>* line = &(*spectra_volume)[i];
+            tp->enqueue_detached_on_node(tp->node_of_row(i, rows), fit_jobs.track([=]()
+            {
+                return zero_counts_on_failure<T_real>([=]() { return fit_single_line_warm_start<T_real>(param_fit, model, line, elements_to_fit, element_fit_count_dict, i); }, element_fit_count_dict, i * spectra_volume->cols(), spectra_volume->cols());
+            }));
+        }
+    }
+    else if (false == low_rank)
+    {
+        //also used when the low rank factorization fails
+        for (size_t p = next_pixel; p < num_pixels; p += pixels_per_task)
+        {
+            size_t count = std::min(pixels_per_task, num_pixels - p);
+            tp->enqueue_detached_on_node(tp->node_of_row(p / spectra_volume->cols(), rows), fit_jobs.track([=]()
+            {
+                return zero_counts_on_failure<T_real>([=]() { return fit_pixel_range<T_real>(fit_routine, model, spectra_volume, elements_to_fit, element_fit_count_dict, p, count); }, element_fit_count_dict, p, count);
+            }));
+        }
+    }
+
+    //wait for all jobs to finish
+    if (false == fit_jobs.wait(status_callback))
+    {
+        logE << "Fitting [ " << fit_routine->get_name() << " ] " << fit_jobs.num_failed() << " of " << fit_jobs.size() << " jobs failed, their pixels are saved as 0\n";
+        for (const auto& err : fit_jobs.errors())
+        {
+            logE << err << "\n";
+        }
+    }
+
+    std::chrono::time_point<std::chrono::system_clock> end = std::chrono::system_clock::now();
+    std::chrono::duration<double> elapsed_seconds = end - start;
+    logI << "Fitting [ " << fit_routine->get_name() << " ] elapsed time: " << elapsed_seconds.count() << "s" << "\n";
+    if (routine_type == data_struct::Fitting_Routines::GAUSS_TAILS && element_fit_count_dict->count(STR_NUM_ITR) > 0)
+    {
+        logI << "Fitting [ " << fit_routine->get_name() << " ] total function evaluations: " << element_fit_count_dict->at(STR_NUM_ITR).sum() << (warm_start ? " (warm start)" : "") << "\n";
+    }
+
+    return element_fit_count_dict;
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief save_fit_routine_results : Save the counts of one fitted routine, plus its integrated and max spectra for the matrix routines.
+ */
+template<typename T_real>
+DLL_EXPORT void save_fit_routine_results(data_struct::Fitting_Routines routine_type,
+                                         fitting::routines::Base_Fit_Routine<T_real>* fit_routine,
+                                         data_struct::Fit_Count_Dict<T_real>* element_fit_count_dict,
+                                         data_struct::Spectra_Volume<T_real>* spectra_volume,
+                                         data_struct::Detector<T_real>* detector)
+{
+    std::chrono::time_point<std::chrono::system_clock> start, end;
+
+    io::file::HDF5_IO::inst()->save_element_fits(fit_routine->get_name(), element_fit_count_dict);
+    io::file::HDF5_IO::inst()->save_params_override(&detector->fit_params_override_dict);
+
+    // the matrix routine saves the max channel spectra too, read the volume once for both
+    data_struct::Spectra<T_real> int_spec;
+    data_struct::Spectra<T_real> max_spectra;
+    data_struct::Spectra<T_real> max_10_spectra;
+    if (routine_type == data_struct::Fitting_Routines::GAUSS_MATRIX)
+    {
+        start = std::chrono::system_clock::now();
+        spectra_volume->integrate_and_max_spectra(int_spec, max_spectra, max_10_spectra);
+        end = std::chrono::system_clock::now();
+        std::chrono::duration<double> elapsed_seconds = end - start;
+        logI << "Integrated and max channel spectra elapsed time: " << elapsed_seconds.count() << "s" << "\n";
+    }
+
+    if (routine_type == data_struct::Fitting_Routines::GAUSS_MATRIX
+        || routine_type == data_struct::Fitting_Routines::NNLS
+        || routine_type == data_struct::Fitting_Routines::SVD)
+    {
+        fitting::routines::Matrix_Optimized_Fit_Routine<T_real>* matrix_fit = (fitting::routines::Matrix_Optimized_Fit_Routine<T_real>*)fit_routine;
+        io::file::HDF5_IO::inst()->save_fitted_int_spectra(fit_routine->get_name(),
+            matrix_fit->fitted_integrated_spectra(),
+            matrix_fit->energy_range(),
+            matrix_fit->fitted_integrated_background(),
+            (*spectra_volume)[0][0].size());
+
+        // save png 
+        std::string dataset_fullpath = io::file::HDF5_IO::inst()->get_filename();
+        int sidx = dataset_fullpath.find("img.dat");
+        if (dataset_fullpath.length() > 0 && sidx > 0) 
+        {
+            dataset_fullpath.replace(sidx, 7, "output"); // 7 = sizeof("img.dat")
+            std::string str_path = dataset_fullpath + "_" + fit_routine->get_name() + ".png";
+            data_struct::ArrayTr<T_real> ev = data_struct::gen_energy_vector(matrix_fit->energy_range(), detector->fit_params_override_dict.fit_params);
+            if (int_spec.size() == 0)
+            {
+                int_spec = spectra_volume->integrate();
+            }
+            int_spec = int_spec.sub_spectra(matrix_fit->energy_range().min, matrix_fit->energy_range().count());
+            #ifdef _BUILD_WITH_QT
+            visual::SavePlotSpectrasFromConsole(str_path, &ev, &int_spec, (&matrix_fit->fitted_integrated_spectra()), (&matrix_fit->fitted_integrated_background()), true);
+            #endif
+        }
+
+    }
+    if (routine_type == data_struct::Fitting_Routines::GAUSS_MATRIX)
+    {
+        fitting::routines::Matrix_Optimized_Fit_Routine<T_real>* matrix_fit = (fitting::routines::Matrix_Optimized_Fit_Routine<T_real>*)fit_routine;
+        io::file::HDF5_IO::inst()->save_max_10_spectra(fit_routine->get_name(),
+            matrix_fit->energy_range(),
+            max_spectra,
+            max_10_spectra,
+            matrix_fit->fitted_integrated_background());
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief save_proc_spectra_end : Save the energy calibration and the spectra volume and close the save sequence.
+ */
+template<typename T_real>
+DLL_EXPORT void save_proc_spectra_end(data_struct::Spectra_Volume<T_real>* spectra_volume,
+                                      data_struct::Detector<T_real>* detector,
+                                      bool save_spec_vol)
+{
+    T_real energy_offset = 0.0;
+    T_real energy_slope = 0.0;
+    T_real energy_quad = 0.0;
+    data_struct::Fit_Parameters<T_real> fit_params = detector->model->fit_parameters();
+    if (fit_params.contains(STR_ENERGY_OFFSET))
+    {
+        energy_offset = fit_params[STR_ENERGY_OFFSET].value;
+    }
+    if (fit_params.contains(STR_ENERGY_SLOPE))
+    {
+        energy_slope = fit_params[STR_ENERGY_SLOPE].value;
+    }
+    if (fit_params.contains(STR_ENERGY_QUADRATIC))
+    {
+        energy_quad = fit_params[STR_ENERGY_QUADRATIC].value;
+    }
+
+    io::file::HDF5_IO::inst()->save_energy_calib(spectra_volume->samples_size(), energy_offset, energy_slope, energy_quad);
+
+    if (save_spec_vol)
+    {
+        io::file::HDF5_IO::inst()->save_spectra_volume("mca_arr", spectra_volume);
+    }
+    
+    io::file::HDF5_IO::inst()->end_save_seq();
+}
 
 // ----------------------------------------------------------------------------
 
@@ -233,129 +746,356 @@ DLL_EXPORT void proc_spectra(data_struct::Spectra_Volume<T_real>* spectra_volume
     //Range of energy in spectra to fit
     fitting::models::Range energy_range = data_struct::get_energy_range(spectra_volume->samples_size(), &(detector->fit_params_override_dict.fit_params));
 
-    std::chrono::time_point<std::chrono::system_clock> start, end;
-
     for (auto& itr : detector->fit_routines)
     {
         fitting::routines::Base_Fit_Routine<T_real>* fit_routine = itr.second;
 
         logI << "Processing  " << fit_routine->get_name() << "\n";
 
-        start = std::chrono::system_clock::now();
         if (override_params->elements_to_fit.size() < 1)
         {
             logE << "No elements to fit. Check  maps_fit_parameters_override.txt0 - 3 exist" << "\n";
             continue;
         }
 
-        //Fit job queue
-        std::queue<std::future<bool> >* fit_job_queue = new std::queue<std::future<bool> >();
+        data_struct::Fit_Count_Dict<T_real>* element_fit_count_dict = fit_spectra_volume(itr.first, fit_routine, detector->model, spectra_volume, &override_params->elements_to_fit, tp, status_callback);
+
+        save_fit_routine_results(itr.first, fit_routine, element_fit_count_dict, spectra_volume, detector);
+
+        element_fit_count_dict->clear();
+        delete element_fit_count_dict;
+    }
+
+    save_proc_spectra_end(spectra_volume, detector, save_spec_vol);
+}
 
-        //Allocate memeory to save fit counts
-        data_struct::Fit_Count_Dict<T_real>* element_fit_count_dict = generate_fit_count_dict(&override_params->elements_to_fit, spectra_volume->rows(), spectra_volume->cols(), true);
+// ----------------------------------------------------------------------------
 
-        for (size_t i = 0; i < spectra_volume->rows(); i++)
+/**
+ * @brief write_fit_routine_shard : Child side of fit_spectra_volume_row_shards, sends one routine's counts for the shard's rows and
+ *                                  for matrix routines the shard's integrated fitted spectra and background.
+ */
+template<typename T_real>
+DLL_EXPORT bool write_fit_routine_shard(Row_Shards& shards,
+                                        data_struct::Fitting_Routines routine_type,
+                                        fitting::routines::Base_Fit_Routine<T_real>* fit_routine,
+                                        const data_struct::Fit_Count_Dict<T_real>* element_fit_count_dict)
+{
+    int32_t type = (int32_t)routine_type;
+    uint64_t num_keys = element_fit_count_dict->size();
+    if (false == shards.write(&type, sizeof(type)) || false == shards.write(&num_keys, sizeof(num_keys)))
+    {
+        return false;
+    }
+    for (const auto& itr : *element_fit_count_dict)
+    {
+        uint64_t name_len = itr.first.length();
+        if (false == shards.write(&name_len, sizeof(name_len))
+            || false == shards.write(itr.first.data(), name_len)
+            || false == shards.write(itr.second.data(), itr.second.size() * sizeof(T_real)))
         {
-            for (size_t j = 0; j < spectra_volume->cols(); j++)
-            {
-                //logD<< i<<" "<<j<<"\n";
-                fit_job_queue->emplace(tp->enqueue(fit_single_spectra<T_real>, fit_routine, detector->model, &(*spectra_volume)[i][j], &override_params->elements_to_fit, element_fit_count_dict, i, j));
-            }
+            return false;
         }
+    }
+
+    uint64_t int_size = 0;
+    if (routine_type == data_struct::Fitting_Routines::GAUSS_MATRIX
+        || routine_type == data_struct::Fitting_Routines::NNLS
+        || routine_type == data_struct::Fitting_Routines::SVD)
+    {
+        fitting::routines::Matrix_Optimized_Fit_Routine<T_real>* matrix_fit = (fitting::routines::Matrix_Optimized_Fit_Routine<T_real>*)fit_routine;
+        int_size = matrix_fit->fitted_integrated_spectra().size();
+        return shards.write(&int_size, sizeof(int_size))
+            && shards.write(matrix_fit->fitted_integrated_spectra().data(), int_size * sizeof(T_real))
+            && shards.write(matrix_fit->fitted_integrated_background().data(), int_size * sizeof(T_real));
+    }
+    return shards.write(&int_size, sizeof(int_size));
+}
+
+// ----------------------------------------------------------------------------
 
-        size_t total_blocks = (spectra_volume->rows() * spectra_volume->cols()) - 1;
-        size_t cur_block = 0;
-        //wait for queue to finish processing
-        while (!fit_job_queue->empty())
+/**
+ * @brief read_fit_routine_shard : Parent side of fit_spectra_volume_row_shards, copies one routine's rows into the full size counts
+ *                                 and adds the shard's integrated spectra to the routine.
+ */
+template<typename T_real>
+DLL_EXPORT bool read_fit_routine_shard(Row_Shards& shards,
+                                       size_t shard,
+                                       data_struct::Detector<T_real>* detector,
+                                       std::unordered_map<data_struct::Fitting_Routines, data_struct::Fit_Count_Dict<T_real>*>& counts)
+{
+    const size_t row_start = shards.row_start(shard);
+    const size_t num_rows = shards.row_end(shard) - row_start;
+    int32_t type = 0;
+    uint64_t num_keys = 0;
+    if (false == shards.read(shard, &type, sizeof(type)) || false == shards.read(shard, &num_keys, sizeof(num_keys)))
+    {
+        return false;
+    }
+    data_struct::Fitting_Routines routine_type = (data_struct::Fitting_Routines)type;
+    if (counts.count(routine_type) == 0 || detector->fit_routines.count(routine_type) == 0)
+    {
+        logE << "Row shard " << shard << " sent an unknown fit routine " << type << "\n";
+        return false;
+    }
+    data_struct::Fit_Count_Dict<T_real>* element_fit_count_dict = counts.at(routine_type);
+    for (uint64_t k = 0; k < num_keys; k++)
+    {
+        uint64_t name_len = 0;
+        if (false == shards.read(shard, &name_len, sizeof(name_len)))
         {
-            auto ret = std::move(fit_job_queue->front());
-            fit_job_queue->pop();
-            ret.get();
-            if (status_callback != nullptr)
-            {
-                (*status_callback)(cur_block, total_blocks);
-            }
-            cur_block++;
+            return false;
+        }
+        std::string name(name_len, ' ');
+        if (false == shards.read(shard, &name[0], name_len))
+        {
+            return false;
         }
+        if (element_fit_count_dict->count(name) == 0)
+        {
+            logE << "Row shard " << shard << " sent unknown counts " << name << "\n";
+            return false;
+        }
+        //row major, the shard's rows are one contiguous block
+        data_struct::ArrayXXr<T_real>& arr = element_fit_count_dict->at(name);
+        if (false == shards.read(shard, arr.data() + (row_start * arr.cols()), num_rows * arr.cols() * sizeof(T_real)))
+        {
+            return false;
+        }
+    }
 
-        std::chrono::time_point<std::chrono::system_clock> end = std::chrono::system_clock::now();
-        std::chrono::duration<double> elapsed_seconds = end - start;
-        logI << "Fitting [ " << fit_routine->get_name() << " ] elapsed time: " << elapsed_seconds.count() << "s" << "\n";
+    uint64_t int_size = 0;
+    if (false == shards.read(shard, &int_size, sizeof(int_size)))
+    {
+        return false;
+    }
+    if (int_size > 0)
+    {
+        data_struct::ArrayTr<T_real> fitted(int_size);
+        data_struct::ArrayTr<T_real> background(int_size);
+        if (false == shards.read(shard, fitted.data(), int_size * sizeof(T_real)) || false == shards.read(shard, background.data(), int_size * sizeof(T_real)))
+        {
+            return false;
+        }
+        ((fitting::routines::Matrix_Optimized_Fit_Routine<T_real>*)detector->fit_routines.at(routine_type))->add_integrated_spectra(fitted, background);
+    }
+    return true;
+}
 
-        io::file::HDF5_IO::inst()->save_element_fits(fit_routine->get_name(), element_fit_count_dict);
-        io::file::HDF5_IO::inst()->save_params_override(override_params);
+// ----------------------------------------------------------------------------
 
+/**
+ * @brief reset_matrix_integrated_spectra : Clear the integrated fitted spectra and background the matrix routines of the detector summed.
+ */
+template<typename T_real>
+DLL_EXPORT void reset_matrix_integrated_spectra(data_struct::Detector<T_real>* detector)
+{
+    for (auto& itr : detector->fit_routines)
+    {
         if (itr.first == data_struct::Fitting_Routines::GAUSS_MATRIX
             || itr.first == data_struct::Fitting_Routines::NNLS
             || itr.first == data_struct::Fitting_Routines::SVD)
         {
-            fitting::routines::Matrix_Optimized_Fit_Routine<T_real>* matrix_fit = (fitting::routines::Matrix_Optimized_Fit_Routine<T_real>*)fit_routine;
-            io::file::HDF5_IO::inst()->save_fitted_int_spectra(fit_routine->get_name(),
-                matrix_fit->fitted_integrated_spectra(),
-                matrix_fit->energy_range(),
-                matrix_fit->fitted_integrated_background(),
-                (*spectra_volume)[0][0].size());
-
-            // save png 
-            std::string dataset_fullpath = io::file::HDF5_IO::inst()->get_filename();
-            int sidx = dataset_fullpath.find("img.dat");
-            if (dataset_fullpath.length() > 0 && sidx > 0) 
+            ((fitting::routines::Matrix_Optimized_Fit_Routine<T_real>*)itr.second)->reset_integrated_spectra();
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief fit_spectra_volume_row_shards : Fit every routine of the detector with the rows split over row_shards forked processes.
+ *        The children share the loaded volume copy on write and each runs its own pool of threads_per_shard workers. Counts are
+ *        merged in row order and integrated spectra are added in shard order. Returns false, with nothing left in out_counts
+ *        or the integrated spectra, if any shard failed. Caller owns the returned counts.
+ */
+template<typename T_real>
+DLL_EXPORT bool fit_spectra_volume_row_shards(data_struct::Spectra_Volume<T_real>* spectra_volume,
+                                              data_struct::Detector<T_real>* detector,
+                                              size_t row_shards,
+                                              size_t threads_per_shard,
+                                              std::unordered_map<data_struct::Fitting_Routines, data_struct::Fit_Count_Dict<T_real>*>& out_counts,
+                                              Callback_Func_Status_Def* status_callback = nullptr)
+{
+    std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now();
+    const data_struct::Fit_Element_Map_Dict<T_real>* elements_to_fit = &detector->fit_params_override_dict.elements_to_fit;
+    Row_Shards shards(spectra_volume->rows(), row_shards);
+
+    reset_matrix_integrated_spectra(detector);
+
+    bool started = shards.start([&](size_t shard) -> bool
+    {
+        //runs in the child, only its own rows are kept and the parent's pool threads do not exist here
+        spectra_volume->keep_rows(shards.row_start(shard), shards.row_end(shard));
+        Cpu_Budget::inst()->set_num_threads(threads_per_shard);
+        Cpu_Budget::inst()->set_serial_omp(true);
+        Eigen::setNbThreads(1);
+        ThreadPool shard_tp(threads_per_shard);
+        for (auto& itr : detector->fit_routines)
+        {
+            data_struct::Fit_Count_Dict<T_real>* element_fit_count_dict = fit_spectra_volume(itr.first, itr.second, detector->model, spectra_volume, elements_to_fit, &shard_tp);
+            bool sent = write_fit_routine_shard(shards, itr.first, itr.second, element_fit_count_dict);
+            delete element_fit_count_dict;
+            if (false == sent)
             {
-                dataset_fullpath.replace(sidx, 7, "output"); // 7 = sizeof("img.dat")
-                std::string str_path = dataset_fullpath + "_" + fit_routine->get_name() + ".png";
-                data_struct::ArrayTr<T_real> ev = data_struct::gen_energy_vector(matrix_fit->energy_range(), override_params->fit_params);
-                Spectra<T_real> int_spec = spectra_volume->integrate();
-                int_spec = int_spec.sub_spectra(matrix_fit->energy_range().min, matrix_fit->energy_range().count());
-                #ifdef _BUILD_WITH_QT
-                visual::SavePlotSpectrasFromConsole(str_path, &ev, &int_spec, (&matrix_fit->fitted_integrated_spectra()), (&matrix_fit->fitted_integrated_background()), true);
-                #endif
+                return false;
             }
+        }
+        return true;
+    });
+    if (false == started)
+    {
+        return false;
+    }
+
+    for (auto& itr : detector->fit_routines)
+    {
+        out_counts[itr.first] = generate_fit_count_dict(elements_to_fit, spectra_volume->rows(), spectra_volume->cols(), true);
+    }
 
+    //read back in shard order so the merge does not depend on which child finished first
+    bool merged = true;
+    for (size_t shard = 0; merged && shard < shards.size(); shard++)
+    {
+        for (size_t n = 0; merged && n < detector->fit_routines.size(); n++)
+        {
+            merged = read_fit_routine_shard(shards, shard, detector, out_counts);
         }
-        if (itr.first == data_struct::Fitting_Routines::GAUSS_MATRIX)
+        if (status_callback != nullptr)
         {
-            fitting::routines::Matrix_Optimized_Fit_Routine<T_real>* matrix_fit = (fitting::routines::Matrix_Optimized_Fit_Routine<T_real>*)fit_routine;
-            io::file::HDF5_IO::inst()->save_max_10_spectra(fit_routine->get_name(),
-                matrix_fit->energy_range(),
-                matrix_fit->max_integrated_spectra(),
-                matrix_fit->max_10_integrated_spectra(),
-                matrix_fit->fitted_integrated_background());
+            (*status_callback)(shard + 1, shards.size());
         }
+    }
+    merged = shards.finish() && merged;
 
-        delete fit_job_queue;
-        element_fit_count_dict->clear();
-        delete element_fit_count_dict;
+    if (false == merged)
+    {
+        for (auto& itr : out_counts)
+        {
+            delete itr.second;
+        }
+        out_counts.clear();
+        //shards read before the failure were already added
+        reset_matrix_integrated_spectra(detector);
+        return false;
     }
 
-    T_real energy_offset = 0.0;
-    T_real energy_slope = 0.0;
-    T_real energy_quad = 0.0;
-    data_struct::Fit_Parameters<T_real> fit_params = detector->model->fit_parameters();
-    if (fit_params.contains(STR_ENERGY_OFFSET))
+    std::chrono::duration<double> elapsed_seconds = std::chrono::system_clock::now() - start;
+    logI << "Fitting " << shards.size() << " row shards elapsed time: " << elapsed_seconds.count() << "s" << "\n";
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief proc_spectra_row_shards : proc_spectra with the fitting split over row_shards processes, saved through the same path so the
+ *                                  output matches a single process run. Falls back to proc_spectra where the rows can't be sharded.
+ */
+template<typename T_real>
+DLL_EXPORT void proc_spectra_row_shards(data_struct::Spectra_Volume<T_real>* spectra_volume,
+                                        data_struct::Detector<T_real>* detector,
+                                        ThreadPool* tp,
+                                        bool save_spec_vol,
+                                        size_t row_shards,
+                                        Callback_Func_Status_Def* status_callback = nullptr)
+{
+    if (detector == nullptr || spectra_volume == nullptr || row_shards < 2 || spectra_volume->rows() < 2
+        || detector->fit_params_override_dict.elements_to_fit.size() < 1)
     {
-        energy_offset = fit_params[STR_ENERGY_OFFSET].value;
+        proc_spectra(spectra_volume, detector, tp, save_spec_vol, status_callback);
+        return;
     }
-    if (fit_params.contains(STR_ENERGY_SLOPE))
+    if (false == Row_Shards::supported())
     {
-        energy_slope = fit_params[STR_ENERGY_SLOPE].value;
+        logW << "Row shards are not supported on this platform, fitting in one process\n";
+        proc_spectra(spectra_volume, detector, tp, save_spec_vol, status_callback);
+        return;
     }
-    if (fit_params.contains(STR_ENERGY_QUADRATIC))
+    for (auto& itr : detector->fit_routines)
     {
-        energy_quad = fit_params[STR_ENERGY_QUADRATIC].value;
+        //the factorization is over the whole volume, a shard would factor only its own rows
+        if ((itr.first == data_struct::Fitting_Routines::NNLS || itr.first == data_struct::Fitting_Routines::SVD)
+            && ((fitting::routines::Matrix_Optimized_Fit_Routine<T_real>*)itr.second)->low_rank_max_rank() > 0)
+        {
+            logW << "Low rank fitting can not be split in row shards, fitting in one process\n";
+            proc_spectra(spectra_volume, detector, tp, save_spec_vol, status_callback);
+            return;
+        }
     }
 
-    io::file::HDF5_IO::inst()->save_energy_calib(spectra_volume->samples_size(), energy_offset, energy_slope, energy_quad);
-
-    if (save_spec_vol)
+    size_t threads_per_shard = std::max((size_t)1, tp->size() / row_shards);
+    std::unordered_map<data_struct::Fitting_Routines, data_struct::Fit_Count_Dict<T_real>*> routine_counts;
+    if (false == fit_spectra_volume_row_shards(spectra_volume, detector, row_shards, threads_per_shard, routine_counts, status_callback))
     {
-        io::file::HDF5_IO::inst()->save_spectra_volume("mca_arr", spectra_volume);
+        logW << "Row shards failed, fitting in one process\n";
+        proc_spectra(spectra_volume, detector, tp, save_spec_vol, status_callback);
+        return;
     }
-    
-    io::file::HDF5_IO::inst()->end_save_seq();
 
+    for (auto& itr : detector->fit_routines)
+    {
+        logI << "Saving  " << itr.second->get_name() << "\n";
+        data_struct::Fit_Count_Dict<T_real>* element_fit_count_dict = routine_counts.at(itr.first);
+        save_fit_routine_results(itr.first, itr.second, element_fit_count_dict, spectra_volume, detector);
+        element_fit_count_dict->clear();
+        delete element_fit_count_dict;
+    }
 
+    save_proc_spectra_end(spectra_volume, detector, save_spec_vol);
 }
 
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief proc_spectra_preview : Fit spatially binned copies of the volume, coarsest first, and save them as <routine>_Bin<N>
+ *                               so element maps are on disk before the full resolution proc_spectra pass.
+ */
+template<typename T_real>
+DLL_EXPORT void proc_spectra_preview(data_struct::Spectra_Volume<T_real>* spectra_volume,
+                                     data_struct::Detector<T_real>* detector,
+                                     ThreadPool* tp,
+                                     std::vector<size_t> bin_sizes)
+{
+    if (detector == nullptr || spectra_volume == nullptr || detector->fit_params_override_dict.elements_to_fit.size() < 1)
+    {
+        return;
+    }
+
+    std::sort(bin_sizes.begin(), bin_sizes.end(), std::greater<size_t>());
+    std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now();
+    for (size_t bin_size : bin_sizes)
+    {
+        if (bin_size < 2)
+        {
+            continue;
+        }
+
+        data_struct::Spectra_Volume<T_real> binned_volume;
+        spectra_volume->generate_binned(bin_size, binned_volume);
+        logI << "Preview bin " << bin_size << "x" << bin_size << " : " << binned_volume.rows() << " x " << binned_volume.cols() << "\n";
+
+        for (auto& itr : detector->fit_routines)
+        {
+            fitting::routines::Base_Fit_Routine<T_real>* fit_routine = itr.second;
+            data_struct::Fit_Count_Dict<T_real>* element_fit_count_dict = fit_spectra_volume(itr.first, fit_routine, detector->model, &binned_volume, &detector->fit_params_override_dict.elements_to_fit, tp);
+            io::file::HDF5_IO::inst()->save_element_fits(fit_routine->get_name() + "_Bin" + std::to_string(bin_size), element_fit_count_dict);
+            element_fit_count_dict->clear();
+            delete element_fit_count_dict;
+
+            // the full resolution pass saves the integrated fit, do not count the preview in it
+            if (itr.first == data_struct::Fitting_Routines::GAUSS_MATRIX
+                || itr.first == data_struct::Fitting_Routines::NNLS
+                || itr.first == data_struct::Fitting_Routines::SVD)
+            {
+                ((fitting::routines::Matrix_Optimized_Fit_Routine<T_real>*)fit_routine)->reset_integrated_spectra();
+            }
+        }
+        io::file::HDF5_IO::inst()->flush();
+
+        std::chrono::duration<double> elapsed_seconds = std::chrono::system_clock::now() - start;
+        logI << "Preview bin " << bin_size << "x" << bin_size << " saved after " << elapsed_seconds.count() << "s" << "\n";
+    }
+}
 
 // ----------------------------------------------------------------------------
 
@@ -427,10 +1167,54 @@ void find_quantifier_scalers(std::unordered_map<std::string, double>& pv_map, Qu
 
 // ----------------------------------------------------------------------------
 
+/**
+ * @brief rehome_spectra_volume : Reallocate each row on a worker of the numa node that will fit it. No-op unless the pool is pinned over several nodes.
+ */
+template<typename T_real>
+DLL_EXPORT void rehome_spectra_volume(data_struct::Spectra_Volume<T_real>* spectra_volume, ThreadPool* tp)
+{
+    if (tp->num_nodes() < 2)
+    {
+        return;
+    }
+    workflow::Completion_Group jobs;
+    for (size_t i = 0; i < spectra_volume->rows(); i++)
+    {
+        tp->enqueue_detached_on_node(tp->node_of_row(i, spectra_volume->rows()), jobs.track([spectra_volume, i]() { (*spectra_volume)[i].rehome(); }));
+    }
+    jobs.wait();
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief dataset_save_path : img.dat file the fits of one dataset and detector are saved in. mda/mca datasets get one .h5<detector> per detector.
+ */
+template<typename T_real>
+DLL_EXPORT std::string dataset_save_path(const data_struct::Analysis_Job<T_real>* analysis_job, const std::string& dataset_file, size_t detector_num)
+{
+    size_t dlen = dataset_file.length();
+    bool is_mda = (dataset_file[dlen - 4] == '.' && dataset_file[dlen - 3] == 'm' && dataset_file[dlen - 2] == 'd' && dataset_file[dlen - 1] == 'a');
+    bool is_mca = (dataset_file[dlen - 4] == '.' && dataset_file[dlen - 3] == 'm' && dataset_file[dlen - 2] == 'c' && dataset_file[dlen - 1] == 'a');
+    bool is_mcad = (dataset_file[dlen - 5] == '.' && dataset_file[dlen - 4] == 'm' && dataset_file[dlen - 3] == 'c' && dataset_file[dlen - 2] == 'a');
+    if (is_mda || is_mca || is_mcad)
+    {
+        std::string str_detector_num = "";
+        if (detector_num != -1)
+        {
+            str_detector_num = std::to_string(detector_num);
+        }
+        return analysis_job->dataset_directory + "img.dat" + DIR_END_CHAR + dataset_file + ".h5" + str_detector_num;
+    }
+    return analysis_job->dataset_directory + "img.dat" + DIR_END_CHAR + dataset_file;
+}
+
+// ----------------------------------------------------------------------------
+
 template<typename T_real>
 DLL_EXPORT void process_dataset_files(data_struct::Analysis_Job<T_real>* analysis_job, Callback_Func_Status_Def* status_callback = nullptr)
 {
-    ThreadPool tp(analysis_job->num_threads);
+    ThreadPool tp(analysis_job->num_threads, analysis_job->numa_pin_threads);
 
     for (auto& dataset_file : analysis_job->dataset_files)
     {
@@ -450,26 +1234,7 @@ DLL_EXPORT void process_dataset_files(data_struct::Analysis_Job<T_real>* analysi
                 //Spectra volume data
                 data_struct::Spectra_Volume<T_real>* spectra_volume = new data_struct::Spectra_Volume<T_real>();
 
-                std::string fullpath;
-                size_t dlen = dataset_file.length();
-                bool is_mda = (dataset_file[dlen - 4] == '.' && dataset_file[dlen - 3] == 'm' && dataset_file[dlen - 2] == 'd' && dataset_file[dlen - 1] == 'a');
-                bool is_mca = (dataset_file[dlen - 4] == '.' && dataset_file[dlen - 3] == 'm' && dataset_file[dlen - 2] == 'c' && dataset_file[dlen - 1] == 'a');
-                bool is_mcad = (dataset_file[dlen - 5] == '.' && dataset_file[dlen - 4] == 'm' && dataset_file[dlen - 3] == 'c' && dataset_file[dlen - 2] == 'a');
-                if (is_mda || is_mca || is_mcad)
-                {
-                    std::string str_detector_num = "";
-                    if (detector_num != -1)
-                    {
-                        str_detector_num = std::to_string(detector_num);
-                    }
-                    std::string full_save_path = analysis_job->dataset_directory + "img.dat" + DIR_END_CHAR + dataset_file + ".h5" + str_detector_num;
-                    io::file::HDF5_IO::inst()->set_filename(full_save_path);
-                }
-                else
-                {
-                    std::string full_save_path = analysis_job->dataset_directory + "img.dat" + DIR_END_CHAR + dataset_file;
-                    io::file::HDF5_IO::inst()->set_filename(full_save_path);
-                }
+                io::file::HDF5_IO::inst()->set_filename(dataset_save_path(analysis_job, dataset_file, detector_num));
 
                 bool loaded_from_analyzed_hdf5 = false;
                 //load spectra volume
@@ -484,8 +1249,32 @@ DLL_EXPORT void process_dataset_files(data_struct::Analysis_Job<T_real>* analysi
                     continue;
                 }
 
-                analysis_job->init_fit_routines(spectra_volume->samples_size(), true);
-                proc_spectra(spectra_volume, detector, &tp, !loaded_from_analyzed_hdf5, status_callback);
+                rehome_spectra_volume(spectra_volume, &tp);
+                if (analysis_job->series)
+                {
+                    T_real incident_energy = 0;
+                    if (analysis_job->series_energies.count(dataset_file) > 0)
+                    {
+                        incident_energy = analysis_job->series_energies.at(dataset_file);
+                    }
+                    analysis_job->init_series_fit_routines(detector_num, spectra_volume->samples_size(), incident_energy);
+                }
+                else
+                {
+                    analysis_job->init_fit_routines(spectra_volume->samples_size(), true);
+                }
+                if (analysis_job->preview_bin_sizes.size() > 0)
+                {
+                    proc_spectra_preview(spectra_volume, detector, &tp, analysis_job->preview_bin_sizes);
+                }
+                if (analysis_job->row_shards > 1)
+                {
+                    proc_spectra_row_shards(spectra_volume, detector, &tp, !loaded_from_analyzed_hdf5, analysis_job->row_shards, status_callback);
+                }
+                else
+                {
+                    proc_spectra(spectra_volume, detector, &tp, !loaded_from_analyzed_hdf5, status_callback);
+                }
                 delete spectra_volume;
             }
         }
@@ -562,9 +1351,18 @@ DLL_EXPORT void process_dataset_files_quick_and_dirty(std::string dataset_file,
     }
     delete tmp_spectra_volume;
 
+    //rows were summed on this thread, move them to the nodes that fit them
+    rehome_spectra_volume(spectra_volume, &tp);
     analysis_job->init_fit_routines(spectra_volume->samples_size(), true);
 
-    proc_spectra(spectra_volume, detector, &tp, !is_loaded_from_analyzed_h5, status_callback);
+    if (analysis_job->row_shards > 1)
+    {
+        proc_spectra_row_shards(spectra_volume, detector, &tp, !is_loaded_from_analyzed_h5, analysis_job->row_shards, status_callback);
+    }
+    else
+    {
+        proc_spectra(spectra_volume, detector, &tp, !is_loaded_from_analyzed_h5, status_callback);
+    }
     delete spectra_volume;
 }
 
@@ -0,0 +1,219 @@
+/***
+Copyright (c) 2016, UChicago Argonne, LLC. All rights reserved.
+
+Copyright 2016. UChicago Argonne, LLC. This software was produced
+under U.S. Government contract DE-AC02-06CH11357 for Argonne National
+Laboratory (ANL), which is operated by UChicago Argonne, LLC for the
+U.S. Department of Energy. The U.S. Government has rights to use,
+reproduce, and distribute this software.  NEITHER THE GOVERNMENT NOR
+UChicago Argonne, LLC MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR
+ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  If software is
+modified to produce derivative works, such modified software should
+be clearly marked, so as not to confuse it with the version available
+from ANL.
+
+Additionally, redistribution and use in source and binary forms, with
+or without modification, are permitted provided that the following
+conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the name of UChicago Argonne, LLC, Argonne National
+      Laboratory, ANL, the U.S. Government, nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY UChicago Argonne, LLC AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL UChicago
+Argonne, LLC OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+***/
+
+
+#include "core/row_shards.h"
+
+#include <algorithm>
+#include <iostream>
+#if !defined(_WIN32)
+#include <cerrno>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+//-----------------------------------------------------------------------------
+
+Row_Shards::Row_Shards(size_t rows, size_t num_shards) : _rows(rows), _num_shards(std::max((size_t)1, std::min(rows, num_shards))), _write_fd(-1)
+{
+
+}
+
+//-----------------------------------------------------------------------------
+
+Row_Shards::~Row_Shards()
+{
+    finish();
+}
+
+//-----------------------------------------------------------------------------
+
+bool Row_Shards::supported()
+{
+#if !defined(_WIN32)
+    return true;
+#else
+    return false;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+
+bool Row_Shards::start(const std::function<bool(size_t)>& shard_func)
+{
+#if !defined(_WIN32)
+    // anything still buffered would be written again by every child
+    std::cout.flush();
+    std::cerr.flush();
+    for (size_t shard = 0; shard < _num_shards; shard++)
+    {
+        int fds[2];
+        if (pipe(fds) != 0)
+        {
+            logE << "Could not create pipe for row shard " << shard << "\n";
+            finish();
+            return false;
+        }
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            logE << "Could not fork row shard " << shard << "\n";
+            close(fds[0]);
+            close(fds[1]);
+            finish();
+            return false;
+        }
+        if (pid == 0)
+        {
+            // child: only keep our own write end, leave without running the parent's exit handlers
+            close(fds[0]);
+            for (int fd : _read_fds)
+            {
+                close(fd);
+            }
+            _write_fd = fds[1];
+            bool ok = shard_func(shard);
+            close(_write_fd);
+            std::cout.flush();
+            std::cerr.flush();
+            _exit(ok ? 0 : 1);
+        }
+        close(fds[1]);
+        _pids.push_back((int)pid);
+        _read_fds.push_back(fds[0]);
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+
+bool Row_Shards::write(const void* data, size_t len)
+{
+#if !defined(_WIN32)
+    const char* ptr = (const char*)data;
+    while (len > 0)
+    {
+        ssize_t n = ::write(_write_fd, ptr, len);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        ptr += n;
+        len -= (size_t)n;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+
+bool Row_Shards::read(size_t shard, void* data, size_t len)
+{
+#if !defined(_WIN32)
+    if (shard >= _read_fds.size())
+    {
+        return false;
+    }
+    char* ptr = (char*)data;
+    while (len > 0)
+    {
+        ssize_t n = ::read(_read_fds[shard], ptr, len);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        ptr += n;
+        len -= (size_t)n;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+
+bool Row_Shards::finish()
+{
+    bool all_ok = true;
+#if !defined(_WIN32)
+    // closing first lets a child blocked on a full pipe fail its write and exit
+    for (int fd : _read_fds)
+    {
+        close(fd);
+    }
+    _read_fds.clear();
+    for (size_t shard = 0; shard < _pids.size(); shard++)
+    {
+        int status = 0;
+        while (waitpid((pid_t)_pids[shard], &status, 0) < 0 && errno == EINTR)
+        {
+        }
+        if (false == WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            logW << "Row shard " << shard << " did not finish cleanly\n";
+            all_ok = false;
+        }
+    }
+    _pids.clear();
+#endif
+    return all_ok;
+}
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,103 @@
+/***
+Copyright (c) 2016, UChicago Argonne, LLC. All rights reserved.
+
+Copyright 2016. UChicago Argonne, LLC. This software was produced
+under U.S. Government contract DE-AC02-06CH11357 for Argonne National
+Laboratory (ANL), which is operated by UChicago Argonne, LLC for the
+U.S. Department of Energy. The U.S. Government has rights to use,
+reproduce, and distribute this software.  NEITHER THE GOVERNMENT NOR
+UChicago Argonne, LLC MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR
+ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  If software is
+modified to produce derivative works, such modified software should
+be clearly marked, so as not to confuse it with the version available
+from ANL.
+
+Additionally, redistribution and use in source and binary forms, with
+or without modification, are permitted provided that the following
+conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the name of UChicago Argonne, LLC, Argonne National
+      Laboratory, ANL, the U.S. Government, nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY UChicago Argonne, LLC AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL UChicago
+Argonne, LLC OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+***/
+
+
+#ifndef __ROW_SHARDS__
+#define __ROW_SHARDS__
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+#include "core/defines.h"
+
+/**
+ * @brief The Row_Shards class : Splits the rows of a dataset into contiguous ranges and fits each range in its own
+ *        forked process. A child writes its results to a pipe that the parent reads back in shard order, so the
+ *        merge does not depend on which process finished first. Only available where fork() is, supported() is
+ *        false elsewhere and callers fit in process.
+ */
+class DLL_EXPORT Row_Shards
+{
+public:
+
+    Row_Shards(size_t rows, size_t num_shards);
+
+    /// closes any open pipes and reaps children that were not waited on
+    ~Row_Shards();
+
+    static bool supported();
+
+    size_t size() const { return _num_shards; }
+
+    size_t row_start(size_t shard) const { return (_rows * shard) / _num_shards; }
+
+    size_t row_end(size_t shard) const { return (_rows * (shard + 1)) / _num_shards; }
+
+    /// fork one child per shard, each calls shard_func(shard) and exits with 0 if it returned true
+    bool start(const std::function<bool(size_t)>& shard_func);
+
+    /// child side, append to this process's pipe
+    bool write(const void* data, size_t len);
+
+    /// parent side, blocking read from a shard's pipe
+    bool read(size_t shard, void* data, size_t len);
+
+    /// close the pipes and wait for every child, true if all of them exited with 0
+    bool finish();
+
+private:
+
+    size_t _rows;
+
+    size_t _num_shards;
+
+    std::vector<int> _pids;
+
+    std::vector<int> _read_fds;
+
+    int _write_fd;
+};
+
+#endif
@@ -48,6 +48,11 @@ POSSIBILITY OF SUCH DAMAGE.
 
 
 #include "analysis_job.h"
+#include "fitting/routines/param_optimized_fit_routine.h"
+#include "fitting/routines/nnls_fit_routine.h"
+#include "core/cpu_budget.h"
+#include <algorithm>
+#include <chrono>
 
 namespace data_struct
 {
@@ -62,8 +67,15 @@ Analysis_Job<T_real>::Analysis_Job()
     _last_init_sample_size = 0;
 	_first_init = true;
     num_threads = std::thread::hardware_concurrency();
+    numa_pin_threads = false;
+    pixels_per_task = 0;
+    row_shards = 0;
+    _fit_routine_init_seconds = 0.0;
     //default mode for which parameters to fit when optimizing fit parameters
     optimize_fit_params_preset = fitting::models::Fit_Params_Preset::BATCH_FIT_NO_TAILS;
+    optimize_num_starts = 1;
+    optimize_roi_workers = 0;
+    optimize_dataset_workers = 0;
     quick_and_dirty = false;
     generate_average_h5 = false;
     add_v9_layout = false;
@@ -74,6 +86,13 @@ Analysis_Job<T_real>::Analysis_Job()
     export_int_fitted_to_csv = false;
     add_background = false;
     use_weights = true;
+    warm_start_fits = false;
+    mixed_precision = false;
+    low_rank_max_rank = 0;
+    low_rank_variance = 1.0;
+    use_fit_routine_cache = true;
+    fit_routine_cache_dir = "";
+    series = false;
     command_line = "";
     theta_pv = "";
     network_source_ip = "";
@@ -135,26 +154,225 @@ void Analysis_Job<T_real>::init_fit_routines(size_t spectra_samples,  bool force
     {
 		_first_init = false;
         _last_init_sample_size = spectra_samples;
+        prepare_fit_routine_init();
+
+        std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now();
+
+        //every detector / routine pair is independent, only the map lookups that may insert are done here.
+        //With the cache on, the first matrix routine of each detector goes first so the others hit its element models.
+        std::vector<Fit_Routine_Init> first_pass;
+        std::vector<Fit_Routine_Init> second_pass;
         for(size_t detector_num : detector_num_arr)
         {
             Detector<T_real>* detector = &detectors_meta_data[detector_num];
-
-            if(detector != nullptr)
+            bool have_matrix = false;
+            for(auto &proc_type : fitting_routines)
             {
-                Range energy_range = get_energy_range(spectra_samples, &(detector->fit_params_override_dict.fit_params));
-
-                for(auto &proc_type : fitting_routines)
+                Fit_Routine_Init init;
+                init.detector_num = detector_num;
+                init.proc_type = proc_type;
+                init.fit_routine = detector->fit_routines[proc_type];
+                bool is_matrix = (proc_type == Fitting_Routines::GAUSS_MATRIX || proc_type == Fitting_Routines::NNLS || proc_type == Fitting_Routines::SVD);
+                if (use_fit_routine_cache && is_matrix && false == have_matrix)
                 {
-                    //Fitting models
-                    fitting::routines::Base_Fit_Routine<T_real>* fit_routine = detector->fit_routines[proc_type];
-                    //logI << "Updating fit routine "<< fit_routine->get_name() <<" detector "<<detector_num<<"\n";
-
-                    Fit_Element_Map_Dict<T_real>* elements_to_fit = &(detector->fit_params_override_dict.elements_to_fit);
-                    //Initialize model
-                    fit_routine->initialize(detector->model, elements_to_fit, energy_range);
+                    have_matrix = true;
+                    first_pass.push_back(init);
+                }
+                else
+                {
+                    second_pass.push_back(init);
                 }
             }
         }
+        _init_fit_routines(first_pass, spectra_samples);
+        _init_fit_routines(second_pass, spectra_samples);
+
+        std::chrono::duration<double> elapsed_seconds = std::chrono::system_clock::now() - start;
+        _fit_routine_init_seconds += elapsed_seconds.count();
+        logI << "Fit routine setup (" << first_pass.size() + second_pass.size() << " routines) elapsed time: " << elapsed_seconds.count() << "s\n";
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+template<typename T_real>
+void Analysis_Job<T_real>::init_series_fit_routines(size_t detector_num, size_t spectra_samples, T_real incident_energy)
+{
+    if (detectors_meta_data.count(detector_num) == 0)
+    {
+        return;
+    }
+    Detector<T_real>* detector = &detectors_meta_data.at(detector_num);
+    Fit_Parameters<T_real>* override_fit_params = &(detector->fit_params_override_dict.fit_params);
+    std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now();
+    bool full_init = (_series_state.count(detector_num) == 0 || _series_state.at(detector_num).spectra_samples != spectra_samples);
+    if (_series_state.count(detector_num) == 0)
+    {
+        Series_State state;
+        state.base_energy = override_fit_params->contains(STR_COHERENT_SCT_ENERGY) ? override_fit_params->value(STR_COHERENT_SCT_ENERGY) : 0;
+        state.incident_energy = state.base_energy;
+        _series_state[detector_num] = state;
+    }
+    Series_State& state = _series_state.at(detector_num);
+    if (incident_energy <= 0 || state.base_energy <= 0)
+    {
+        incident_energy = state.base_energy;
+    }
+
+    T_real old_energy = state.incident_energy;
+    bool energy_changed = (incident_energy != old_energy);
+    if (energy_changed)
+    {
+        //move the allowed range with the energy so the optimizer bounds stay the same relative to it
+        Fit_Param<T_real>& fit_param = (*override_fit_params)[STR_COHERENT_SCT_ENERGY];
+        T_real delta = incident_energy - fit_param.value;
+        fit_param.value = incident_energy;
+        fit_param.min_val += delta;
+        fit_param.max_val += delta;
+        detector->model->update_fit_params_values(override_fit_params);
+        detector->update_from_fit_paramseters();
+        state.incident_energy = incident_energy;
+    }
+    state.spectra_samples = spectra_samples;
+
+    if (full_init)
+    {
+        prepare_fit_routine_init();
+        std::vector<Fit_Routine_Init> inits;
+        for (auto& proc_type : fitting_routines)
+        {
+            Fit_Routine_Init init;
+            init.detector_num = detector_num;
+            init.proc_type = proc_type;
+            init.fit_routine = detector->fit_routines[proc_type];
+            inits.push_back(init);
+        }
+        _init_fit_routines(inits, spectra_samples);
+    }
+    else
+    {
+        const Fit_Element_Map_Dict<T_real>* elements_to_fit = &(detector->fit_params_override_dict.elements_to_fit);
+        size_t regenerated = 0;
+        size_t num_models = 0;
+        for (auto& proc_type : fitting_routines)
+        {
+            if (proc_type != Fitting_Routines::GAUSS_MATRIX && proc_type != Fitting_Routines::NNLS && proc_type != Fitting_Routines::SVD)
+            {
+                continue;
+            }
+            fitting::routines::Matrix_Optimized_Fit_Routine<T_real>* fit_routine = (fitting::routines::Matrix_Optimized_Fit_Routine<T_real>*)detector->fit_routines[proc_type];
+            if (fit_routine == nullptr)
+            {
+                continue;
+            }
+            if (energy_changed)
+            {
+                regenerated += fit_routine->update_incident_energy(detector->model, elements_to_fit, old_energy);
+                num_models += fit_routine->element_models().size();
+            }
+            else
+            {
+                fit_routine->reset_integrated_spectra();
+            }
+        }
+        if (energy_changed)
+        {
+            logI << "Series detector " << detector_num << " incident energy " << old_energy << " -> " << state.incident_energy << " keV, regenerated " << regenerated << " of " << num_models << " element models\n";
+        }
+    }
+
+    std::chrono::duration<double> elapsed_seconds = std::chrono::system_clock::now() - start;
+    _fit_routine_init_seconds += elapsed_seconds.count();
+}
+
+//-----------------------------------------------------------------------------
+
+template<typename T_real>
+void Analysis_Job<T_real>::prepare_fit_routine_init()
+{
+    _lmfit_optimizer.set_mixed_precision(mixed_precision);
+    _fit_routine_cache.set_directory(fit_routine_cache_dir);
+}
+
+//-----------------------------------------------------------------------------
+
+template<typename T_real>
+void Analysis_Job<T_real>::_init_fit_routines(const std::vector<Fit_Routine_Init>& inits, size_t spectra_samples)
+{
+    int num_inits = (int)inits.size();
+#pragma omp parallel for schedule(dynamic, 1) num_threads(std::max(1, std::min(num_inits, Cpu_Budget::inst()->omp_threads())))
+    for (int i = 0; i < num_inits; i++)
+    {
+        init_fit_routine(inits[i].detector_num, inits[i].proc_type, inits[i].fit_routine, spectra_samples);
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+template<typename T_real>
+void Analysis_Job<T_real>::init_fit_routine(size_t detector_num, Fitting_Routines proc_type, fitting::routines::Base_Fit_Routine<T_real>* fit_routine, size_t spectra_samples)
+{
+    if (fit_routine == nullptr || detectors_meta_data.count(detector_num) == 0)
+    {
+        return;
+    }
+    Detector<T_real>* detector = &detectors_meta_data.at(detector_num);
+
+    Range energy_range = get_energy_range(spectra_samples, &(detector->fit_params_override_dict.fit_params));
+    Fit_Element_Map_Dict<T_real>* elements_to_fit = &(detector->fit_params_override_dict.elements_to_fit);
+    apply_fit_routine_options(proc_type, fit_routine);
+    //Initialize model
+    if (use_fit_routine_cache && (proc_type == Fitting_Routines::GAUSS_MATRIX || proc_type == Fitting_Routines::NNLS || proc_type == Fitting_Routines::SVD))
+    {
+        _init_matrix_fit_routine((fitting::routines::Matrix_Optimized_Fit_Routine<T_real>*)fit_routine, detector->model, elements_to_fit, energy_range, detector_num);
+    }
+    else
+    {
+        fit_routine->initialize(detector->model, elements_to_fit, energy_range);
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+template<typename T_real>
+void Analysis_Job<T_real>::apply_fit_routine_options(Fitting_Routines proc_type, fitting::routines::Base_Fit_Routine<T_real>* fit_routine) const
+{
+    if (proc_type == Fitting_Routines::NNLS)
+    {
+        ((fitting::routines::NNLS_Fit_Routine<T_real>*)fit_routine)->set_mixed_precision(mixed_precision);
+    }
+    if (proc_type == Fitting_Routines::NNLS || proc_type == Fitting_Routines::SVD)
+    {
+        ((fitting::routines::Matrix_Optimized_Fit_Routine<T_real>*)fit_routine)->set_low_rank(low_rank_max_rank, low_rank_variance);
+    }
+    if (proc_type == Fitting_Routines::GAUSS_TAILS)
+    {
+        ((fitting::routines::Param_Optimized_Fit_Routine<T_real>*)fit_routine)->set_warm_start(warm_start_fits);
+    }
+    fit_routine->set_pixels_per_task(pixels_per_task);
+}
+
+//-----------------------------------------------------------------------------
+
+template<typename T_real>
+void Analysis_Job<T_real>::_init_matrix_fit_routine(fitting::routines::Matrix_Optimized_Fit_Routine<T_real>* fit_routine,
+                                                    fitting::models::Base_Model<T_real>* model,
+                                                    const Fit_Element_Map_Dict<T_real>* elements_to_fit,
+                                                    Range energy_range,
+                                                    size_t detector_num)
+{
+    std::string key = fitting::routines::Fit_Routine_Cache<T_real>::gen_key(model, elements_to_fit, energy_range);
+    typename fitting::routines::Fit_Routine_Cache<T_real>::Element_Models element_models;
+    if (_fit_routine_cache.find(key, element_models))
+    {
+        logI << "Fit routine cache hit: " << fit_routine->get_name() << " detector " << detector_num << "\n";
+        fit_routine->initialize_with_element_models(elements_to_fit, energy_range, element_models);
+    }
+    else
+    {
+        logI << "Fit routine cache miss: " << fit_routine->get_name() << " detector " << detector_num << "\n";
+        fit_routine->initialize(model, elements_to_fit, energy_range);
+        _fit_routine_cache.insert(key, fit_routine->element_models());
     }
 }
 
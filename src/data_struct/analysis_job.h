@@ -54,6 +54,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "data_struct/detector.h"
 #include "data_struct/element_info.h"
 #include "fitting/routines/base_fit_routine.h"
+#include "fitting/routines/matrix_optimized_fit_routine.h"
+#include "fitting/routines/fit_routine_cache.h"
 #include <vector>
 #include <string>
 #include <thread>
@@ -91,6 +93,28 @@ public:
 
     void init_fit_routines(size_t spectra_samples, bool force=false);
 
+    //apply the job options shared by all routines (optimizer precision, cache directory), call once before init_fit_routine
+    void prepare_fit_routine_init();
+
+    /**
+     * @brief init_fit_routine : Set up and initialize one routine for a detector the same way init_fit_routines does,
+     *                           used for routines owned by the caller. Safe to call from several threads for different routines.
+     */
+    void init_fit_routine(size_t detector_num, Fitting_Routines proc_type, fitting::routines::Base_Fit_Routine<T_real>* fit_routine, size_t spectra_samples);
+
+    //set the job options of a routine (mixed precision, low rank, warm start, pixels per task), call before initialize
+    void apply_fit_routine_options(Fitting_Routines proc_type, fitting::routines::Base_Fit_Routine<T_real>* fit_routine) const;
+
+    /**
+     * @brief init_series_fit_routines : init_fit_routines for one detector of a series of datasets. Routines are only rebuilt when the
+     *                                   spectra length changed; a new incident_energy (keV, <= 0 = override file value) only updates
+     *                                   the energy dependent element models.
+     */
+    void init_series_fit_routines(size_t detector_num, size_t spectra_samples, T_real incident_energy);
+
+    //total time spent in init_fit_routines, for the run summary
+    double fit_routine_init_seconds() const { return _fit_routine_init_seconds; }
+
     std::string command_line;
 
     std::string dataset_directory;
@@ -117,12 +141,33 @@ public:
 
     fitting::models::Fit_Params_Preset optimize_fit_params_preset;
 
+    //number of starting points per preset when optimizing fit parameters, > 1 perturbs the free peak shape params
+    size_t optimize_num_starts;
+
+    //extra presets optimized next to optimize_fit_params_preset, best residual wins
+    std::vector<fitting::models::Fit_Params_Preset> optimize_multi_start_presets;
+
+    //number of roi optimizations run at the same time, 0 = num_threads
+    size_t optimize_roi_workers;
+
+    //number of dataset/detector optimizations run at the same time by generate_optimal_params, 0 = num_threads
+    size_t optimize_dataset_workers;
+
 	std::string update_theta_str;
 
 	std::vector<size_t> detector_num_arr;
 
     size_t num_threads;
 
+    //pixels fitted per thread pool task, 0 = measure each routine and pick
+    size_t pixels_per_task;
+
+    //pin pool workers to the cpus of each numa node and keep rows on the node that fits them
+    bool numa_pin_threads;
+
+    //fit each dataset in this many forked processes, each with a contiguous block of rows. 0 or 1 = one process
+    size_t row_shards;
+
     //bool update_scalers;
 
     bool quick_and_dirty;
@@ -145,6 +190,33 @@ public:
 
     bool use_weights;
 
+    //seed per pixel gauss tails fits from the neighbouring pixel
+    bool warm_start_fits;
+
+    //float model evaluation with double precision optimizer / nnls solve (only used for float jobs)
+    bool mixed_precision;
+
+    //nnls / svd fit a low rank factorization of the volume instead of every pixel, 0 = per pixel fits
+    size_t low_rank_max_rank;
+
+    //fraction of the volume energy the low rank basis has to keep
+    T_real low_rank_variance;
+
+    //fit and save spatially binned preview maps with these bin sizes before the full resolution fit
+    std::vector<size_t> preview_bin_sizes;
+
+    //reuse element models of the matrix fit routines when the detector parameters did not change
+    bool use_fit_routine_cache;
+
+    //also keep them in this directory for later runs, empty = memory only
+    std::string fit_routine_cache_dir;
+
+    //treat dataset_files as a series of scans with the same detector and elements, reuse fit routines between them
+    bool series;
+
+    //incident energy (keV) of series datasets that differ from the override file, by dataset file name
+    std::map<std::string, T_real> series_energies;
+
 	std::string update_us_amps_str;
 
 	std::string update_ds_amps_str;
@@ -160,6 +232,21 @@ public:
 
 protected:
 
+    struct Fit_Routine_Init
+    {
+        size_t detector_num;
+        Fitting_Routines proc_type;
+        fitting::routines::Base_Fit_Routine<T_real>* fit_routine;
+    };
+
+    void _init_fit_routines(const std::vector<Fit_Routine_Init>& inits, size_t spectra_samples);
+
+    void _init_matrix_fit_routine(fitting::routines::Matrix_Optimized_Fit_Routine<T_real>* fit_routine,
+                                  fitting::models::Base_Model<T_real>* model,
+                                  const Fit_Element_Map_Dict<T_real>* elements_to_fit,
+                                  Range energy_range,
+                                  size_t detector_num);
+
     //Optimizers for fitting models
     fitting::optimizers::LMFit_Optimizer<T_real> _lmfit_optimizer;
     fitting::optimizers::MPFit_Optimizer<T_real> _mpfit_optimizer;
@@ -167,6 +254,19 @@ protected:
 
     size_t _last_init_sample_size;
 
+    fitting::routines::Fit_Routine_Cache<T_real> _fit_routine_cache;
+
+    double _fit_routine_init_seconds;
+
+    struct Series_State
+    {
+        size_t spectra_samples;
+        T_real incident_energy;
+        T_real base_energy;
+    };
+
+    //last init per detector for init_series_fit_routines
+    std::map<size_t, Series_State> _series_state;
     
 
 private:
@@ -210,7 +210,7 @@ public:
 
     void divide_fit_values_by(T_real divisor);
 
-    bool contains(std::string name) const { return ( _params.find(name) != _params.end()); }
+    bool contains(const std::string& name) const { return ( _params.find(name) != _params.end()); }
 
     std::vector<T_real> to_array();
 
@@ -236,13 +236,13 @@ public:
 
     void remove(std::string key);
 
-    inline const T_real& value(std::string key) const { return _params.at(key).value; }
+    inline const T_real& value(const std::string& key) const { return _params.at(key).value; }
 
     void print();
 
     void print_non_fixed();
 
-    const Fit_Param<T_real>& at(std::string name) const {return _params.at(name); }
+    const Fit_Param<T_real>& at(const std::string& name) const {return _params.at(name); }
 
     size_t size() const { return _params.size(); }
 
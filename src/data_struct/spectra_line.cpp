@@ -129,6 +129,15 @@ void Spectra_Line<T_real>::recalc_elapsed_livetime()
     }
 }
 
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+void Spectra_Line<T_real>::rehome()
+{
+    std::vector<Spectra<T_real> > line(_data_line.begin(), _data_line.end());
+    _data_line.swap(line);
+}
+
 // ----------------------------------------------------------------------------
 // ----------------------------------------------------------------------------
 
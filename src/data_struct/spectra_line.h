@@ -77,6 +77,11 @@ public:
 
     void recalc_elapsed_livetime();
 
+    // reallocate every spectra from the calling thread so first touch puts the pages on its numa node
+    void rehome();
+
+    void swap(Spectra_Line<T_real>& other) { _data_line.swap(other._data_line); }
+
     auto size() const { return _data_line.size(); }
 
 private:
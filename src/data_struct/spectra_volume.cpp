@@ -48,10 +48,16 @@ POSSIBILITY OF SUCH DAMAGE.
 
 
 #include "spectra_volume.h"
+#include "core/cpu_budget.h"
+#include <array>
+#include <algorithm>
 
 namespace data_struct
 {
 
+//rows summed together by _reduce_rows before the partial sums are added
+static const size_t REDUCE_ROW_BLOCK = 8;
+
 // ----------------------------------------------------------------------------
 
 template<typename T_real>
@@ -84,39 +90,189 @@ void Spectra_Volume<T_real>::resize_and_zero(size_t rows, size_t cols, size_t sa
 
 // ----------------------------------------------------------------------------
 
+/**
+ * @brief add_max_channels : add the pixel's max channel value to row_max and its 10 largest channel values to row_max_10
+ */
 template<typename T_real>
-Spectra<T_real> Spectra_Volume<T_real>::integrate()
+static void add_max_channels(const Spectra<T_real>& spectra, ArrayTr<T_real>& max_vals, ArrayTr<T_real>& row_max, ArrayTr<T_real>& row_max_10)
 {
+    typename ArrayTr<T_real>::Index idx;
+    max_vals = spectra;
+    for (int k = 0; k < 10; k++)
+    {
+        T_real max_val = max_vals.maxCoeff(&idx);
+        if (k == 0)
+        {
+            row_max[idx] += max_val;
+        }
+        row_max_10[idx] += max_val;
+        max_vals[idx] = 0;
+    }
+}
+
+// ----------------------------------------------------------------------------
 
-    Spectra<T_real> i_spectra(_data_vol[0][0].size());
-    T_real elt = 0.0;
-    T_real ert = 0.0;
-    T_real in_cnt = 0.0;
-    T_real out_cnt = 0.0;
-    for(size_t i = 0; i < _data_vol.size(); i++)
+template<typename T_real>
+void Spectra_Volume<T_real>::_reduce_rows(Spectra<T_real>* out_int_spectra, Spectra<T_real>* out_max_spectra, Spectra<T_real>* out_max_10_spectra) const
+{
+    const size_t rows = _data_vol.size();
+    const size_t cols = (rows > 0) ? _data_vol[0].size() : 0;
+    const size_t samples = (cols > 0) ? _data_vol[0][0].size() : 0;
+    const long num_blocks = static_cast<long>((rows + REDUCE_ROW_BLOCK - 1) / REDUCE_ROW_BLOCK);
+    const bool do_int = (out_int_spectra != nullptr);
+    const bool do_max = (out_max_spectra != nullptr && out_max_10_spectra != nullptr);
+
+    // each block of rows is summed on its own then the blocks are added in order, the block size is fixed
+    // so the result does not depend on the number of threads. Each pixel is read once while it is in cache.
+    std::vector<ArrayTr<T_real>> block_sums(do_int ? num_blocks : 0);
+    std::vector<std::array<T_real, 4>> block_totals(do_int ? num_blocks : 0);
+    std::vector<ArrayTr<T_real>> block_max(do_max ? num_blocks : 0);
+    std::vector<ArrayTr<T_real>> block_max_10(do_max ? num_blocks : 0);
+
+#pragma omp parallel for schedule(static) num_threads(Cpu_Budget::inst()->omp_threads())
+    for (long b = 0; b < num_blocks; b++)
     {
-        for(size_t j = 0; j < _data_vol[0].size(); j++)
+        const size_t first_row = static_cast<size_t>(b) * REDUCE_ROW_BLOCK;
+        const size_t last_row = std::min(rows, first_row + REDUCE_ROW_BLOCK);
+        ArrayTr<T_real> max_vals;
+        if (do_int)
+        {
+            block_sums[b].setZero(samples);
+            block_totals[b].fill(0.0);
+        }
+        if (do_max)
         {
-            i_spectra += _data_vol[i][j];
-            elt += _data_vol[i][j].elapsed_livetime();
-            ert += _data_vol[i][j].elapsed_realtime();
-            in_cnt += _data_vol[i][j].input_counts();
-            out_cnt += _data_vol[i][j].output_counts();
+            block_max[b].setZero(samples);
+            block_max_10[b].setZero(samples);
+            max_vals.resize(samples);
+        }
+        for (size_t i = first_row; i < last_row; i++)
+        {
+            for (size_t j = 0; j < cols; j++)
+            {
+                const Spectra<T_real>& spectra = _data_vol[i][j];
+                if (do_int)
+                {
+                    std::array<T_real, 4>& totals = block_totals[b];
+                    block_sums[b] += spectra;
+                    totals[0] += spectra.elapsed_livetime();
+                    totals[1] += spectra.elapsed_realtime();
+                    totals[2] += spectra.input_counts();
+                    totals[3] += spectra.output_counts();
+                }
+                if (do_max)
+                {
+                    add_max_channels(spectra, max_vals, block_max[b], block_max_10[b]);
+                }
+            }
         }
     }
 
-    i_spectra.elapsed_livetime(elt);
-    i_spectra.elapsed_realtime(ert);
-    i_spectra.input_counts(in_cnt);
-    i_spectra.output_counts(out_cnt);
+    if (do_int)
+    {
+        out_int_spectra->setZero(samples);
+        T_real elt = 0.0;
+        T_real ert = 0.0;
+        T_real in_cnt = 0.0;
+        T_real out_cnt = 0.0;
+        for (long b = 0; b < num_blocks; b++)
+        {
+            *out_int_spectra += block_sums[b];
+            elt += block_totals[b][0];
+            ert += block_totals[b][1];
+            in_cnt += block_totals[b][2];
+            out_cnt += block_totals[b][3];
+        }
+        out_int_spectra->elapsed_livetime(elt);
+        out_int_spectra->elapsed_realtime(ert);
+        out_int_spectra->input_counts(in_cnt);
+        out_int_spectra->output_counts(out_cnt);
+        out_int_spectra->recalc_elapsed_livetime();
+    }
+    if (do_max)
+    {
+        out_max_spectra->setZero(samples);
+        out_max_10_spectra->setZero(samples);
+        for (long b = 0; b < num_blocks; b++)
+        {
+            *out_max_spectra += block_max[b];
+            *out_max_10_spectra += block_max_10[b];
+        }
+    }
+}
 
-    i_spectra.recalc_elapsed_livetime();
+// ----------------------------------------------------------------------------
 
+template<typename T_real>
+Spectra<T_real> Spectra_Volume<T_real>::integrate()
+{
+    Spectra<T_real> i_spectra;
+    _reduce_rows(&i_spectra, nullptr, nullptr);
     return i_spectra;
 }
 
 // ----------------------------------------------------------------------------
 
+template<typename T_real>
+void Spectra_Volume<T_real>::generate_max_spectra(Spectra<T_real>& out_max_spectra, Spectra<T_real>& out_max_10_spectra) const
+{
+    _reduce_rows(nullptr, &out_max_spectra, &out_max_10_spectra);
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+void Spectra_Volume<T_real>::integrate_and_max_spectra(Spectra<T_real>& out_int_spectra, Spectra<T_real>& out_max_spectra, Spectra<T_real>& out_max_10_spectra) const
+{
+    _reduce_rows(&out_int_spectra, &out_max_spectra, &out_max_10_spectra);
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+void Spectra_Volume<T_real>::generate_binned(size_t factor, Spectra_Volume<T_real>& out_volume) const
+{
+    factor = std::max(factor, (size_t)1);
+    const size_t num_rows = rows();
+    const size_t num_cols = cols();
+    const size_t samples = samples_size();
+    const long out_rows = static_cast<long>((num_rows + factor - 1) / factor);
+    const size_t out_cols = (num_cols + factor - 1) / factor;
+
+    out_volume.resize_and_zero(out_rows, out_cols, samples);
+
+#pragma omp parallel for schedule(static) num_threads(Cpu_Budget::inst()->omp_threads())
+    for (long i = 0; i < out_rows; i++)
+    {
+        for (size_t j = 0; j < out_cols; j++)
+        {
+            Spectra<T_real>& out_spectra = out_volume[i][j];
+            T_real elt = 0.0;
+            T_real ert = 0.0;
+            T_real in_cnt = 0.0;
+            T_real out_cnt = 0.0;
+            for (size_t r = (size_t)i * factor; r < std::min(((size_t)i + 1) * factor, num_rows); r++)
+            {
+                for (size_t c = j * factor; c < std::min((j + 1) * factor, num_cols); c++)
+                {
+                    const Spectra<T_real>& spectra = _data_vol[r][c];
+                    out_spectra += spectra;
+                    elt += spectra.elapsed_livetime();
+                    ert += spectra.elapsed_realtime();
+                    in_cnt += spectra.input_counts();
+                    out_cnt += spectra.output_counts();
+                }
+            }
+            out_spectra.elapsed_livetime(elt);
+            out_spectra.elapsed_realtime(ert);
+            out_spectra.input_counts(in_cnt);
+            out_spectra.output_counts(out_cnt);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+
 template<typename T_real>
 void Spectra_Volume<T_real>::recalc_elapsed_livetime()
 {
@@ -130,6 +286,24 @@ void Spectra_Volume<T_real>::recalc_elapsed_livetime()
 
 // ----------------------------------------------------------------------------
 
+template<typename T_real>
+void Spectra_Volume<T_real>::keep_rows(size_t row_start, size_t row_end)
+{
+    row_end = std::min(row_end, _data_vol.size());
+    if (row_start >= row_end)
+    {
+        _data_vol.clear();
+        return;
+    }
+    for (size_t i = row_start; i < row_end; i++)
+    {
+        _data_vol[i - row_start].swap(_data_vol[i]);
+    }
+    _data_vol.resize(row_end - row_start);
+}
+
+// ----------------------------------------------------------------------------
+
 template<typename T_real>
 void Spectra_Volume<T_real>::generate_scaler_maps(std::vector<Scaler_Map<T_real>> *scaler_maps)
 {
@@ -185,7 +359,7 @@ Eigen::Tensor<T_real, 3> Spectra_Volume<T_real>::get_sv_tensor()
     {
         for (size_t j = 0; j < _data_vol[0].size(); j++)
         {
-            for (size_t k = 0; k < _data_vol[0][0].size(); k++)
+            for (size_t k = 0; k < samples_size(); k++)
             {
                 data(i, j, k) = _data_vol[i][j][k];
             }
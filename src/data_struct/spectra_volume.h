@@ -76,6 +76,26 @@ public:
 
     Spectra<T_real> integrate();
 
+    /**
+     * @brief generate_max_spectra : per channel sum of every pixel's max channel value, and of every pixel's 10 largest channel values
+     */
+    void generate_max_spectra(Spectra<T_real>& out_max_spectra, Spectra<T_real>& out_max_10_spectra) const;
+
+    /**
+     * @brief integrate_and_max_spectra : integrate() and generate_max_spectra() in one row parallel pass over the volume
+     */
+    void integrate_and_max_spectra(Spectra<T_real>& out_int_spectra, Spectra<T_real>& out_max_spectra, Spectra<T_real>& out_max_10_spectra) const;
+
+    /**
+     * @brief generate_binned : sum factor x factor blocks of pixels (partial blocks at the edges) into out_volume, live/real time and counts are summed too
+     */
+    void generate_binned(size_t factor, Spectra_Volume<T_real>& out_volume) const;
+
+    /**
+     * @brief keep_rows : drop every row outside [row_start, row_end), the kept rows are moved without copying spectra
+     */
+    void keep_rows(size_t row_start, size_t row_end);
+
     void generate_scaler_maps(std::vector<Scaler_Map<T_real>>* scaler_maps);
 
 	size_t cols() const { if (_data_vol.size() > 0) return _data_vol[0].size(); else return 0; }
@@ -92,6 +112,12 @@ public:
 
 private:
 
+    /**
+     * @brief _reduce_rows : integrated spectra (times and counts summed) and max channel spectra in one row block parallel pass,
+     *                       nullptr skips an output. Same result for any number of threads.
+     */
+    void _reduce_rows(Spectra<T_real>* out_int_spectra, Spectra<T_real>* out_max_spectra, Spectra<T_real>* out_max_10_spectra) const;
+
     std::vector<Spectra_Line<T_real> > _data_vol;
 
 };
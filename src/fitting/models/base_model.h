@@ -68,6 +68,33 @@ using namespace data_struct;
  */
 enum class Fit_Params_Preset { NOT_SET, MATRIX_BATCH_FIT, BATCH_FIT_NO_TAILS, BATCH_FIT_WITH_TAILS, BATCH_FIT_WITH_FREE_ENERGY, BATCH_FIT_NO_TAILS_E_QUAD};
 
+/**
+ * @brief The Model_Workspace struct : caller owned scratch buffers for model_spectrum_workspace.
+ *          Buffers are sized on first use and reused, one workspace per fitting thread.
+ */
+template<typename T_real>
+struct Model_Workspace
+{
+    ArrayTr<T_real> energy;
+    ArrayTr<T_real> ev;
+    std::vector<const Fit_Element_Map<T_real>*> elements;
+    std::vector<ArrayTr<T_real>> element_spectra;
+    // one per omp thread
+    std::vector<ArrayTr<T_real>> delta_energy;
+    std::vector<ArrayTr<T_real>> peak_spectra;
+
+    // Mixed precision: the energy axis, the exp and erfc arguments and all sums are double, only the
+    // exp and erfc run in T_real. Energy calibration comes from the double values below, the model is in spectra_dp.
+    bool double_accumulation = false;
+    double energy_offset = 0.0;
+    double energy_slope = 0.0;
+    double energy_quad = 0.0;
+    ArrayTr<double> ev_dp;
+    std::vector<ArrayTr<double>> element_spectra_dp;
+    std::vector<ArrayTr<double>> delta_energy_dp;
+    ArrayTr<double> spectra_dp;
+};
+
 /**
  * @brief The Base_Model class: base class for modeling spectra and fitting elements
  */
@@ -111,6 +138,18 @@ public:
                                          const Fit_Element_Map_Dict<T_real> * const elements_to_fit,
                                          const struct Range energy_range) = 0;
 
+    /**
+     * @brief model_spectrum_workspace : Same as model_spectrum_mp but writes into out_spectra using scratch buffers from workspace.
+     */
+    virtual void model_spectrum_workspace(const Fit_Parameters<T_real> * const fit_params,
+                                          const Fit_Element_Map_Dict<T_real> * const elements_to_fit,
+                                          const struct Range energy_range,
+                                          Model_Workspace<T_real>& /*workspace*/,
+                                          Spectra<T_real>& out_spectra)
+    {
+        out_spectra = model_spectrum_mp(fit_params, elements_to_fit, energy_range);
+    }
+
     virtual const Spectra<T_real> model_spectrum_element(const Fit_Parameters<T_real> * const fitp,
                                                  const Fit_Element_Map<T_real> * const element_to_fit,
                                                  const ArrayTr<T_real>  &ev,
@@ -48,6 +48,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 
 #include "gaussian_model.h"
+#include "core/cpu_budget.h"
 
 #include <iostream>
 #include <algorithm>
@@ -532,7 +533,7 @@ const Spectra<T_real> Gaussian_Model<T_real>::model_spectrum_mp(const Fit_Parame
             keys.push_back(itr.first);
         }
     }
-#pragma omp parallel for
+#pragma omp parallel for num_threads(Cpu_Budget::inst()->omp_threads())
     for (int i=0; i < (int)keys.size(); i++)
     {
         Spectra<T_real> tmp = model_spectrum_element(fit_params, elements_to_fit->at(keys[i]), ev, nullptr);
@@ -553,6 +554,357 @@ const Spectra<T_real> Gaussian_Model<T_real>::model_spectrum_mp(const Fit_Parame
 
 // ----------------------------------------------------------------------------
 
+template<typename T_real>
+void Gaussian_Model<T_real>::model_spectrum_workspace(const Fit_Parameters<T_real> * const fit_params,
+                                                      const std::unordered_map<std::string, Fit_Element_Map<T_real>*> * const elements_to_fit,
+                                                      const struct Range energy_range,
+                                                      Model_Workspace<T_real>& workspace,
+                                                      Spectra<T_real>& out_spectra)
+{
+    const Eigen::Index num_channels = (Eigen::Index)energy_range.count();
+    int num_threads = 1;
+#ifdef _OPENMP
+    num_threads = omp_get_max_threads();
+#endif
+
+    // Eigen only reallocates when the size changes, so after the first call these are in place
+    workspace.energy = ArrayTr<T_real>::LinSpaced(num_channels, energy_range.min, energy_range.max);
+
+    workspace.elements.clear();
+    for (const auto& itr : (*elements_to_fit))
+    {
+        if (itr.first != STR_COHERENT_SCT_AMPLITUDE && itr.first != STR_COMPTON_AMPLITUDE)
+        {
+            workspace.elements.push_back(itr.second);
+        }
+    }
+    if ((int)workspace.peak_spectra.size() < num_threads)
+    {
+        workspace.peak_spectra.resize(num_threads);
+    }
+    for (int t = 0; t < num_threads; t++)
+    {
+        workspace.peak_spectra[t].resize(num_channels);
+    }
+
+    if (workspace.double_accumulation)
+    {
+        workspace.ev_dp = workspace.energy.template cast<double>();
+        workspace.ev_dp = workspace.energy_offset + (workspace.ev_dp * workspace.energy_slope) + (workspace.ev_dp.square() * workspace.energy_quad);
+        _model_spectrum_workspace<double>(fit_params, workspace, workspace.ev_dp, workspace.delta_energy_dp, workspace.element_spectra_dp, workspace.spectra_dp);
+        out_spectra.resize(num_channels);
+        out_spectra.head(num_channels) = workspace.spectra_dp.template cast<T_real>();
+    }
+    else
+    {
+        T_real energy_offset = fit_params->value(STR_ENERGY_OFFSET);
+        T_real energy_slope = fit_params->value(STR_ENERGY_SLOPE);
+        T_real energy_quad = fit_params->value(STR_ENERGY_QUADRATIC);
+        workspace.ev = energy_offset + (workspace.energy * energy_slope) + (pow(workspace.energy, (T_real)2.0) * energy_quad);
+        _model_spectrum_workspace<T_real>(fit_params, workspace, workspace.ev, workspace.delta_energy, workspace.element_spectra, out_spectra);
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+template<typename T_acc>
+void Gaussian_Model<T_real>::_model_spectrum_workspace(const Fit_Parameters<T_real> * const fit_params,
+                                                       Model_Workspace<T_real>& workspace,
+                                                       const ArrayTr<T_acc>& ev,
+                                                       std::vector<ArrayTr<T_acc>>& delta_energies,
+                                                       std::vector<ArrayTr<T_acc>>& element_spectra,
+                                                       ArrayTr<T_acc>& out_spectra) const
+{
+    const Eigen::Index num_channels = ev.size();
+    const int num_threads = (int)workspace.peak_spectra.size();
+
+    if (element_spectra.size() < workspace.elements.size())
+    {
+        element_spectra.resize(workspace.elements.size());
+    }
+    if ((int)delta_energies.size() < num_threads)
+    {
+        delta_energies.resize(num_threads);
+    }
+    for (int t = 0; t < num_threads; t++)
+    {
+        delta_energies[t].resize(num_channels);
+    }
+
+    // the OpenMP runtime allocates a team for every region, even a one thread one, so serial fits skip it
+    const int omp_threads = Cpu_Budget::inst()->omp_threads();
+    if (omp_threads < 2)
+    {
+        for (size_t i = 0; i < workspace.elements.size(); i++)
+        {
+            element_spectra[i].resize(num_channels);
+            _model_spectrum_element_workspace<T_acc>(fit_params, workspace.elements[i], ev, delta_energies[0], workspace.peak_spectra[0], element_spectra[i]);
+        }
+    }
+    else
+    {
+#pragma omp parallel for num_threads(omp_threads)
+        for (int i = 0; i < (int)workspace.elements.size(); i++)
+        {
+            int t = 0;
+#ifdef _OPENMP
+            t = omp_get_thread_num();
+#endif
+            element_spectra[i].resize(num_channels);
+            _model_spectrum_element_workspace<T_acc>(fit_params, workspace.elements[i], ev, delta_energies[t], workspace.peak_spectra[t], element_spectra[i]);
+        }
+    }
+
+    out_spectra.resize(num_channels);
+    out_spectra.setZero();
+    // sum in map order so the result does not depend on thread scheduling
+    for (size_t i = 0; i < workspace.elements.size(); i++)
+    {
+        out_spectra += element_spectra[i];
+    }
+
+    ArrayTr<T_acc>& delta_energy = delta_energies[0];
+    ArrayTr<T_real>& counts = workspace.peak_spectra[0];
+    const T_real gain = fit_params->value(STR_ENERGY_SLOPE);
+    const T_real fwhm_offset = fit_params->value(STR_FWHM_OFFSET);
+    const T_real fwhm_fanoprime = fit_params->value(STR_FWHM_FANOPRIME);
+    const T_real coherent_energy = fit_params->value(STR_COHERENT_SCT_ENERGY);
+
+    // elastic peak, gaussian
+    T_real sigma = std::sqrt( std::pow( (fwhm_offset / (T_real)2.3548), (T_real)2.0 ) + coherent_energy * (T_real)2.96 * fwhm_fanoprime );
+    if (false == std::isfinite(sigma))
+    {
+        counts.setConstant(std::numeric_limits<T_real>::quiet_NaN());
+    }
+    else
+    {
+        delta_energy = ev - (T_acc)coherent_energy;
+        T_real fvalue = (T_real)1.0;
+        fvalue = fvalue * std::pow((T_real)10.0, fit_params->value(STR_COHERENT_SCT_AMPLITUDE));
+        counts = fvalue * (gain / (sigma * (T_real)(SQRT_2xPI)) * Eigen::exp(((T_acc)-0.5 * Eigen::pow((delta_energy / (T_acc)sigma), (T_acc)2.0)).template cast<T_real>()));
+    }
+    out_spectra += counts.template cast<T_acc>();
+
+    // compton peak, same terms as compton_peak()
+    T_real compton_E = coherent_energy / ((T_real)1.0 + (coherent_energy / (T_real)511.0) * ((T_real)1.0 - std::cos(fit_params->value(STR_COMPTON_ANGLE) * (T_real)2.0 * (T_real)(M_PI) / (T_real)360.0)));
+    sigma = std::sqrt( std::pow( (fwhm_offset / (T_real)2.3548), (T_real)62.0) + compton_E * (T_real)2.96 * fwhm_fanoprime );
+    if (false == std::isfinite(sigma))
+    {
+        counts.setConstant(std::numeric_limits<T_real>::quiet_NaN());
+    }
+    else
+    {
+        const T_real compton_f_step = fit_params->value(STR_COMPTON_F_STEP);
+        const T_real compton_f_tail = fit_params->value(STR_COMPTON_F_TAIL);
+        const T_real compton_hi_f_tail = fit_params->value(STR_COMPTON_HI_F_TAIL);
+        const T_real compton_sigma = sigma * fit_params->value(STR_COMPTON_FWHM_CORR);
+
+        delta_energy = ev - (T_acc)compton_E;
+
+        T_real faktor = (T_real)1.0 / ((T_real)1.0 + compton_f_step + compton_f_tail + compton_hi_f_tail);
+        faktor = faktor * std::pow((T_real)10.0, fit_params->value(STR_COMPTON_AMPLITUDE));
+
+        counts = faktor * (gain / (compton_sigma * (T_real)(SQRT_2xPI)) * Eigen::exp(((T_acc)-0.5 * Eigen::pow((delta_energy / (T_acc)compton_sigma), (T_acc)2.0)).template cast<T_real>()));
+
+        if (compton_f_step > 0.0)
+        {
+            T_real fvalue = faktor * compton_f_step;
+            T_real scale = gain / (T_real)2.0 / compton_E;
+            for (Eigen::Index i = 0; i < num_channels; i++)
+            {
+                counts[i] += fvalue * (scale * std::erfc((T_real)(delta_energy[i] / ((T_acc)(M_SQRT2) * sigma))));
+            }
+        }
+
+        T_real gamma = fit_params->value(STR_COMPTON_GAMMA);
+        T_real fvalue = faktor * compton_f_tail;
+        T_real scale = gain / (T_real)2.0 / gamma / sigma / exp((T_real)-0.5 / pow(gamma, (T_real)2.0));
+        for (Eigen::Index i = 0; i < num_channels; i++)
+        {
+            T_acc v = delta_energy[i];
+            T_real t = (v < (T_acc)0.0) ? std::exp((T_real)(v / (gamma * sigma))) * std::erfc((T_real)(v / ((T_acc)(M_SQRT2)*sigma) + ((T_acc)1.0 / (gamma * (T_acc)(M_SQRT2))))) : std::erfc((T_real)(v / ((T_acc)(M_SQRT2)*sigma) + ((T_acc)1.0 / (gamma * (T_acc)(M_SQRT2)))));
+            counts[i] += fvalue * (scale * t);
+        }
+
+        // tail on the high side
+        gamma = fit_params->value(STR_COMPTON_HI_GAMMA);
+        fvalue = faktor * compton_hi_f_tail;
+        scale = gain / (T_real)2.0 / gamma / sigma / exp((T_real)-0.5 / pow(gamma, (T_real)2.0));
+        for (Eigen::Index i = 0; i < num_channels; i++)
+        {
+            T_acc v = -delta_energy[i];
+            T_real t = (v < (T_acc)0.0) ? std::exp((T_real)(v / (gamma * sigma))) * std::erfc((T_real)(v / ((T_acc)(M_SQRT2)*sigma) + ((T_acc)1.0 / (gamma * (T_acc)(M_SQRT2))))) : std::erfc((T_real)(v / ((T_acc)(M_SQRT2)*sigma) + ((T_acc)1.0 / (gamma * (T_acc)(M_SQRT2)))));
+            counts[i] += fvalue * (scale * t);
+        }
+    }
+    out_spectra += counts.template cast<T_acc>();
+
+    T_real escape_factor = fit_params->value(STR_SI_ESCAPE);
+    if (escape_factor > 0.0)
+    {
+        // Si = 1.73998, delta_energy is free again and holds the escape counts
+        int bins = 1.73998 / (ev(1) - ev(0));
+        delta_energy.setZero();
+        for (int i = 0; i < num_channels - bins; ++i)
+        {
+            delta_energy(i) = out_spectra(i + bins) * escape_factor;
+        }
+        out_spectra += delta_energy;
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+template<typename T_acc>
+void Gaussian_Model<T_real>::_model_spectrum_element_workspace(const Fit_Parameters<T_real> * const fitp,
+                                                               const Fit_Element_Map<T_real>* const element_to_fit,
+                                                               const ArrayTr<T_acc>& ev,
+                                                               ArrayTr<T_acc>& delta_energy,
+                                                               ArrayTr<T_real>& peak_spectra,
+                                                               ArrayTr<T_acc>& out_spectra) const
+{
+    out_spectra.setZero();
+
+    if (false == fitp->contains(element_to_fit->full_name()))
+    {
+        return;
+    }
+
+    T_real pre_faktor = std::pow((T_real)10.0, fitp->value(element_to_fit->full_name()));
+
+    if (false == std::isfinite(pre_faktor))
+    {
+        out_spectra.setConstant(std::numeric_limits<T_acc>::quiet_NaN());
+        return;
+    }
+
+    const T_real gain = fitp->value(STR_ENERGY_SLOPE);
+    const T_real fwhm_offset = fitp->value(STR_FWHM_OFFSET);
+    const T_real fwhm_fanoprime = fitp->value(STR_FWHM_FANOPRIME);
+    const T_real f_step_offset = fitp->value(STR_F_STEP_OFFSET);
+    const T_real f_step_linear = fitp->value(STR_F_STEP_LINEAR);
+    const T_real f_tail_offset = fitp->value(STR_F_TAIL_OFFSET);
+    const T_real f_tail_linear = fitp->value(STR_F_TAIL_LINEAR);
+    const T_real kb_f_tail_offset = fitp->value(STR_KB_F_TAIL_OFFSET);
+    const T_real kb_f_tail_linear = fitp->value(STR_KB_F_TAIL_LINEAR);
+    const T_real gamma_offset = fitp->value(STR_GAMMA_OFFSET);
+    const T_real gamma_linear = fitp->value(STR_GAMMA_LINEAR);
+    const T_real incident_energy = fitp->value(STR_COHERENT_SCT_ENERGY);
+    const Eigen::Index num_channels = ev.size();
+
+    const std::vector<Element_Energy_Ratio<T_real>>& energy_ratios = element_to_fit->energy_ratios();
+
+    for (int idx = 0; idx < (int)energy_ratios.size(); idx++)
+    {
+        const Element_Energy_Ratio<T_real>& er_struct = energy_ratios[idx];
+        T_real sigma = std::sqrt(std::pow((fwhm_offset / (T_real)2.3548), (T_real)2.0) + (er_struct.energy) * (T_real)2.96 * fwhm_fanoprime);
+        T_real f_step = std::abs<T_real>(er_struct.mu_fraction * (f_step_offset + (f_step_linear * er_struct.energy)));
+        T_real f_tail = std::abs<T_real>(f_tail_offset + (f_tail_linear * er_struct.mu_fraction));
+        T_real kb_f_tail = std::abs<T_real>(kb_f_tail_offset + (kb_f_tail_linear * er_struct.mu_fraction));
+
+        //don't process if energy is 0
+        if (er_struct.ratio == 0.0)
+            continue;
+        if (er_struct.energy <= 0.0)
+            continue;
+
+        delta_energy = ev - (T_acc)er_struct.energy;
+
+        T_real faktor = T_real(er_struct.ratio * pre_faktor);
+        T_real line_f_tail = (T_real)0.0;
+        if (element_to_fit->check_binding_energy(incident_energy, idx))
+        {
+            switch (er_struct.ptype)
+            {
+            case Element_Param_Type::Kb1_Line:
+            case Element_Param_Type::Kb2_Line:
+                faktor = faktor / ((T_real)1.0 + kb_f_tail + f_step);
+                break;
+            case Element_Param_Type::Ka1_Line:
+            case Element_Param_Type::Ka2_Line:
+            case Element_Param_Type::La1_Line:
+            case Element_Param_Type::La2_Line:
+            case Element_Param_Type::Lb1_Line:
+            case Element_Param_Type::Lb2_Line:
+            case Element_Param_Type::Lb3_Line:
+            case Element_Param_Type::Lb4_Line:
+            case Element_Param_Type::Lg1_Line:
+            case Element_Param_Type::Lg2_Line:
+            case Element_Param_Type::Lg3_Line:
+            case Element_Param_Type::Lg4_Line:
+            case Element_Param_Type::Ll_Line:
+            case Element_Param_Type::Ln_Line:
+                faktor = faktor / ((T_real)1.0 + f_tail + f_step);
+                break;
+            default:
+                break;
+            }
+        }
+        else
+        {
+            faktor = (T_real)0.0;
+        }
+
+        // peak, gauss
+        peak_spectra = faktor * (gain / (sigma * (T_real)(SQRT_2xPI)) * Eigen::exp(((T_acc)-0.5 * Eigen::pow((delta_energy / (T_acc)sigma), (T_acc)2.0)).template cast<T_real>()));
+
+        // peak, step
+        if (f_step > 0.0)
+        {
+            T_real value = faktor * f_step;
+            T_real scale = gain / (T_real)2.0 / er_struct.energy;
+            for (Eigen::Index i = 0; i < num_channels; i++)
+            {
+                peak_spectra[i] += value * (scale * std::erfc((T_real)(delta_energy[i] / ((T_acc)(M_SQRT2) * sigma))));
+            }
+        }
+
+        // peak, tail; use different tail for K beta vs K alpha lines
+        switch (er_struct.ptype)
+        {
+            case Element_Param_Type::Kb1_Line:
+            case Element_Param_Type::Kb2_Line:
+                line_f_tail = kb_f_tail;
+                break;
+            case Element_Param_Type::Ka1_Line:
+            case Element_Param_Type::Ka2_Line:
+            case Element_Param_Type::La1_Line:
+            case Element_Param_Type::La2_Line:
+            case Element_Param_Type::Lb1_Line:
+            case Element_Param_Type::Lb2_Line:
+            case Element_Param_Type::Lb3_Line:
+            case Element_Param_Type::Lb4_Line:
+            case Element_Param_Type::Lg1_Line:
+            case Element_Param_Type::Lg2_Line:
+            case Element_Param_Type::Lg3_Line:
+            case Element_Param_Type::Lg4_Line:
+            case Element_Param_Type::Ll_Line:
+            case Element_Param_Type::Ln_Line:
+                line_f_tail = f_tail;
+                break;
+            default:
+                out_spectra += peak_spectra.template cast<T_acc>();
+                continue;
+        }
+
+        T_real gamma = std::abs(gamma_offset + gamma_linear * (er_struct.energy)) * element_to_fit->width_multi();
+        T_real value = faktor * line_f_tail;
+        T_real scale = gain / (T_real)2.0 / gamma / sigma / exp((T_real)-0.5 / pow(gamma, (T_real)2.0));
+        for (Eigen::Index i = 0; i < num_channels; i++)
+        {
+            T_acc v = delta_energy[i];
+            T_real t = (v < (T_acc)0.0) ? std::exp((T_real)(v / (gamma * sigma))) * std::erfc((T_real)(v / ((T_acc)(M_SQRT2)*sigma) + ((T_acc)1.0 / (gamma * (T_acc)(M_SQRT2))))) : std::erfc((T_real)(v / ((T_acc)(M_SQRT2)*sigma) + ((T_acc)1.0 / (gamma * (T_acc)(M_SQRT2)))));
+            peak_spectra[i] += value * (scale * t);
+        }
+
+        out_spectra += peak_spectra.template cast<T_acc>();
+    }
+}
+
+// ----------------------------------------------------------------------------
+
 template<typename T_real>
 const Spectra<T_real> Gaussian_Model<T_real>::model_spectrum_element(const Fit_Parameters<T_real> * const fitp,
                                                      const Fit_Element_Map<T_real>* const element_to_fit,
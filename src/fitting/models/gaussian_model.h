@@ -86,6 +86,13 @@ public:
                                                         const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
                                                         const struct Range energy_range);
 
+    // multi threaded, no heap allocations once workspace is sized
+    virtual void model_spectrum_workspace(const Fit_Parameters<T_real>* const fit_params,
+                                          const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                                          const struct Range energy_range,
+                                          Model_Workspace<T_real>& workspace,
+                                          Spectra<T_real>& out_spectra);
+
     virtual const Spectra<T_real> model_spectrum_element(const Fit_Parameters<T_real>* const fitp,
                                                             const Fit_Element_Map<T_real>* const element_to_fit,
                                                             const ArrayTr<T_real> &ev,
@@ -134,6 +141,23 @@ protected:
 
     Fit_Parameters<T_real> _generate_default_fit_parameters();
 
+    // T_acc is the type of the energy axis and the sums, T_real or double for mixed precision
+    template<typename T_acc>
+    void _model_spectrum_workspace(const Fit_Parameters<T_real>* const fit_params,
+                                   Model_Workspace<T_real>& workspace,
+                                   const ArrayTr<T_acc>& ev,
+                                   std::vector<ArrayTr<T_acc>>& delta_energies,
+                                   std::vector<ArrayTr<T_acc>>& element_spectra,
+                                   ArrayTr<T_acc>& out_spectra) const;
+
+    template<typename T_acc>
+    void _model_spectrum_element_workspace(const Fit_Parameters<T_real>* const fitp,
+                                           const Fit_Element_Map<T_real>* const element_to_fit,
+                                           const ArrayTr<T_acc>& ev,
+                                           ArrayTr<T_acc>& delta_energy,
+                                           ArrayTr<T_real>& peak_spectra,
+                                           ArrayTr<T_acc>& out_spectra) const;
+
     Fit_Parameters<T_real> _fit_parameters;
 
 };
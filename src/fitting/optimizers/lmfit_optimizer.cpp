@@ -70,24 +70,24 @@ void residuals_lmfit( const T_real *par, int m_dat, const void *data, T_real *fv
     ud->fit_parameters->from_array(par, m_dat);
     // Model spectra based on new fit parameters
     update_background_user_data(ud);
-    ud->spectra_model = ud->fit_model->model_spectrum_mp(ud->fit_parameters, ud->elements, ud->energy_range);
+    ud->fit_model->model_spectrum_workspace(ud->fit_parameters, ud->elements, ud->energy_range, ud->model_workspace, ud->spectra_model);
     // Add background
     ud->spectra_model += ud->spectra_background;
     // Remove nan's and inf's
     // ud->spectra_model = (ArrayTr<T_real>)ud->spectra_model.unaryExpr([](T_real v) { return std::isfinite(v) ? v : (T_real)0.0; });
 
     // Calculate residuals
-    for (int i = 0; i < m_dat; i++ )
+    if (false == weighted_residuals(ud->spectra, ud->spectra_model, ud->weights, fvec, m_dat))
     {
-		fvec[i] = abs(ud->spectra[i] - ud->spectra_model[i]) * ud->weights[i];
-		if (std::isfinite(fvec[i]) == false)
-		{
-			//logE << "\n\n\n";
-			logE << "Spectra[i] = " << ud->spectra[i] << " :: spectra_model[i] = " << ud->spectra_model[i] << "  ::  weights[i] = " << ud->weights[i];
-			//logE << "\n\n\n";
-			fvec[i] = ud->spectra[i] + ud->spectra_model[i];
-            //fvec[i] = std::numeric_limits<T_real>::quiet_NaN();
-		}
+        for (int i = 0; i < m_dat; i++ )
+        {
+            if (std::isfinite(fvec[i]) == false)
+            {
+                logE << "Spectra[i] = " << ud->spectra[i] << " :: spectra_model[i] = " << ud->spectra_model[i] << "  ::  weights[i] = " << ud->weights[i];
+                fvec[i] = ud->spectra[i] + ud->spectra_model[i];
+                //fvec[i] = std::numeric_limits<T_real>::quiet_NaN();
+            }
+        }
     }
     
     ud->cur_itr++;
@@ -107,6 +107,95 @@ void residuals_lmfit( const T_real *par, int m_dat, const void *data, T_real *fv
 
 // ----------------------------------------------------------------------------
 
+template<typename T_real>
+void residuals_lmfit_columns( const int n, const T_real *x, const T_real *step, const int m_dat, const void *data, T_real *fjac, int *userbreak )
+{
+    User_Data<T_real>* ud = (User_Data<T_real>*)(data);
+
+    int ret = jacobian_columns<T_real>(ud, n, x, n, nullptr, step, m_dat, fjac, [m_dat](User_Data<T_real>* local_ud, T_real* par, T_real* fvec)
+    {
+        int local_break = 0;
+        residuals_lmfit<T_real>(par, m_dat, (const void*)local_ud, fvec, &local_break);
+        return (local_break != 0) ? -1 : 0;
+    });
+    if (ret < 0)
+    {
+        *userbreak = 1;
+    }
+
+    ud->cur_itr += n;
+    if (ud->status_callback != nullptr)
+    {
+        try
+        {
+            (*ud->status_callback)(ud->cur_itr, ud->total_itr);
+        }
+        catch (...)
+        {
+            logI << "Cancel fitting" << std::endl;
+            *userbreak = 1;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief The Mixed_User_Data struct : lets lmmin<double> call a T_real residual function.
+ *        spectra, spectra_model and weights are the arrays evaluate fills, used to redo the residuals in double.
+ *        For model fits model_workspace is set, the model is read from its double sum and background is added to it.
+ */
+template<typename T_real>
+struct Mixed_User_Data
+{
+    const void* ud;
+    void (*evaluate)(const T_real* par, const int m_dat, const void* data, T_real* fvec, int* userbreak);
+    const ArrayTr<T_real>* spectra;
+    const ArrayTr<T_real>* spectra_model;
+    const ArrayTr<T_real>* weights;
+    Model_Workspace<T_real>* model_workspace;
+    const ArrayTr<T_real>* background;
+    // index of energy offset, slope and quadratic in par, -1 if fixed
+    int energy_idx[3];
+    std::vector<T_real> par;
+    std::vector<T_real> fvec;
+};
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+void residuals_lmfit_mixed( const double *par, int m_dat, const void *data, double *fvec, int *userbreak )
+{
+    Mixed_User_Data<T_real>* mud = (Mixed_User_Data<T_real>*)(data);
+
+    for (size_t i = 0; i < mud->par.size(); i++)
+    {
+        mud->par[i] = static_cast<T_real>(par[i]);
+    }
+    if (mud->model_workspace != nullptr)
+    {
+        // a float calibration would move the energy axis in steps far larger than the lmmin steps
+        double* energy[3] = { &mud->model_workspace->energy_offset, &mud->model_workspace->energy_slope, &mud->model_workspace->energy_quad };
+        for (int k = 0; k < 3; k++)
+        {
+            if (mud->energy_idx[k] > -1)
+            {
+                *energy[k] = par[mud->energy_idx[k]];
+            }
+        }
+    }
+    mud->evaluate(&mud->par[0], m_dat, mud->ud, &mud->fvec[0], userbreak);
+    // the difference to the spectra and the norm lmmin sums from it are double, so is the model sum for model fits
+    for (int i = 0; i < m_dat; i++)
+    {
+        double model = (mud->model_workspace != nullptr) ? mud->model_workspace->spectra_dp[i] + (double)(*mud->background)[i] : (double)(*mud->spectra_model)[i];
+        double residual = std::abs((double)(*mud->spectra)[i] - model) * (double)(*mud->weights)[i];
+        fvec[i] = std::isfinite(residual) ? residual : static_cast<double>(mud->fvec[i]);
+    }
+}
+
+// ----------------------------------------------------------------------------
+
 template<typename T_real>
 void general_residuals_lmfit( const T_real *par, int m_dat, const void *data, T_real *fvec, int *userbreak )
 {
@@ -124,13 +213,15 @@ void general_residuals_lmfit( const T_real *par, int m_dat, const void *data, T_
     // ud->spectra_model = (ArrayTr<T_real>)ud->spectra_model.unaryExpr([](T_real v) { return std::isfinite(v) ? v : (T_real)0.0; });
     
     // Calculate residuals
-    for (int i = 0; i < m_dat; i++ )
+    if (false == weighted_residuals(ud->spectra, ud->spectra_model, ud->weights, fvec, m_dat))
     {
-        fvec[i] = abs( ud->spectra[i] - ud->spectra_model[i] ) * ud->weights[i];
-		if (std::isfinite(fvec[i]) == false)
-		{
-			fvec[i] = ud->spectra[i] + ud->spectra_model[i];
-		}
+        for (int i = 0; i < m_dat; i++ )
+        {
+            if (std::isfinite(fvec[i]) == false)
+            {
+                fvec[i] = ud->spectra[i] + ud->spectra_model[i];
+            }
+        }
     }
     
 
@@ -179,6 +270,7 @@ template<typename T_real>
 LMFit_Optimizer<T_real>::LMFit_Optimizer() : Optimizer<T_real>()
 {
     this->_last_outcome = -1;
+    _mixed_precision = false;
 
     if (std::is_same<T_real, float>::value)
     {
@@ -203,6 +295,7 @@ LMFit_Optimizer<T_real>::LMFit_Optimizer() : Optimizer<T_real>()
     _options.verbosity = 0; //  OR'ed: 1: print some messages; 2: print Jacobian. 
     _options.n_maxpri = -1; // -1, or max number of parameters to print.
     _options.m_maxpri = -1; // -1, or max number of residuals to print. 
+    _options.evaluate_columns = nullptr; // set per call in minimize() when the parallel jacobian is on
 
 
     this->_outcome_map[0] = OPTIMIZER_OUTCOME::FOUND_ZERO;
@@ -344,7 +437,16 @@ OPTIMIZER_OUTCOME LMFit_Optimizer<T_real>::minimize(Fit_Parameters<T_real> *fit_
     //control.verbosity = 3;
 
     /* perform the fit */
-    lmmin( (int)fitp_arr.size(), &fitp_arr[0], (int)energy_range.count(), (const void*) &ud, residuals_lmfit, &_options, &status );
+    if (_mixed_precision)
+    {
+        _lmmin_mixed_precision(fitp_arr, (int)energy_range.count(), (const void*) &ud, residuals_lmfit, ud.spectra, ud.spectra_model, ud.weights, status, fit_params, &ud.model_workspace, &ud.spectra_background);
+    }
+    else
+    {
+        lm_control_struct<T_real> options = _options;
+        options.evaluate_columns = this->_parallel_jacobian ? residuals_lmfit_columns<T_real> : nullptr;
+        lmmin( (int)fitp_arr.size(), &fitp_arr[0], (int)energy_range.count(), (const void*) &ud, residuals_lmfit, &options, &status );
+    }
     logI<< "Outcome: "<<lm_infmsg[status.outcome]<<"\nNum iter: "<<status.nfev<<"\n Norm of the residue vector: "<<status.fnorm<<"\n";
     this->_last_outcome = status.outcome;
     fit_params->from_array(fitp_arr);
@@ -386,6 +488,83 @@ OPTIMIZER_OUTCOME LMFit_Optimizer<T_real>::minimize(Fit_Parameters<T_real> *fit_
 
 // ----------------------------------------------------------------------------
 
+template<typename T_real>
+void LMFit_Optimizer<T_real>::_lmmin_mixed_precision(std::vector<T_real>& fitp_arr,
+                                                     int m_dat,
+                                                     const void* ud,
+                                                     void (*evaluate)(const T_real* par, const int m_dat, const void* data, T_real* fvec, int* userbreak),
+                                                     const ArrayTr<T_real>& spectra,
+                                                     const ArrayTr<T_real>& spectra_model,
+                                                     const ArrayTr<T_real>& weights,
+                                                     lm_status_struct<T_real>& status,
+                                                     Fit_Parameters<T_real>* fit_params,
+                                                     Model_Workspace<T_real>* model_workspace,
+                                                     const ArrayTr<T_real>* background)
+{
+    Mixed_User_Data<T_real> mud;
+    mud.ud = ud;
+    mud.evaluate = evaluate;
+    mud.spectra = &spectra;
+    mud.spectra_model = &spectra_model;
+    mud.weights = &weights;
+    mud.model_workspace = model_workspace;
+    mud.background = background;
+    mud.par.resize(fitp_arr.size());
+    mud.fvec.resize(m_dat);
+
+    if (model_workspace != nullptr)
+    {
+        // fit_params->to_array() set opt_array_index, fixed ones keep their value for the whole fit
+        const std::string energy_names[3] = { STR_ENERGY_OFFSET, STR_ENERGY_SLOPE, STR_ENERGY_QUADRATIC };
+        double* energy[3] = { &model_workspace->energy_offset, &model_workspace->energy_slope, &model_workspace->energy_quad };
+        for (int k = 0; k < 3; k++)
+        {
+            mud.energy_idx[k] = -1;
+            *energy[k] = 0.0;
+            if (fit_params->contains(energy_names[k]))
+            {
+                const Fit_Param<T_real>& param = fit_params->at(energy_names[k]);
+                *energy[k] = (double)param.value;
+                if (param.bound_type != E_Bound_Type::FIXED)
+                {
+                    mud.energy_idx[k] = param.opt_array_index;
+                }
+            }
+        }
+        model_workspace->double_accumulation = true;
+    }
+
+    std::vector<double> fitp_arr_dp(fitp_arr.begin(), fitp_arr.end());
+
+    lm_control_struct<double> options_dp;
+    options_dp.ftol = _options.ftol;
+    options_dp.xtol = _options.xtol;
+    options_dp.gtol = _options.gtol;
+    options_dp.epsilon = _options.epsilon;
+    options_dp.stepbound = _options.stepbound;
+    options_dp.patience = _options.patience;
+    options_dp.scale_diag = _options.scale_diag;
+    options_dp.msgfile = _options.msgfile;
+    options_dp.verbosity = _options.verbosity;
+    options_dp.n_maxpri = _options.n_maxpri;
+    options_dp.m_maxpri = _options.m_maxpri;
+    options_dp.evaluate_columns = nullptr;
+
+    lm_status_struct<double> status_dp;
+    lmmin( (int)fitp_arr_dp.size(), &fitp_arr_dp[0], m_dat, (const void*) &mud, residuals_lmfit_mixed<T_real>, &options_dp, &status_dp );
+
+    for (size_t i = 0; i < fitp_arr.size(); i++)
+    {
+        fitp_arr[i] = static_cast<T_real>(fitp_arr_dp[i]);
+    }
+    status.fnorm = static_cast<T_real>(status_dp.fnorm);
+    status.nfev = status_dp.nfev;
+    status.outcome = status_dp.outcome;
+    status.userbreak = status_dp.userbreak;
+}
+
+// ----------------------------------------------------------------------------
+
 template<typename T_real>
 OPTIMIZER_OUTCOME LMFit_Optimizer<T_real>::minimize_func(Fit_Parameters<T_real>*fit_params,
                                                 const Spectra<T_real>* const spectra,
@@ -408,7 +587,14 @@ OPTIMIZER_OUTCOME LMFit_Optimizer<T_real>::minimize_func(Fit_Parameters<T_real>*
 
     lm_status_struct<T_real> status;
     _options.verbosity = 0;
-    lmmin((int)fitp_arr.size(), &fitp_arr[0], (int)energy_range.count(), (const void*) &ud, general_residuals_lmfit, &_options, &status );
+    if (_mixed_precision)
+    {
+        _lmmin_mixed_precision(fitp_arr, (int)energy_range.count(), (const void*) &ud, general_residuals_lmfit, ud.spectra, ud.spectra_model, ud.weights, status);
+    }
+    else
+    {
+        lmmin((int)fitp_arr.size(), &fitp_arr[0], (int)energy_range.count(), (const void*) &ud, general_residuals_lmfit, &_options, &status );
+    }
     this->_last_outcome = status.outcome;
     fit_params->from_array(fitp_arr);
 
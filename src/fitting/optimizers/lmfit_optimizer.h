@@ -96,9 +96,31 @@ public:
 
     virtual std::string detailed_outcome(int outcome);
 
+    /**
+     * @brief set_mixed_precision : Only used for float. lmmin (jacobian, QR, sum of squares) runs in double. Model fits keep the
+     *          energy calibration, the peak arguments and the model sums in double, only exp and erfc run in float.
+     */
+    void set_mixed_precision(bool val) { _mixed_precision = val && std::is_same<T_real, float>::value; }
+
+    bool mixed_precision() const { return _mixed_precision; }
+
 private:
 
+    void _lmmin_mixed_precision(std::vector<T_real>& fitp_arr,
+                                int m_dat,
+                                const void* ud,
+                                void (*evaluate)(const T_real* par, const int m_dat, const void* data, T_real* fvec, int* userbreak),
+                                const ArrayTr<T_real>& spectra,
+                                const ArrayTr<T_real>& spectra_model,
+                                const ArrayTr<T_real>& weights,
+                                lm_status_struct<T_real>& status,
+                                Fit_Parameters<T_real>* fit_params = nullptr,
+                                Model_Workspace<T_real>* model_workspace = nullptr,
+                                const ArrayTr<T_real>* background = nullptr);
+
     struct lm_control_struct<T_real> _options;
+
+    bool _mixed_precision;
 };
 
 } //namespace optimizers
@@ -75,25 +75,23 @@ int residuals_mpfit(int m, int params_size, T_real *params, T_real *dy, T_real *
     // Update background if fit_snip_width is set to fit
     update_background_user_data(ud);
     // Model spectra based on new fit parameters
-    ud->spectra_model = ud->fit_model->model_spectrum_mp(ud->fit_parameters, ud->elements, ud->energy_range);
+    ud->fit_model->model_spectrum_workspace(ud->fit_parameters, ud->elements, ud->energy_range, ud->model_workspace, ud->spectra_model);
     // Add background
     ud->spectra_model += ud->spectra_background;
     // Remove nan's and inf's
     // ud->spectra_model = (ArrayTr<T_real>)ud->spectra_model.unaryExpr([](T_real v) { return std::isfinite(v) ? v : (T_real)0.0; });
 
     //Calculate residuals
-    for (int i=0; i<m; i++)
+    if (false == weighted_residuals(ud->spectra, ud->spectra_model, ud->weights, dy, m))
     {
-		//dy[i] = pow((ud->spectra[i] - ud->spectra_model[i]),2) * ud->weights[i];
-        dy[i] = abs(ud->spectra[i] - ud->spectra_model[i]) * ud->weights[i];
-		if (std::isfinite(dy[i]) == false)
-		{
-			//logE << "\n\n\n";
-			logE << "Spectra[i] = "<< ud->spectra[i] << " :: spectra_model[i] = " << ud->spectra_model[i] << "  ::  weights[i] = " << ud->weights[i];
-			//logE << "\n\n\n";
-			//dy[i] = ud->spectra[i] + ud->spectra_model[i];
-            dy[i] = std::numeric_limits<T_real>::quiet_NaN();
-		}
+        for (int i=0; i<m; i++)
+        {
+            if (std::isfinite(dy[i]) == false)
+            {
+                logE << "Spectra[i] = "<< ud->spectra[i] << " :: spectra_model[i] = " << ud->spectra_model[i] << "  ::  weights[i] = " << ud->weights[i];
+                dy[i] = std::numeric_limits<T_real>::quiet_NaN();
+            }
+        }
     }
 	
     ud->cur_itr++;
@@ -115,6 +113,38 @@ int residuals_mpfit(int m, int params_size, T_real *params, T_real *dy, T_real *
 
 //-----------------------------------------------------------------------------
 
+template<typename T_real>
+int residuals_mpfit_columns(int m, int npar, const T_real *x, int nfree, const int *ifree, const T_real *h, T_real *out, void *usr_data)
+{
+    User_Data<T_real>* ud = static_cast<User_Data<T_real>*>(usr_data);
+
+    int ret = jacobian_columns<T_real>(ud, npar, x, nfree, ifree, h, m, out, [m, npar](User_Data<T_real>* local_ud, T_real* par, T_real* dy)
+    {
+        return residuals_mpfit<T_real>(m, npar, par, dy, nullptr, (void*)local_ud);
+    });
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    ud->cur_itr += nfree;
+    if (ud->status_callback != nullptr)
+    {
+        try
+        {
+            (*ud->status_callback)(ud->cur_itr, ud->total_itr);
+        }
+        catch (int e)
+        {
+            logI << "Cancel fitting" << std::endl;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+
 template<typename T_real>
 int gen_residuals_mpfit(int m, int params_size, T_real *params, T_real *dy, T_real **dvec, void *usr_data)
 {
@@ -133,15 +163,15 @@ int gen_residuals_mpfit(int m, int params_size, T_real *params, T_real *dy, T_re
     // 
     
     // Calculate residuals
-    for (int i=0; i<m; i++)
+    if (false == weighted_residuals(ud->spectra, ud->spectra_model, ud->weights, dy, m))
     {
-        dy[i] = abs( ud->spectra[i] - ud->spectra_model[i] ) * ud->weights[i];
-		
-        if (std::isfinite(dy[i]) == false)
-		{
-			//dy[i] = ud->spectra[i] + ud->spectra_model[i];
-            dy[i] = std::numeric_limits<T_real>::quiet_NaN();
-		}
+        for (int i=0; i<m; i++)
+        {
+            if (std::isfinite(dy[i]) == false)
+            {
+                dy[i] = std::numeric_limits<T_real>::quiet_NaN();
+            }
+        }
     }
 
     return 0;
@@ -229,6 +259,7 @@ MPFit_Optimizer<T_real>::MPFit_Optimizer() : Optimizer<T_real>()
                                     //    1 = perform check
 
     _options.iterproc = 0;         // Placeholder pointer - must set to 0
+    _options.columns = 0;          // set per call in minimize() when the parallel jacobian is on
 
 
     this->_outcome_map[0] = OPTIMIZER_OUTCOME::FAILED;
@@ -506,7 +537,9 @@ OPTIMIZER_OUTCOME MPFit_Optimizer<T_real>::minimize(Fit_Parameters<T_real>*fit_p
     result.resid = &resid[0];
     result.covar = &covar[0];
 
-    this->_last_outcome = mpfit(residuals_mpfit<T_real>, (int)energy_range.count(), (int)fitp_arr.size(), &fitp_arr[0], &par[0], &_options, (void *) &ud, &result);
+    mp_config<T_real> options = _options;
+    options.columns = this->_parallel_jacobian ? residuals_mpfit_columns<T_real> : 0;
+    this->_last_outcome = mpfit(residuals_mpfit<T_real>, (int)energy_range.count(), (int)fitp_arr.size(), &fitp_arr[0], &par[0], &options, (void *) &ud, &result);
 
 	logI<< detailed_outcome(this->_last_outcome) << "\n";
 
@@ -91,6 +91,14 @@ namespace optimizers
 
     // ----------------------------------------------------------------------------
 
+    bool optimizer_outcome_converged(OPTIMIZER_OUTCOME outcome)
+    {
+        // lmfit maps its call limit (5) and failures (6, 7) to the *_TOL_LT_TOL outcomes, so only CONVERGED can be trusted
+        return outcome == fitting::optimizers::OPTIMIZER_OUTCOME::CONVERGED;
+    }
+
+    // ----------------------------------------------------------------------------
+
 
 TEMPLATE_STRUCT_DLL_EXPORT User_Data<float>;
 TEMPLATE_STRUCT_DLL_EXPORT User_Data<double>;
@@ -54,6 +54,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "data_struct/fit_parameters.h"
 #include "fitting/models/base_model.h"
 #include "quantification/models/quantification_model.h"
+#include "core/cpu_budget.h"
 
 
 typedef std::function<void(size_t, size_t)> Callback_Func_Status_Def;
@@ -88,6 +89,11 @@ enum class OPTIMIZER_OUTCOME{ FOUND_ZERO, CONVERGED, TRAPPED,  EXHAUSTED, FAILED
 
 DLL_EXPORT std::string optimizer_outcome_to_str(OPTIMIZER_OUTCOME outcome);
 
+/**
+ * @brief optimizer_outcome_converged : True only for CONVERGED, the tolerance states also stand for call limits and failures
+ */
+DLL_EXPORT bool optimizer_outcome_converged(OPTIMIZER_OUTCOME outcome);
+
 /**
  * @brief The User_Data struct : Structure used by minimize function for optimizers
  */
@@ -113,6 +119,7 @@ struct User_Data
     Fit_Element_Map_Dict<T_real> *elements;
     Range energy_range;
     Spectra<T_real>  spectra_model;
+    Model_Workspace<T_real> model_workspace;
     const Spectra<T_real> *orig_spectra;
     Callback_Func_Status_Def* status_callback;
     size_t cur_itr;
@@ -268,7 +275,7 @@ void update_background_user_data(User_Data<T_real> *ud)
 {
     if (ud->fit_parameters->contains(STR_SNIP_WIDTH))
     {
-        Fit_Param<T_real> fit_snip_width = ud->fit_parameters->at(STR_SNIP_WIDTH);
+        const Fit_Param<T_real>& fit_snip_width = ud->fit_parameters->at(STR_SNIP_WIDTH);
         if (fit_snip_width.bound_type != E_Bound_Type::FIXED && ud->orig_spectra != nullptr)
         {
             //ud->spectra_background = snip_background(ud->orig_spectra,
@@ -287,6 +294,68 @@ void update_background_user_data(User_Data<T_real> *ud)
     }
 }
 
+//----------------------------------------------------------------------------
+
+/**
+ * @brief weighted_residuals : fvec = |spectra - spectra_model| * weights in one branch free pass.
+ *          spectra, weights and background are clipped to the energy range once in fill_user_data.
+ * @return false if any residual is not finite so the caller can patch them up
+ */
+template<typename T_real>
+bool weighted_residuals(const ArrayTr<T_real>& spectra, const ArrayTr<T_real>& spectra_model, const ArrayTr<T_real>& weights, T_real* fvec, int m_dat)
+{
+    Eigen::Map<ArrayTr<T_real>> residuals(fvec, m_dat);
+    residuals = (spectra.head(m_dat) - spectra_model.head(m_dat)).abs() * weights.head(m_dat);
+    return residuals.allFinite();
+}
+
+//----------------------------------------------------------------------------
+
+/**
+ * @brief jacobian_columns : evaluate finite difference jacobian columns across omp threads.
+ *          Column j is evaluated at x with x[ifree[j]] + h[j] (ifree == nullptr means column j is parameter j)
+ *          and written to out + j*m. Each thread works on its own copy of the user data and fit parameters
+ *          so every column is bit identical to the serial loop.
+ * @return < 0 if evaluate returned < 0 for any column
+ */
+template<typename T_real>
+int jacobian_columns(const User_Data<T_real>* ud,
+                     int npar,
+                     const T_real* x,
+                     int ncols,
+                     const int* ifree,
+                     const T_real* h,
+                     int m,
+                     T_real* out,
+                     std::function<int(User_Data<T_real>*, T_real*, T_real*)> evaluate)
+{
+    int iflag = 0;
+#pragma omp parallel num_threads(Cpu_Budget::inst()->omp_threads())
+    {
+        Fit_Parameters<T_real> fit_params(*(ud->fit_parameters));
+        User_Data<T_real> local_ud(*ud);
+        local_ud.fit_parameters = &fit_params;
+        local_ud.status_callback = nullptr;
+        std::vector<T_real> par(x, x + npar);
+
+#pragma omp for schedule(dynamic, 1)
+        for (int j = 0; j < ncols; j++)
+        {
+            int idx = (ifree != nullptr) ? ifree[j] : j;
+            T_real temp = par[idx];
+            par[idx] = temp + h[j];
+            int ret = evaluate(&local_ud, &par[0], out + (size_t)j * m);
+            par[idx] = temp;
+            if (ret < 0)
+            {
+#pragma omp atomic write
+                iflag = ret;
+            }
+        }
+    }
+    return iflag;
+}
+
 //----------------------------------------------------------------------------
 //----------------------------------------------------------------------------
 
@@ -300,6 +369,7 @@ public:
     Optimizer()
     {
         _last_outcome = -1;
+        _parallel_jacobian = false;
     }
 
     virtual ~Optimizer(){}
@@ -332,12 +402,22 @@ public:
 
     std::string get_last_detailed_outcome() {return detailed_outcome(_last_outcome);}
 
+    /**
+     * @brief set_parallel_jacobian : evaluate the finite difference jacobian columns of minimize() in parallel.
+     *          Meant for single spectrum fits, per pixel fits are already parallel over pixels.
+     */
+    void set_parallel_jacobian(bool val) { _parallel_jacobian = val; }
+
+    bool parallel_jacobian() const { return _parallel_jacobian; }
+
 protected:
 
     std::map<int, OPTIMIZER_OUTCOME> _outcome_map;
 
     int _last_outcome;
 
+    bool _parallel_jacobian;
+
 };
 
 } //namespace optimizers
@@ -74,7 +74,7 @@ public:
     /**
      * @brief Base_Fit_Routine : Constructor
      */
-    Base_Fit_Routine() {}
+    Base_Fit_Routine() : _pixels_per_task(0) {}
 
     /**
      * @brief ~Base_Fit_Routine : Destructor
@@ -112,9 +112,16 @@ public:
                             const Fit_Element_Map_Dict<T_real> * const elements_to_fit,
                             const struct Range energy_range) = 0;
 
+    /**
+     * @brief set_pixels_per_task : Pixels fitted by one thread pool task when fitting a volume. 0 times the routine on the first row and picks the size
+     */
+    void set_pixels_per_task(size_t pixels) { _pixels_per_task = pixels; }
+
+    size_t pixels_per_task() const { return _pixels_per_task; }
 
 protected:
 
+    size_t _pixels_per_task;
 
 private:
 
@@ -0,0 +1,363 @@
+/***
+Copyright (c) 2016, UChicago Argonne, LLC. All rights reserved.
+
+Copyright 2016. UChicago Argonne, LLC. This software was produced
+under U.S. Government contract DE-AC02-06CH11357 for Argonne National
+Laboratory (ANL), which is operated by UChicago Argonne, LLC for the
+U.S. Department of Energy. The U.S. Government has rights to use,
+reproduce, and distribute this software.  NEITHER THE GOVERNMENT NOR
+UChicago Argonne, LLC MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR
+ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  If software is
+modified to produce derivative works, such modified software should
+be clearly marked, so as not to confuse it with the version available
+from ANL.
+
+Additionally, redistribution and use in source and binary forms, with
+or without modification, are permitted provided that the following
+conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the name of UChicago Argonne, LLC, Argonne National
+      Laboratory, ANL, the U.S. Government, nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY UChicago Argonne, LLC AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL UChicago
+Argonne, LLC OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+***/
+
+
+#include "fit_routine_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+namespace fitting
+{
+namespace routines
+{
+
+static const char CACHE_FILE_MAGIC[8] = { 'X', 'R', 'F', 'C', 'A', 'C', 'H', '1' };
+
+// ----------------------------------------------------------------------------
+
+template<typename T>
+static void append_bytes(std::string& key, const T& val)
+{
+    key.append((const char*)&val, sizeof(T));
+}
+
+// ----------------------------------------------------------------------------
+
+static void append_string(std::string& key, const std::string& str)
+{
+    append_bytes(key, (uint64_t)str.length());
+    key.append(str);
+}
+
+// ----------------------------------------------------------------------------
+
+//channels of each element model, from the energy range gen_key writes after the precision
+static bool key_model_size(const std::string& key, uint64_t& out_size)
+{
+    uint64_t range_min = 0;
+    uint64_t range_max = 0;
+    if (key.length() < sizeof(uint32_t) + 2 * sizeof(uint64_t))
+    {
+        return false;
+    }
+    memcpy(&range_min, key.data() + sizeof(uint32_t), sizeof(uint64_t));
+    memcpy(&range_max, key.data() + sizeof(uint32_t) + sizeof(uint64_t), sizeof(uint64_t));
+    if (range_max < range_min)
+    {
+        return false;
+    }
+    out_size = (range_max - range_min) + 1;
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+Fit_Routine_Cache<T_real>::Fit_Routine_Cache()
+{
+
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+Fit_Routine_Cache<T_real>::~Fit_Routine_Cache()
+{
+    _cache.clear();
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+void Fit_Routine_Cache<T_real>::set_directory(const std::string& dir)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _directory = dir;
+    if (_directory.length() > 0 && _directory.back() != DIR_END_CHAR)
+    {
+        _directory += DIR_END_CHAR;
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+std::string Fit_Routine_Cache<T_real>::gen_key(const models::Base_Model<T_real>* const model,
+                                               const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                                               const struct Range energy_range)
+{
+    // raw bytes, exact values so a hit always reproduces the same models
+    std::string key;
+    append_bytes(key, (uint32_t)sizeof(T_real));
+    append_bytes(key, (uint64_t)energy_range.min);
+    append_bytes(key, (uint64_t)energy_range.max);
+
+    const Fit_Parameters<T_real>& fit_params = model->fit_parameters();
+    std::vector<std::string> names;
+    for (const auto& itr : fit_params)
+    {
+        names.push_back(itr.first);
+    }
+    std::sort(names.begin(), names.end());
+    for (const auto& name : names)
+    {
+        append_string(key, name);
+        append_bytes(key, fit_params.at(name).value);
+    }
+
+    // element order is part of the key, the fit matrix columns follow it
+    for (const auto& itr : *elements_to_fit)
+    {
+        const Fit_Element_Map<T_real>* element = itr.second;
+        append_string(key, itr.first);
+        if (element == nullptr)
+        {
+            append_bytes(key, (int32_t)-2);
+            continue;
+        }
+        append_string(key, element->full_name());
+        append_bytes(key, (int32_t)element->Z());
+        append_string(key, element->shell_type_as_string());
+        append_bytes(key, (int32_t)(element->pileup_element() == nullptr ? -1 : element->pileup_element()->number));
+        append_bytes(key, element->width_multi());
+        append_bytes(key, (uint64_t)element->energy_ratios().size());
+        for (const auto& er : element->energy_ratios())
+        {
+            append_bytes(key, er.energy);
+            append_bytes(key, er.ratio);
+            append_bytes(key, er.mu_fraction);
+            append_bytes(key, (int32_t)er.ptype);
+        }
+        for (const auto& multi : element->energy_ratio_multipliers())
+        {
+            append_bytes(key, multi);
+        }
+    }
+    return key;
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+bool Fit_Routine_Cache<T_real>::find(const std::string& key, Element_Models& out_models)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto itr = _cache.find(key);
+    if (itr != _cache.end())
+    {
+        out_models = itr->second;
+        return true;
+    }
+    if (_directory.length() > 0 && _load(key, out_models))
+    {
+        _cache[key] = out_models;
+        return true;
+    }
+    return false;
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+void Fit_Routine_Cache<T_real>::insert(const std::string& key, const Element_Models& element_models)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _cache[key] = element_models;
+    if (_directory.length() > 0 && false == _save(key, element_models))
+    {
+        logW << "Could not save fit routine cache file " << _file_path(key) << "\n";
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+void Fit_Routine_Cache<T_real>::clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _cache.clear();
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+std::string Fit_Routine_Cache<T_real>::_file_path(const std::string& key) const
+{
+    // 64 bit FNV-1a of the key, the full key is stored in the file and checked on load
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : key)
+    {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    std::stringstream ss;
+    ss << _directory << "fit_routine_" << std::hex << std::setw(16) << std::setfill('0') << hash << ".cache";
+    return ss.str();
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+bool Fit_Routine_Cache<T_real>::_load(const std::string& key, Element_Models& out_models) const
+{
+    std::ifstream in(_file_path(key), std::ios::binary);
+    if (false == in.is_open())
+    {
+        return false;
+    }
+    char magic[sizeof(CACHE_FILE_MAGIC)];
+    uint64_t key_len = 0;
+    in.read(magic, sizeof(magic));
+    in.read((char*)&key_len, sizeof(key_len));
+    if (false == in.good() || memcmp(magic, CACHE_FILE_MAGIC, sizeof(magic)) != 0 || key_len != key.length())
+    {
+        return false;
+    }
+    std::string file_key(key_len, '\0');
+    in.read(&file_key[0], key_len);
+    if (false == in.good() || file_key != key)
+    {
+        return false;
+    }
+
+    // every length is checked before it is allocated, a corrupt file is a miss
+    uint64_t model_size = 0;
+    if (false == key_model_size(key, model_size))
+    {
+        return false;
+    }
+    uint64_t num_models = 0;
+    in.read((char*)&num_models, sizeof(num_models));
+    // each model's element name is in the key
+    if (false == in.good() || num_models > key.length())
+    {
+        return false;
+    }
+    Element_Models models;
+    for (uint64_t i = 0; in.good() && i < num_models; i++)
+    {
+        uint64_t name_len = 0;
+        uint64_t size = 0;
+        in.read((char*)&name_len, sizeof(name_len));
+        if (false == in.good() || name_len > key.length())
+        {
+            return false;
+        }
+        std::string name(name_len, '\0');
+        in.read(&name[0], name_len);
+        in.read((char*)&size, sizeof(size));
+        if (false == in.good() || size != model_size)
+        {
+            return false;
+        }
+        Spectra<T_real> spectra(size);
+        in.read((char*)spectra.data(), size * sizeof(T_real));
+        models[name] = spectra;
+    }
+    if (false == in.good())
+    {
+        return false;
+    }
+    out_models = models;
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+bool Fit_Routine_Cache<T_real>::_save(const std::string& key, const Element_Models& element_models) const
+{
+    std::string path = _file_path(key);
+    // write next to it and rename so another run never reads a partial file
+    std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        if (false == out.is_open())
+        {
+            return false;
+        }
+        uint64_t key_len = key.length();
+        uint64_t num_models = element_models.size();
+        out.write(CACHE_FILE_MAGIC, sizeof(CACHE_FILE_MAGIC));
+        out.write((const char*)&key_len, sizeof(key_len));
+        out.write(key.data(), key_len);
+        out.write((const char*)&num_models, sizeof(num_models));
+        for (const auto& itr : element_models)
+        {
+            uint64_t name_len = itr.first.length();
+            uint64_t size = itr.second.size();
+            out.write((const char*)&name_len, sizeof(name_len));
+            out.write(itr.first.data(), name_len);
+            out.write((const char*)&size, sizeof(size));
+            out.write((const char*)itr.second.data(), size * sizeof(T_real));
+        }
+        if (false == out.good())
+        {
+            out.close();
+            std::remove(tmp_path.c_str());
+            return false;
+        }
+    }
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0)
+    {
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
+TEMPLATE_CLASS_DLL_EXPORT Fit_Routine_Cache<float>;
+TEMPLATE_CLASS_DLL_EXPORT Fit_Routine_Cache<double>;
+
+} //namespace routines
+} //namespace fitting
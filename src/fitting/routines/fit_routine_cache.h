@@ -0,0 +1,117 @@
+/***
+Copyright (c) 2016, UChicago Argonne, LLC. All rights reserved.
+
+Copyright 2016. UChicago Argonne, LLC. This software was produced
+under U.S. Government contract DE-AC02-06CH11357 for Argonne National
+Laboratory (ANL), which is operated by UChicago Argonne, LLC for the
+U.S. Department of Energy. The U.S. Government has rights to use,
+reproduce, and distribute this software.  NEITHER THE GOVERNMENT NOR
+UChicago Argonne, LLC MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR
+ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  If software is
+modified to produce derivative works, such modified software should
+be clearly marked, so as not to confuse it with the version available
+from ANL.
+
+Additionally, redistribution and use in source and binary forms, with
+or without modification, are permitted provided that the following
+conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the name of UChicago Argonne, LLC, Argonne National
+      Laboratory, ANL, the U.S. Government, nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY UChicago Argonne, LLC AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL UChicago
+Argonne, LLC OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+***/
+
+
+
+#ifndef Fit_Routine_Cache_H
+#define Fit_Routine_Cache_H
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "data_struct/spectra.h"
+#include "data_struct/fit_element_map.h"
+#include "fitting/models/base_model.h"
+
+namespace fitting
+{
+namespace routines
+{
+
+using namespace data_struct;
+
+/**
+ * @brief The Fit_Routine_Cache class : Element model spectra of the matrix fit routines (GAUSS_MATRIX, NNLS, SVD), keyed by
+ *        everything they are generated from: fit parameters, elements and their energy ratios, energy range and precision.
+ *        Kept in memory and, if a directory is set, in one file per key so later runs skip generating them too.
+ */
+template<typename T_real>
+class DLL_EXPORT Fit_Routine_Cache
+{
+public:
+
+    typedef std::unordered_map<std::string, Spectra<T_real>> Element_Models;
+
+    Fit_Routine_Cache();
+
+    ~Fit_Routine_Cache();
+
+    /// directory for cache files, empty keeps the cache in memory only
+    void set_directory(const std::string& dir);
+
+    const std::string& directory() const { return _directory; }
+
+    static std::string gen_key(const models::Base_Model<T_real>* const model,
+                               const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                               const struct Range energy_range);
+
+    /// copy the cached models for key into out_models, looks in memory first then on disk
+    bool find(const std::string& key, Element_Models& out_models);
+
+    void insert(const std::string& key, const Element_Models& element_models);
+
+    void clear();
+
+protected:
+
+    std::string _file_path(const std::string& key) const;
+
+    bool _load(const std::string& key, Element_Models& out_models) const;
+
+    bool _save(const std::string& key, const Element_Models& element_models) const;
+
+    std::string _directory;
+
+    std::unordered_map<std::string, Element_Models> _cache;
+
+    std::mutex _mutex;
+
+};
+
+} //namespace routines
+
+} //namespace fitting
+
+#endif // Fit_Routine_Cache_H
@@ -0,0 +1,255 @@
+/***
+Copyright (c) 2016, UChicago Argonne, LLC. All rights reserved.
+
+Copyright 2016. UChicago Argonne, LLC. This software was produced
+under U.S. Government contract DE-AC02-06CH11357 for Argonne National
+Laboratory (ANL), which is operated by UChicago Argonne, LLC for the
+U.S. Department of Energy. The U.S. Government has rights to use,
+reproduce, and distribute this software.  NEITHER THE GOVERNMENT NOR
+UChicago Argonne, LLC MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR
+ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  If software is
+modified to produce derivative works, such modified software should
+be clearly marked, so as not to confuse it with the version available
+from ANL.
+
+Additionally, redistribution and use in source and binary forms, with
+or without modification, are permitted provided that the following
+conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the name of UChicago Argonne, LLC, Argonne National
+      Laboratory, ANL, the U.S. Government, nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY UChicago Argonne, LLC AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL UChicago
+Argonne, LLC OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+***/
+
+
+#include "low_rank_reduction.h"
+
+#include <random>
+#include <Eigen/QR>
+#include <Eigen/SVD>
+
+namespace fitting
+{
+namespace routines
+{
+
+template<typename T_real>
+Low_Rank_Reduction<T_real>::Low_Rank_Reduction()
+{
+    _max_rank = 32;
+    _variance = 1.0;
+    _non_negative = false;
+    _max_iter = 200;
+    _num_iter = 0;
+    _explained_variance = 0.0;
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+Low_Rank_Reduction<T_real>::~Low_Rank_Reduction()
+{
+
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+void Low_Rank_Reduction<T_real>::_randomized_svd(const Matrix_Type& data, size_t num, Matrix_Type& out_u, ArrayTr<T_real>& out_s, Matrix_Type& out_v)
+{
+    const Eigen::Index l = std::min((Eigen::Index)num + 10, std::min(data.rows(), data.cols()));
+
+    // fixed seed so the same dataset always gives the same maps
+    std::mt19937 gen(1);
+    std::normal_distribution<T_real> dist(0.0, 1.0);
+    Matrix_Type omega(data.cols(), l);
+    for (Eigen::Index c = 0; c < omega.cols(); c++)
+    {
+        for (Eigen::Index r = 0; r < omega.rows(); r++)
+        {
+            omega(r, c) = dist(gen);
+        }
+    }
+
+    Matrix_Type y = data * omega;
+    // power iterations, re-orthonormalized each time so float does not lose the small components
+    for (int q = 0; q < 2; q++)
+    {
+        Eigen::HouseholderQR<Matrix_Type> qr_y(y);
+        y = qr_y.householderQ() * Matrix_Type::Identity(data.rows(), l);
+        Matrix_Type z = data.transpose() * y;
+        Eigen::HouseholderQR<Matrix_Type> qr_z(z);
+        z = qr_z.householderQ() * Matrix_Type::Identity(data.cols(), l);
+        y = data * z;
+    }
+
+    Eigen::HouseholderQR<Matrix_Type> qr(y);
+    Matrix_Type q = qr.householderQ() * Matrix_Type::Identity(data.rows(), l);
+    Matrix_Type b = q.transpose() * data;
+    Eigen::BDCSVD<Matrix_Type> svd(b, Eigen::ComputeThinU | Eigen::ComputeThinV);
+    out_u = q * svd.matrixU();
+    out_s = svd.singularValues().array();
+    out_v = svd.matrixV();
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+void Low_Rank_Reduction<T_real>::_nmf(const Matrix_Type& data, T_real data_norm)
+{
+    const T_real eps = std::numeric_limits<T_real>::epsilon();
+    const T_real tol = 1.0e-5;
+    T_real prev_err = data_norm;
+    T_real err = data_norm;
+
+    // HALS: update one column of weights / row of basis at a time in closed form
+    for (_num_iter = 0; _num_iter < _max_iter; )
+    {
+        _num_iter++;
+        Matrix_Type xbt = data * _basis.transpose();
+        Matrix_Type bbt = _basis * _basis.transpose();
+        for (Eigen::Index j = 0; j < _weights.cols(); j++)
+        {
+            if (bbt(j, j) > 0)
+            {
+                _weights.col(j) = (_weights.col(j) + (xbt.col(j) - _weights * bbt.col(j)) / bbt(j, j)).cwiseMax(eps);
+            }
+        }
+
+        Matrix_Type wtx = _weights.transpose() * data;
+        Matrix_Type wtw = _weights.transpose() * _weights;
+        for (Eigen::Index j = 0; j < _basis.rows(); j++)
+        {
+            if (wtw(j, j) > 0)
+            {
+                _basis.row(j) = (_basis.row(j) + (wtx.row(j) - wtw.row(j) * _basis) / wtw(j, j)).cwiseMax(eps);
+            }
+        }
+
+        // |X - WB|^2 = |X|^2 - 2 <W'X, B> + <W'W, BB'> without forming W * B
+        err = data_norm - (T_real)2.0 * wtx.cwiseProduct(_basis).sum() + wtw.cwiseProduct(_basis * _basis.transpose()).sum();
+        if (std::abs(prev_err - err) <= tol * data_norm)
+        {
+            break;
+        }
+        prev_err = err;
+    }
+
+    for (Eigen::Index r = 0; r < _basis.rows(); r++)
+    {
+        T_real norm = _basis.row(r).norm();
+        if (norm > 0)
+        {
+            _basis.row(r) /= norm;
+            _weights.col(r) *= norm;
+        }
+    }
+    _explained_variance = (T_real)1.0 - std::max(err, (T_real)0.0) / data_norm;
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+bool Low_Rank_Reduction<T_real>::factorize(const Matrix_Type& data)
+{
+    _num_iter = 0;
+    _explained_variance = 0.0;
+    _basis.resize(0, 0);
+    _weights.resize(0, 0);
+
+    if (data.rows() == 0 || data.cols() == 0 || _max_rank == 0)
+    {
+        return false;
+    }
+
+    T_real data_norm = data.squaredNorm();
+    if (false == std::isfinite(data_norm) || data_norm <= 0)
+    {
+        logW << "Can not factorize empty or non finite data\n";
+        return false;
+    }
+
+    size_t max_rank = std::min(_max_rank, (size_t)std::min(data.rows(), data.cols()));
+    Matrix_Type u;
+    Matrix_Type v;
+    ArrayTr<T_real> s;
+    _randomized_svd(data, max_rank, u, s, v);
+    max_rank = std::min(max_rank, (size_t)s.size());
+
+    size_t rank = max_rank;
+    T_real kept = 0.0;
+    for (size_t r = 0; r < max_rank; r++)
+    {
+        kept += s[r] * s[r];
+        if (kept >= _variance * data_norm)
+        {
+            rank = r + 1;
+            break;
+        }
+    }
+
+    if (_non_negative)
+    {
+        // NNDSVD start: keep the dominant sign half of each singular pair
+        _weights.setZero(data.rows(), rank);
+        _basis.setZero(rank, data.cols());
+        for (size_t r = 0; r < rank; r++)
+        {
+            Matrix_Type up = u.col(r).cwiseMax((T_real)0.0);
+            Matrix_Type un = (-u.col(r)).cwiseMax((T_real)0.0);
+            Matrix_Type vp = v.col(r).cwiseMax((T_real)0.0);
+            Matrix_Type vn = (-v.col(r)).cwiseMax((T_real)0.0);
+            T_real mp = up.norm() * vp.norm();
+            T_real mn = un.norm() * vn.norm();
+            if (mp >= mn && mp > 0)
+            {
+                _weights.col(r) = std::sqrt(s[r] * mp) * up / up.norm();
+                _basis.row(r) = (std::sqrt(s[r] * mp) * vp / vp.norm()).transpose();
+            }
+            else if (mn > 0)
+            {
+                _weights.col(r) = std::sqrt(s[r] * mn) * un / un.norm();
+                _basis.row(r) = (std::sqrt(s[r] * mn) * vn / vn.norm()).transpose();
+            }
+        }
+        _nmf(data, data_norm);
+    }
+    else
+    {
+        _weights = u.leftCols(rank) * s.head(rank).matrix().asDiagonal();
+        _basis = v.leftCols(rank).transpose();
+        _explained_variance = (T_real)(s.head(rank).square().sum() / data_norm);
+    }
+
+    return _weights.allFinite() && _basis.allFinite();
+}
+
+// ----------------------------------------------------------------------------
+
+TEMPLATE_CLASS_DLL_EXPORT Low_Rank_Reduction<float>;
+TEMPLATE_CLASS_DLL_EXPORT Low_Rank_Reduction<double>;
+
+} //namespace routines
+} //namespace fitting
@@ -0,0 +1,130 @@
+/***
+Copyright (c) 2016, UChicago Argonne, LLC. All rights reserved.
+
+Copyright 2016. UChicago Argonne, LLC. This software was produced
+under U.S. Government contract DE-AC02-06CH11357 for Argonne National
+Laboratory (ANL), which is operated by UChicago Argonne, LLC for the
+U.S. Department of Energy. The U.S. Government has rights to use,
+reproduce, and distribute this software.  NEITHER THE GOVERNMENT NOR
+UChicago Argonne, LLC MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR
+ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  If software is
+modified to produce derivative works, such modified software should
+be clearly marked, so as not to confuse it with the version available
+from ANL.
+
+Additionally, redistribution and use in source and binary forms, with
+or without modification, are permitted provided that the following
+conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the name of UChicago Argonne, LLC, Argonne National
+      Laboratory, ANL, the U.S. Government, nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY UChicago Argonne, LLC AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL UChicago
+Argonne, LLC OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+***/
+
+
+
+#ifndef Low_Rank_Reduction_H
+#define Low_Rank_Reduction_H
+
+#include "data_struct/spectra.h"
+
+namespace fitting
+{
+namespace routines
+{
+
+using namespace data_struct;
+
+/**
+ * @brief The Low_Rank_Reduction class : Factorize a block of spectra (one row per pixel) into a few basis spectra
+ *        and per pixel weights so matrix fit routines only have to fit the basis. Uses a randomized truncated SVD,
+ *        refined with a non negative factorization (HALS) when the fit routine needs non negative inputs (NNLS).
+ */
+template<typename T_real>
+class DLL_EXPORT Low_Rank_Reduction
+{
+public:
+
+    typedef Eigen::Matrix<T_real, Eigen::Dynamic, Eigen::Dynamic> Matrix_Type;
+
+    Low_Rank_Reduction();
+
+    ~Low_Rank_Reduction();
+
+    void set_max_rank(size_t val) { _max_rank = val; }
+
+    /**
+     * @brief set_variance : Fraction of the data energy (sum of squares) the basis has to keep. Rank is the smallest that reaches it, capped by max rank.
+     */
+    void set_variance(T_real val) { _variance = val; }
+
+    void set_non_negative(bool val) { _non_negative = val; }
+
+    void set_max_iter(size_t val) { _max_iter = val; }
+
+    bool factorize(const Matrix_Type& data);
+
+    // rank x channels
+    const Matrix_Type& basis() const { return _basis; }
+
+    // pixels x rank
+    const Matrix_Type& weights() const { return _weights; }
+
+    size_t rank() const { return _basis.rows(); }
+
+    // 1 - |data - weights * basis|^2 / |data|^2
+    T_real explained_variance() const { return _explained_variance; }
+
+    size_t num_iter() const { return _num_iter; }
+
+protected:
+
+    void _randomized_svd(const Matrix_Type& data, size_t num, Matrix_Type& out_u, ArrayTr<T_real>& out_s, Matrix_Type& out_v);
+
+    void _nmf(const Matrix_Type& data, T_real data_norm);
+
+    size_t _max_rank;
+
+    T_real _variance;
+
+    bool _non_negative;
+
+    size_t _max_iter;
+
+    size_t _num_iter;
+
+    T_real _explained_variance;
+
+    Matrix_Type _basis;
+
+    Matrix_Type _weights;
+
+};
+
+} //namespace routines
+
+} //namespace fitting
+
+#endif // Low_Rank_Reduction_H
@@ -47,6 +47,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 
 #include "matrix_optimized_fit_routine.h"
+#include "core/cpu_budget.h"
 #ifdef _OPENMP
 #include <omp.h>
 #endif
@@ -65,6 +66,8 @@ template<typename T_real>
 Matrix_Optimized_Fit_Routine<T_real>::Matrix_Optimized_Fit_Routine() : Param_Optimized_Fit_Routine<T_real>()
 {
     _use_weights = true;
+    _low_rank_max_rank = 0;
+    _low_rank_variance = 1.0;
 }
 
 // ----------------------------------------------------------------------------
@@ -80,6 +83,57 @@ Matrix_Optimized_Fit_Routine<T_real>::~Matrix_Optimized_Fit_Routine()
 
 // --------------------------------------------------------------------------------------------------------------------
 
+template<typename T_real>
+void Matrix_Optimized_Fit_Routine<T_real>::subtract_background(const models::Base_Model<T_real>* const model,
+                                                               const Spectra<T_real>* const spectra,
+                                                               ArrayTr<T_real>& out_background,
+                                                               ArrayTr<T_real>& out_spectra)
+{
+    const Fit_Parameters<T_real>& fit_params = model->fit_parameters();
+    if (fit_params.contains(STR_SNIP_WIDTH))
+    {
+        ArrayTr<T_real> bkg = snip_background<T_real>(spectra,
+            fit_params.value(STR_ENERGY_OFFSET),
+            fit_params.value(STR_ENERGY_SLOPE),
+            fit_params.value(STR_ENERGY_QUADRATIC),
+            fit_params.value(STR_SNIP_WIDTH),
+            this->_energy_range.min,
+            this->_energy_range.max);
+
+        out_background = bkg.segment(this->_energy_range.min, this->_energy_range.count());
+    }
+    else
+    {
+        out_background.setZero(this->_energy_range.count());
+    }
+
+    out_spectra = spectra->segment(this->_energy_range.min, this->_energy_range.count());
+    out_spectra -= out_background;
+    out_spectra = out_spectra.unaryExpr([](T_real v) { return v > 0.0 ? v : (T_real)0.0; });
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
+template<typename T_real>
+void Matrix_Optimized_Fit_Routine<T_real>::add_integrated_spectra(const ArrayTr<T_real>& fitted, const ArrayTr<T_real>& background)
+{
+    std::lock_guard<std::mutex> lock(_int_spec_mutex);
+    _integrated_fitted_spectra.add(Spectra<T_real>(fitted));
+    _integrated_background.add(Spectra<T_real>(background));
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
+template<typename T_real>
+void Matrix_Optimized_Fit_Routine<T_real>::reset_integrated_spectra()
+{
+    std::lock_guard<std::mutex> lock(_int_spec_mutex);
+    _integrated_fitted_spectra.setZero(this->_energy_range.count());
+    _integrated_background.setZero(this->_energy_range.count());
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
 template<typename T_real>
 void Matrix_Optimized_Fit_Routine<T_real>::model_spectrum(const Fit_Parameters<T_real>* const fit_params,
                                                   const struct Range * const energy_range,
@@ -100,13 +154,11 @@ void Matrix_Optimized_Fit_Routine<T_real>::model_spectrum(const Fit_Parameters<T
 // ----------------------------------------------------------------------------
 
 template<typename T_real>
-std::unordered_map<std::string, Spectra<T_real>> Matrix_Optimized_Fit_Routine<T_real>::_generate_element_models(models::Base_Model<T_real>* const model,
+Fit_Parameters<T_real> Matrix_Optimized_Fit_Routine<T_real>::_element_model_fit_params(models::Base_Model<T_real>* const model,
     const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
-    struct Range energy_range)
+    struct Range energy_range,
+    ArrayTr<T_real>& out_ev)
 {
-    // fitmatrix(energy_range.count(), elements_to_fit->size()+2); //+2 for compton and elastic //n_pileup)
-    std::unordered_map<std::string, Spectra<T_real>> element_spectra;
-
     Fit_Parameters<T_real> fit_parameters = model->fit_parameters();
     //set all fit parameters to be fixed. We only want to fit element counts
     fit_parameters.set_all(E_Bound_Type::FIXED);
@@ -116,12 +168,10 @@ std::unordered_map<std::string, Spectra<T_real>> Matrix_Optimized_Fit_Routine<T_
     T_real energy_quad = fit_parameters.value(STR_ENERGY_QUADRATIC);
 
     ArrayTr<T_real> energy = ArrayTr<T_real>::LinSpaced(energy_range.count(), energy_range.min, energy_range.max);
-    ArrayTr<T_real> ev = energy_offset + (energy * energy_slope) + (pow(energy, (T_real)2.0) * energy_quad);
-
+    out_ev = energy_offset + (energy * energy_slope) + (pow(energy, (T_real)2.0) * energy_quad);
 
     for (const auto& itr : (*elements_to_fit))
     {
-        Fit_Element_Map<T_real>* element = itr.second;
         // Set value to 0.0 . This is the pre_faktor in gauss_tails_model. we do 10.0 ^ pre_faktor = 1.0
         if (false == fit_parameters.contains(itr.first))
         {
@@ -132,7 +182,26 @@ std::unordered_map<std::string, Spectra<T_real>> Matrix_Optimized_Fit_Routine<T_
         {
             fit_parameters[itr.first].value = (T_real)0.0;
         }
-        element_spectra[itr.first] = model->model_spectrum_element(&fit_parameters, element, ev, nullptr);
+    }
+    return fit_parameters;
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+std::unordered_map<std::string, Spectra<T_real>> Matrix_Optimized_Fit_Routine<T_real>::_generate_element_models(models::Base_Model<T_real>* const model,
+    const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+    struct Range energy_range)
+{
+    // fitmatrix(energy_range.count(), elements_to_fit->size()+2); //+2 for compton and elastic //n_pileup)
+    std::unordered_map<std::string, Spectra<T_real>> element_spectra;
+
+    ArrayTr<T_real> ev;
+    Fit_Parameters<T_real> fit_parameters = _element_model_fit_params(model, elements_to_fit, energy_range, ev);
+
+    for (const auto& itr : (*elements_to_fit))
+    {
+        element_spectra[itr.first] = model->model_spectrum_element(&fit_parameters, itr.second, ev, nullptr);
     }
     //i = elements_to_fit->size();
     // scattering:
@@ -206,7 +275,7 @@ std::unordered_map<std::string, Spectra<T_real>> Matrix_Optimized_Fit_Routine<T_
             keys.push_back(itr.first);
         }
     }
-#pragma omp parallel for
+#pragma omp parallel for num_threads(Cpu_Budget::inst()->omp_threads())
     for (int i = 0; i < (int)keys.size(); i++)
     {
         Fit_Element_Map<T_real>* element = elements_to_fit->at(keys[i]);
@@ -281,6 +350,75 @@ void Matrix_Optimized_Fit_Routine<T_real>::initialize(models::Base_Model<T_real>
 
 // ----------------------------------------------------------------------------
 
+template<typename T_real>
+size_t Matrix_Optimized_Fit_Routine<T_real>::update_incident_energy(models::Base_Model<T_real>* const model,
+                                                                    const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                                                                    T_real old_energy)
+{
+    ArrayTr<T_real> ev;
+    Fit_Parameters<T_real> fit_parameters = _element_model_fit_params(model, elements_to_fit, this->_energy_range, ev);
+    const T_real new_energy = fit_parameters.value(STR_COHERENT_SCT_ENERGY);
+
+    //the incident energy only decides which lines of an element are excited
+    std::unordered_map<std::string, Spectra<T_real>> element_spectra = _element_models;
+    size_t regenerated = 0;
+    for (const auto& itr : (*elements_to_fit))
+    {
+        bool changed = (_element_models.count(itr.first) == 0);
+        for (int idx = 0; false == changed && idx < (int)itr.second->energy_ratios().size(); idx++)
+        {
+            changed = (itr.second->check_binding_energy(old_energy, idx) != itr.second->check_binding_energy(new_energy, idx));
+        }
+        if (changed)
+        {
+            element_spectra[itr.first] = model->model_spectrum_element(&fit_parameters, itr.second, ev, nullptr);
+            regenerated++;
+        }
+    }
+
+    Spectra<T_real> elastic_model(this->_energy_range.count());
+    fit_parameters[STR_COHERENT_SCT_AMPLITUDE].value = 0.0;
+    elastic_model += model->elastic_peak(&fit_parameters, ev, fit_parameters.at(STR_ENERGY_SLOPE).value);
+    element_spectra[STR_COHERENT_SCT_AMPLITUDE] = elastic_model;
+
+    Spectra<T_real> compton_model(this->_energy_range.count());
+    fit_parameters[STR_COMPTON_AMPLITUDE].value = 0.0;
+    compton_model += model->compton_peak(&fit_parameters, ev, fit_parameters.at(STR_ENERGY_SLOPE).value);
+    element_spectra[STR_COMPTON_AMPLITUDE] = compton_model;
+    regenerated += 2;
+
+    initialize_with_element_models(elements_to_fit, this->_energy_range, element_spectra);
+    return regenerated;
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+void Matrix_Optimized_Fit_Routine<T_real>::initialize_with_element_models(const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                                                                         const struct Range energy_range,
+                                                                         const std::unordered_map<std::string, Spectra<T_real>>& element_models)
+{
+    this->_energy_range = energy_range;
+    //insert in the same order _generate_element_models does so the map, and the fit matrix built from it, iterate the same way
+    std::unordered_map<std::string, Spectra<T_real>> element_spectra;
+    for (const auto& itr : (*elements_to_fit))
+    {
+        element_spectra[itr.first] = element_models.at(itr.first);
+    }
+    element_spectra[STR_COHERENT_SCT_AMPLITUDE] = element_models.at(STR_COHERENT_SCT_AMPLITUDE);
+    element_spectra[STR_COMPTON_AMPLITUDE] = element_models.at(STR_COMPTON_AMPLITUDE);
+    _element_models.clear();
+    _element_models = std::move(element_spectra);
+
+    {
+        std::lock_guard<std::mutex> lock(_int_spec_mutex);
+        _integrated_fitted_spectra.setZero(energy_range.count());
+        _integrated_background.setZero(energy_range.count());
+    }
+}
+
+// ----------------------------------------------------------------------------
+
 template<typename T_real>
 void Matrix_Optimized_Fit_Routine<T_real>::initialize_mp(models::Base_Model<T_real>* const model,
     const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
@@ -361,17 +499,6 @@ OPTIMIZER_OUTCOME Matrix_Optimized_Fit_Routine<T_real>:: fit_spectra(const model
         out_counts[STR_NUM_ITR] = fit_params.at(STR_NUM_ITR).value;
         out_counts[STR_RESIDUAL] = fit_params.at(STR_RESIDUAL).value;
 
-		//get max and top 10 max channels
-        std::vector<std::pair<int, T_real> > max_map;
-		data_struct::Spectra<T_real> max_vals = *spectra;
-		typename data_struct::Spectra<T_real>::Index idx;
-		for (int i = 0; i < 10; i++)
-		{
-			T_real max_val = max_vals.maxCoeff(&idx);
-			max_map.push_back({ idx, max_val });
-			max_vals[idx] = 0;
-		}
-
 		//model fit spectra
         Spectra<T_real> model_spectra(this->_energy_range.count());
         this->model_spectrum(&fit_params, &this->_energy_range, &model_spectra);
@@ -384,23 +511,6 @@ OPTIMIZER_OUTCOME Matrix_Optimized_Fit_Routine<T_real>:: fit_spectra(const model
             std::lock_guard<std::mutex> lock(_int_spec_mutex);
             _integrated_fitted_spectra.add(model_spectra);
             _integrated_background.add(background);
-
-			//we don't know the spectra size during initlaize() will have to resize here
-			if (_max_channels_spectra.size() < spectra->size())
-			{
-				_max_channels_spectra.setZero(spectra->size());
-			}
-			if (_max_10_channels_spectra.size() < spectra->size())
-			{
-				_max_10_channels_spectra.setZero(spectra->size());
-			}
-
-			_max_channels_spectra[max_map[0].first] += max_map[0].second;
-
-			for (auto &itr : max_map)
-			{
-				_max_10_channels_spectra[itr.first] += itr.second;
-			}
         }
 
         this->_optimizer->set_options(saved_options);
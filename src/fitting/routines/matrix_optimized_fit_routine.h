@@ -88,6 +88,25 @@ public:
                         const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
                         const struct Range energy_range);
 
+    /**
+     * @brief initialize_with_element_models : Same as initialize but takes element models generated earlier for the same model,
+     *                                         elements and energy range instead of generating them.
+     */
+    virtual void initialize_with_element_models(const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                                                const struct Range energy_range,
+                                                const std::unordered_map<std::string, Spectra<T_real>>& element_models);
+
+    const std::unordered_map<std::string, Spectra<T_real>>& element_models() const { return _element_models; }
+
+    /**
+     * @brief update_incident_energy : After the model's COHERENT_SCT_ENERGY changed from old_energy, regenerate only the element models
+     *                                 that depend on it: elastic, compton and elements whose excited lines changed. Same models as initialize.
+     * @return number of element models regenerated
+     */
+    size_t update_incident_energy(models::Base_Model<T_real>* const model,
+                                  const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                                  T_real old_energy);
+
 
     virtual void model_spectrum(const Fit_Parameters<T_real>* const fit_params,
                         const struct Range * const energy_range,
@@ -97,14 +116,46 @@ public:
 
     const Spectra<T_real>& fitted_integrated_background() { return _integrated_background; }
 
-	const Spectra<T_real>& max_integrated_spectra() { return _max_channels_spectra; }
+    void set_use_weights(bool val) {_use_weights = val;}
 
-	const Spectra<T_real>& max_10_integrated_spectra() { return _max_10_channels_spectra; }
+    /**
+     * @brief fit_counts : Solve element counts for a spectrum already cut to the energy range with its background removed.
+     *                     Returns false if the routine has no direct matrix solve. Used to fit low rank basis spectra.
+     */
+    virtual bool fit_counts(const ArrayTr<T_real>& /*rhs*/,
+                            const Fit_Element_Map_Dict<T_real>* const /*elements_to_fit*/,
+                            std::unordered_map<std::string, T_real>& /*out_counts*/,
+                            ArrayTr<T_real>& /*out_model*/) { return false; }
 
-    void set_use_weights(bool val) {_use_weights = val;}
+    /**
+     * @brief subtract_background : Snip background of the energy range and the background subtracted spectra clipped at 0, same as the per pixel fits.
+     */
+    void subtract_background(const models::Base_Model<T_real>* const model,
+                             const Spectra<T_real>* const spectra,
+                             ArrayTr<T_real>& out_background,
+                             ArrayTr<T_real>& out_spectra);
+
+    void add_integrated_spectra(const ArrayTr<T_real>& fitted, const ArrayTr<T_real>& background);
+
+    void reset_integrated_spectra();
+
+    /**
+     * @brief set_low_rank : Fit a low rank factorization of the volume instead of every pixel. 0 max rank disables it.
+     */
+    void set_low_rank(size_t max_rank, T_real variance) { _low_rank_max_rank = max_rank; _low_rank_variance = variance; }
+
+    size_t low_rank_max_rank() const { return _low_rank_max_rank; }
+
+    T_real low_rank_variance() const { return _low_rank_variance; }
 
 protected:
 
+    //fit parameters and energy axis the element models are generated with
+    Fit_Parameters<T_real> _element_model_fit_params(models::Base_Model<T_real>* const model,
+                                                     const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                                                     struct Range energy_range,
+                                                     ArrayTr<T_real>& out_ev);
+
     std::unordered_map<std::string, Spectra<T_real>> _generate_element_models(models::Base_Model<T_real>* const model,
                                                             const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
                                                             struct Range energy_range);
@@ -116,11 +167,13 @@ protected:
 
 	data_struct::Spectra<T_real> _integrated_fitted_spectra;
     data_struct::Spectra<T_real> _integrated_background;
-	data_struct::Spectra<T_real> _max_channels_spectra;
-	data_struct::Spectra<T_real> _max_10_channels_spectra;
 
     bool _use_weights;
 
+    size_t _low_rank_max_rank;
+
+    T_real _low_rank_variance;
+
     std::unordered_map<std::string, Spectra<T_real>> _element_models;
 
     static std::mutex _int_spec_mutex;
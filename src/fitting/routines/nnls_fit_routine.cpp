@@ -61,6 +61,7 @@ NNLS_Fit_Routine<T_real>::NNLS_Fit_Routine() : Matrix_Optimized_Fit_Routine<T_re
 {
 
     _max_iter = 200;
+    _mixed_precision = false;
 
 }
 
@@ -71,6 +72,7 @@ NNLS_Fit_Routine<T_real>::NNLS_Fit_Routine(size_t max_iter) : Matrix_Optimized_F
 {
 
     _max_iter = max_iter;
+    _mixed_precision = false;
 
 }
 
@@ -104,6 +106,54 @@ void NNLS_Fit_Routine<T_real>::_generate_fitmatrix()
         i++;
     }
 
+    if (_mixed_precision)
+    {
+        _fitmatrix_dp = _fitmatrix.template cast<double>();
+    }
+    else
+    {
+        _fitmatrix_dp.resize(0, 0);
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+void NNLS_Fit_Routine<T_real>::set_mixed_precision(bool val)
+{
+    _mixed_precision = val && std::is_same<T_real, float>::value;
+    if (_mixed_precision)
+    {
+        _fitmatrix_dp = _fitmatrix.template cast<double>();
+    }
+    else
+    {
+        _fitmatrix_dp.resize(0, 0);
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+void NNLS_Fit_Routine<T_real>::_solve(ArrayTr<T_real>* rhs, ArrayTr<T_real>& out_result, int& num_iter, T_real& npg, int& max_iter)
+{
+    if (_mixed_precision)
+    {
+        ArrayTr<double> rhs_dp = rhs->template cast<double>();
+        double npg_dp;
+        nsNNLS::nnls<double> solver(&_fitmatrix_dp, &rhs_dp, _max_iter);
+        solver.optimize(num_iter, npg_dp);
+        out_result = solver.getSolution()->template cast<T_real>();
+        npg = static_cast<T_real>(npg_dp);
+        max_iter = solver.getMaxit();
+    }
+    else
+    {
+        nsNNLS::nnls<T_real> solver(&_fitmatrix, rhs, _max_iter);
+        solver.optimize(num_iter, npg);
+        out_result = *(solver.getSolution());
+        max_iter = solver.getMaxit();
+    }
 }
 
 // ----------------------------------------------------------------------------
@@ -117,24 +167,23 @@ void NNLS_Fit_Routine<T_real>::fit_spectrum_model(const Spectra<T_real>* const s
     //spectra_model->setZero(this->_energy_range.count());
     spectra_model->setZero();
 
-    data_struct::ArrayTr<T_real>* result;
+    data_struct::ArrayTr<T_real> solution;
+    data_struct::ArrayTr<T_real>* result = &solution;
     int num_iter;
+    int max_iter;
     T_real npg;
 
     ArrayTr<T_real> spectra_sub_background = spectra->segment(this->_energy_range.min, this->_energy_range.count());
     spectra_sub_background -= *background;
     spectra_sub_background = spectra_sub_background.unaryExpr([](T_real v) { return v > 0.0 ? v : (T_real)0.0; });
-    nsNNLS::nnls<T_real> solver(&_fitmatrix, &spectra_sub_background, _max_iter);
 
-    solver.optimize(num_iter, npg);
+    _solve(&spectra_sub_background, solution, num_iter, npg, max_iter);
     //logI << "NNLS num iter: " << num_iter << " : npg : " << npg << "\n";
     if (num_iter < 0)
     {
         logE << "Num iter < 0" << "\n";
     }
 
-    result = solver.getSolution();
-
     for (const auto& itr : *elements_to_fit)
     {
         if (std::isfinite((*result)[_element_row_index[itr.first]]))
@@ -180,33 +229,14 @@ OPTIMIZER_OUTCOME NNLS_Fit_Routine<T_real>::fit_spectra(const models::Base_Model
                                                 const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
                                                 std::unordered_map<std::string, T_real>& out_counts)
 {
-	data_struct::ArrayTr<T_real>* result;
+    data_struct::ArrayTr<T_real> solution;
+    data_struct::ArrayTr<T_real>* result = &solution;
     int num_iter;
+    int max_iter;
     T_real npg;
-    Fit_Parameters<T_real> fit_params = model->fit_parameters();
-    fit_params.add_parameter(Fit_Param<T_real>(STR_RESIDUAL, 0.0));
     ArrayTr<T_real> background;
-    if (fit_params.contains(STR_SNIP_WIDTH))
-    {        
-        ArrayTr<T_real> bkg = snip_background<T_real>(spectra,
-            fit_params.value(STR_ENERGY_OFFSET),
-            fit_params.value(STR_ENERGY_SLOPE),
-            fit_params.value(STR_ENERGY_QUADRATIC),
-            fit_params.value(STR_SNIP_WIDTH),
-            this->_energy_range.min,
-            this->_energy_range.max);
-
-        background = bkg.segment(this->_energy_range.min, this->_energy_range.count());
-    }
-    else
-    {
-        background.setZero(this->_energy_range.count());
-    }
-
-    ArrayTr<T_real> spectra_sub_background = spectra->segment(this->_energy_range.min, this->_energy_range.count());
-    spectra_sub_background -= background;
-    spectra_sub_background = spectra_sub_background.unaryExpr([](T_real v) { return v>0.0 ? v : (T_real)0.0; });
-    nsNNLS::nnls<T_real> solver(&_fitmatrix, &spectra_sub_background, _max_iter);
+    ArrayTr<T_real> spectra_sub_background;
+    this->subtract_background(model, spectra, background, spectra_sub_background);
 
     Spectra<T_real> spectra_model = background;
 
@@ -214,14 +244,12 @@ OPTIMIZER_OUTCOME NNLS_Fit_Routine<T_real>::fit_spectra(const models::Base_Model
 	//ArrayTr<T_real> rhs = spectra->sub_spectra(this->_energy_range.min, this->_energy_range.count());
 	//nsNNLS::nnls<T_real> solver(&_fitmatrix, &rhs, _max_iter);
 
-    solver.optimize(num_iter, npg);
+    _solve(&spectra_sub_background, solution, num_iter, npg, max_iter);
     if (num_iter < 0)
     {
         logE<<"num_iter < 0"<<"\n";
     }
 
-    result = solver.getSolution();
-
     for(const auto& itr : *elements_to_fit)
     {
         if (std::isfinite((*result)[_element_row_index[itr.first]]))
@@ -253,7 +281,7 @@ OPTIMIZER_OUTCOME NNLS_Fit_Routine<T_real>::fit_spectra(const models::Base_Model
         this->_integrated_background.add(background);
 	}
 
-    if (num_iter == solver.getMaxit())
+    if (num_iter == max_iter)
     {
         return OPTIMIZER_OUTCOME::EXHAUSTED;
     }
@@ -263,6 +291,45 @@ OPTIMIZER_OUTCOME NNLS_Fit_Routine<T_real>::fit_spectra(const models::Base_Model
 
 // ----------------------------------------------------------------------------
 
+template<typename T_real>
+bool NNLS_Fit_Routine<T_real>::fit_counts(const ArrayTr<T_real>& rhs,
+                                          const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                                          std::unordered_map<std::string, T_real>& out_counts,
+                                          ArrayTr<T_real>& out_model)
+{
+    data_struct::ArrayTr<T_real> solution;
+    ArrayTr<T_real> spectra = rhs;
+    int num_iter;
+    int max_iter;
+    T_real npg;
+
+    _solve(&spectra, solution, num_iter, npg, max_iter);
+    if (num_iter < 0)
+    {
+        logE << "num_iter < 0" << "\n";
+        return false;
+    }
+
+    out_model.setZero(this->_energy_range.count());
+    for (const auto& itr : *elements_to_fit)
+    {
+        int idx = _element_row_index.at(itr.first);
+        if (std::isfinite(solution[idx]))
+        {
+            out_counts[itr.first] = solution[idx];
+            out_model += _fitmatrix.col(idx).array() * solution[idx];
+        }
+        else
+        {
+            out_counts[itr.first] = 0.;
+        }
+    }
+    out_counts[STR_NUM_ITR] = static_cast<T_real>(num_iter);
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
 template<typename T_real>
 void NNLS_Fit_Routine<T_real>::initialize(models::Base_Model<T_real>* const model,
                                   const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
@@ -284,6 +351,17 @@ void NNLS_Fit_Routine<T_real>::initialize_mp(models::Base_Model<T_real>* const m
 }
 // ----------------------------------------------------------------------------
 
+template<typename T_real>
+void NNLS_Fit_Routine<T_real>::initialize_with_element_models(const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                                                     const struct Range energy_range,
+                                                     const std::unordered_map<std::string, Spectra<T_real>>& element_models)
+{
+    Matrix_Optimized_Fit_Routine<T_real>::initialize_with_element_models(elements_to_fit, energy_range, element_models);
+    _generate_fitmatrix();
+}
+
+// ----------------------------------------------------------------------------
+
 TEMPLATE_CLASS_DLL_EXPORT NNLS_Fit_Routine<float>;
 TEMPLATE_CLASS_DLL_EXPORT NNLS_Fit_Routine<double>;
 
@@ -83,26 +83,46 @@ public:
                             const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
                             Spectra<T_real>* spectra_model);
 
+    virtual bool fit_counts(const ArrayTr<T_real>& rhs,
+                            const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                            std::unordered_map<std::string, T_real>& out_counts,
+                            ArrayTr<T_real>& out_model);
+
     virtual std::string get_name() { return STR_FIT_NNLS; }
 
     virtual void initialize(models::Base_Model<T_real>* const model,
                             const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
                             const struct Range energy_range);
 
+    virtual void initialize_with_element_models(const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                                                const struct Range energy_range,
+                                                const std::unordered_map<std::string, Spectra<T_real>>& element_models);
+
     void initialize_mp(models::Base_Model<T_real>* const model,
                         const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
                         const struct Range energy_range);
 
+    /**
+     * @brief set_mixed_precision : Only used for float. Solve the nnls problem in double while spectra and element models stay float
+     */
+    void set_mixed_precision(bool val);
+
 protected:
 
     void _generate_fitmatrix();
 
+    void _solve(ArrayTr<T_real>* rhs, ArrayTr<T_real>& out_result, int& num_iter, T_real& npg, int& max_iter);
+
     size_t _max_iter;
 
+    bool _mixed_precision;
+
 private:
 
     Eigen::Matrix<T_real, Eigen::Dynamic, Eigen::Dynamic> _fitmatrix;
 
+    Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> _fitmatrix_dp;
+
     std::unordered_map<std::string, int> _element_row_index;
 
 };
@@ -74,6 +74,7 @@ Param_Optimized_Fit_Routine<T_real>::Param_Optimized_Fit_Routine() : Base_Fit_Ro
     _energy_range.min = 0;
     _energy_range.max = 1999;
     _update_coherent_amplitude_on_fit = true;
+    _warm_start = false;
 
 }
 
@@ -179,13 +180,46 @@ OPTIMIZER_OUTCOME Param_Optimized_Fit_Routine<T_real>::fit_spectra(const models:
                                                            const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
                                                            std::unordered_map<std::string, T_real>& out_counts)
 {
+    Fit_Parameters<T_real> fit_params;
+    return _fit_spectra(model, spectra, elements_to_fit, nullptr, fit_params, out_counts);
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+OPTIMIZER_OUTCOME Param_Optimized_Fit_Routine<T_real>::fit_spectra_warm_start(const models::Base_Model<T_real>* const model,
+                                                                      const Spectra<T_real>* const spectra,
+                                                                      const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                                                                      const Fit_Parameters<T_real>* const seed_fit_params,
+                                                                      Fit_Parameters<T_real>& out_fit_params,
+                                                                      std::unordered_map<std::string, T_real>& out_counts,
+                                                                      bool* out_cold_refit)
+{
+    return _fit_spectra(model, spectra, elements_to_fit, seed_fit_params, out_fit_params, out_counts, out_cold_refit);
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+OPTIMIZER_OUTCOME Param_Optimized_Fit_Routine<T_real>::_fit_spectra(const models::Base_Model<T_real>* const model,
+                                                            const Spectra<T_real>* const spectra,
+                                                            const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                                                            const Fit_Parameters<T_real>* const seed_fit_params,
+                                                            Fit_Parameters<T_real>& fit_params,
+                                                            std::unordered_map<std::string, T_real>& out_counts,
+                                                            bool* out_cold_refit)
+{
+    if (out_cold_refit != nullptr)
+    {
+        *out_cold_refit = false;
+    }
     //int xmin = np.argmin(abs(x - (fitp.g.xmin - fitp.s.val[keywords.energy_pos[0]]) / fitp.s.val[keywords.energy_pos[1]]));
     //int xmax = np.argmin(abs(x - (fitp.g.xmax - fitp.s.val[keywords.energy_pos[0]]) / fitp.s.val[keywords.energy_pos[1]]));
     // fitp.g.xmin = MIN_ENERGY_TO_FIT
     // fitp.g.xmax = MAX_ENERGY_TO_FIT
 
     OPTIMIZER_OUTCOME ret_val = OPTIMIZER_OUTCOME::FAILED;
-    Fit_Parameters<T_real> fit_params = model->fit_parameters();
+    fit_params = model->fit_parameters();
     //Add fit param for number of iterations
     fit_params.add_parameter(Fit_Param<T_real>(STR_NUM_ITR));
     _add_elements_to_fit_parameters(&fit_params, spectra, elements_to_fit);
@@ -209,7 +243,40 @@ OPTIMIZER_OUTCOME Param_Optimized_Fit_Routine<T_real>::fit_spectra(const models:
 
     if(_optimizer != nullptr)
     {
-        ret_val = _optimizer->minimize(&fit_params, spectra, elements_to_fit, model, _energy_range, false);
+        if (seed_fit_params != nullptr)
+        {
+            //keep the default start in case the warm start does not converge
+            Fit_Parameters<T_real> cold_fit_params = fit_params;
+            for (const auto& itr : *seed_fit_params)
+            {
+                //only fitted values, not the previous fit's bookkeeping
+                if (itr.first == STR_NUM_ITR || itr.first == STR_RESIDUAL || itr.first == STR_OUTCOME)
+                {
+                    continue;
+                }
+                if (itr.second.bound_type != E_Bound_Type::FIXED && fit_params.contains(itr.first) && fit_params[itr.first].bound_type != E_Bound_Type::FIXED)
+                {
+                    fit_params[itr.first].value = itr.second.value;
+                }
+            }
+            ret_val = _optimizer->minimize(&fit_params, spectra, elements_to_fit, model, _energy_range, false);
+            if (false == optimizer_outcome_converged(ret_val))
+            {
+                T_real warm_itr = fit_params.value(STR_NUM_ITR);
+                if (out_cold_refit != nullptr)
+                {
+                    *out_cold_refit = true;
+                }
+                fit_params = cold_fit_params;
+                ret_val = _optimizer->minimize(&fit_params, spectra, elements_to_fit, model, _energy_range, false);
+                //count evaluations of both attempts
+                fit_params[STR_NUM_ITR].value += warm_itr;
+            }
+        }
+        else
+        {
+            ret_val = _optimizer->minimize(&fit_params, spectra, elements_to_fit, model, _energy_range, false);
+        }
 
         //Save the counts from fit parameters into fit count dict for each element
         for (auto el_itr : *elements_to_fit)
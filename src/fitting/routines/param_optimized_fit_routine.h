@@ -82,6 +82,20 @@ public:
                                           Fit_Parameters<T_real>& out_fit_params,
                                           Callback_Func_Status_Def* status_callback = nullptr);
 
+    /**
+     * @brief fit_spectra_warm_start : Same as fit_spectra but starts the optimizer from seed_fit_params (usually the
+     *                                 converged parameters of a neighbouring pixel). If the warm start does not converge
+     *                                 the spectra is refit from the default start and out_cold_refit is set.
+     *                                 Pass nullptr as seed for a cold start.
+     */
+    OPTIMIZER_OUTCOME fit_spectra_warm_start(const models::Base_Model<T_real>* const model,
+                                             const Spectra<T_real>* const spectra,
+                                             const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                                             const Fit_Parameters<T_real>* const seed_fit_params,
+                                             Fit_Parameters<T_real>& out_fit_params,
+                                             std::unordered_map<std::string, T_real>& out_counts,
+                                             bool* out_cold_refit = nullptr);
+
     virtual std::string get_name() { return STR_FIT_GAUSS_TAILS; }
 
     virtual void initialize(models::Base_Model<T_real>* const model,
@@ -94,6 +108,10 @@ public:
 
      const Range& energy_range() { return _energy_range; }
 
+     void set_warm_start(bool val) { _warm_start = val; }
+
+     bool warm_start() const { return _warm_start; }
+
 protected:
 
     void _add_elements_to_fit_parameters(Fit_Parameters<T_real>* fit_params,
@@ -103,12 +121,22 @@ protected:
     void _calc_and_update_coherent_amplitude(Fit_Parameters<T_real>* fitp,
                                              const Spectra<T_real>* const spectra);
 
+    OPTIMIZER_OUTCOME _fit_spectra(const models::Base_Model<T_real>* const model,
+                                   const Spectra<T_real>* const spectra,
+                                   const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                                   const Fit_Parameters<T_real>* const seed_fit_params,
+                                   Fit_Parameters<T_real>& fit_params,
+                                   std::unordered_map<std::string, T_real>& out_counts,
+                                   bool* out_cold_refit = nullptr);
+
     Optimizer<T_real>* _optimizer;
 
     Range _energy_range;
 
     bool _update_coherent_amplitude_on_fit;
 
+    bool _warm_start;
+
 private:
 
 
@@ -59,7 +59,8 @@ namespace routines
 template<typename T_real>
 ROI_Fit_Routine<T_real>::ROI_Fit_Routine() : Base_Fit_Routine<T_real>()
 {
-
+    _roi_energy_offset = (T_real)0.0;
+    _roi_energy_slope = (T_real)0.0;
 }
 
 // --------------------------------------------------------------------------------------------------------------------
@@ -72,39 +73,96 @@ ROI_Fit_Routine<T_real>::~ROI_Fit_Routine()
 
 // --------------------------------------------------------------------------------------------------------------------
 
+template<typename T_real>
+void ROI_Fit_Routine<T_real>::_resolve_rois(const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                                    T_real energy_offset,
+                                    T_real energy_slope,
+                                    std::vector<std::pair<std::string, Range>>& out_rois) const
+{
+    out_rois.clear();
+    for (const auto& e_itr : *elements_to_fit)
+    {
+        Fit_Element_Map<T_real>* element = e_itr.second;
+        if (element != nullptr)
+        {
+            Range roi;
+            roi.min = static_cast<unsigned int>(std::round(((element->center() - element->width()) - energy_offset) / energy_slope));
+            roi.max = static_cast<unsigned int>(std::round(((element->center() + element->width()) - energy_offset) / energy_slope));
+            out_rois.emplace_back(e_itr.first, roi);
+        }
+    }
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
+template<typename T_real>
+bool ROI_Fit_Routine<T_real>::_rois_match(const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                                          T_real energy_offset,
+                                          T_real energy_slope) const
+{
+    if (energy_offset != _roi_energy_offset || energy_slope != _roi_energy_slope)
+    {
+        return false;
+    }
+    // same elements in the same order with the same center and width, wherever the dictionary lives
+    size_t i = 0;
+    for (const auto& e_itr : *elements_to_fit)
+    {
+        Fit_Element_Map<T_real>* element = e_itr.second;
+        if (element != nullptr)
+        {
+            if (i >= _rois.size()
+                || _rois[i].first != e_itr.first
+                || _roi_energies[i].first != element->center()
+                || _roi_energies[i].second != element->width())
+            {
+                return false;
+            }
+            i++;
+        }
+    }
+    return i == _rois.size();
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
 template<typename T_real>
 optimizers::OPTIMIZER_OUTCOME ROI_Fit_Routine<T_real>::fit_spectra(const models::Base_Model<T_real>* const model,
                                                             const Spectra<T_real>* const spectra,
                                                             const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
                                                             std::unordered_map<std::string, T_real>& out_counts)
  {    
-    Fit_Parameters<T_real> fitp = model->fit_parameters();
+    const Fit_Parameters<T_real>& fitp = model->fit_parameters();
     unsigned int n_mca_channels = spectra->size();
 
     T_real energy_offset = fitp.value(STR_ENERGY_OFFSET);
     T_real energy_slope = fitp.value(STR_ENERGY_SLOPE);
-    for(const auto& e_itr : *elements_to_fit)
+
+    const std::vector<std::pair<std::string, Range>>* rois = &_rois;
+    std::vector<std::pair<std::string, Range>> tmp_rois;
+    // not initialized for these elements or calibration changed since, resolve for this call only
+    if (false == _rois_match(elements_to_fit, energy_offset, energy_slope))
     {
-        unsigned int left_roi = 0;
-        unsigned int right_roi = 0;
-        Fit_Element_Map<T_real>* element = e_itr.second;
-        if (element != nullptr)
-        {
-            left_roi = static_cast<unsigned int>(std::round(((element->center() - element->width()) - energy_offset) / energy_slope));
-            right_roi = static_cast<unsigned int>(std::round(((element->center() + element->width()) - energy_offset) / energy_slope));
+        _resolve_rois(elements_to_fit, energy_offset, energy_slope, tmp_rois);
+        rois = &tmp_rois;
+    }
 
-            if (right_roi >= n_mca_channels)
-            {
-                right_roi = n_mca_channels - 2;
-            }
-            if (left_roi > right_roi)
-            {
-                left_roi = right_roi - 1;
-            }
+    for (const auto& roi_itr : *rois)
+    {
+        unsigned int left_roi = static_cast<unsigned int>(roi_itr.second.min);
+        unsigned int right_roi = static_cast<unsigned int>(roi_itr.second.max);
 
-            size_t spec_size = (right_roi - left_roi) + 1;
-            out_counts[e_itr.first] = spectra->segment(left_roi, spec_size).sum();
+        if (right_roi >= n_mca_channels)
+        {
+            right_roi = n_mca_channels - 2;
+        }
+        if (left_roi > right_roi)
+        {
+            left_roi = right_roi - 1;
         }
+
+        size_t spec_size = (right_roi - left_roi) + 1;
+        out_counts[roi_itr.first] = spectra->segment(left_roi, spec_size).sum();
     }
     return optimizers::OPTIMIZER_OUTCOME::CONVERGED;
 }
@@ -116,7 +174,18 @@ void ROI_Fit_Routine<T_real>::initialize(models::Base_Model<T_real>* const model
                                  const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
                                  const struct Range energy_range)
 {
-    //N/A
+    const Fit_Parameters<T_real>& fitp = model->fit_parameters();
+    _roi_energy_offset = fitp.value(STR_ENERGY_OFFSET);
+    _roi_energy_slope = fitp.value(STR_ENERGY_SLOPE);
+    _resolve_rois(elements_to_fit, _roi_energy_offset, _roi_energy_slope, _rois);
+    _roi_energies.clear();
+    for (const auto& e_itr : *elements_to_fit)
+    {
+        if (e_itr.second != nullptr)
+        {
+            _roi_energies.emplace_back(e_itr.second->center(), e_itr.second->width());
+        }
+    }
 }
 
 // --------------------------------------------------------------------------------------------------------------------
@@ -81,6 +81,32 @@ public:
 
 protected:
 
+    /**
+     * @brief _resolve_rois : compute the left / right channel of each element roi from the energy calibration
+     */
+    void _resolve_rois(const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                       T_real energy_offset,
+                       T_real energy_slope,
+                       std::vector<std::pair<std::string, Range>>& out_rois) const;
+
+    /**
+     * @brief _rois_match : true if _rois were resolved for the same element names, centers and widths and the same energy calibration
+     */
+    bool _rois_match(const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                     T_real energy_offset,
+                     T_real energy_slope) const;
+
+    //element rois resolved in initialize so they are not recomputed per pixel
+    std::vector<std::pair<std::string, Range>> _rois;
+
+    //center and width of the element of each roi in _rois
+    std::vector<std::pair<T_real, T_real>> _roi_energies;
+
+    T_real _roi_energy_offset;
+
+    T_real _roi_energy_slope;
+
+
 
 
 
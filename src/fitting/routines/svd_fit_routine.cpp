@@ -49,8 +49,6 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "svd_fit_routine.h"
 
-#include <Eigen/SVD>
-
 namespace fitting
 {
 namespace routines
@@ -93,6 +91,8 @@ void SVD_Fit_Routine<T_real>::_generate_fitmatrix()
         _element_row_index[itr.first] = i;
         i++;
     }
+    //factor once, solve() is const so every pixel and basis spectrum reuses it
+    _svd.compute(_fitmatrix, Eigen::ComputeThinU | Eigen::ComputeThinV);
 
 }
 
@@ -104,7 +104,6 @@ optimizers::OPTIMIZER_OUTCOME SVD_Fit_Routine<T_real>::fit_spectra(const models:
                                                            const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
                                                            std::unordered_map<std::string, T_real>& out_counts)
 {
-    Eigen::JacobiSVD<Eigen::Matrix<T_real, Eigen::Dynamic, Eigen::Dynamic> > svd(_fitmatrix, Eigen::ComputeThinU | Eigen::ComputeThinV );
     VectorTr<T_real> rhs = spectra->segment(this->_energy_range.min, this->_energy_range.count());
 
     Fit_Parameters<T_real> fit_params = model->fit_parameters();
@@ -131,7 +130,7 @@ optimizers::OPTIMIZER_OUTCOME SVD_Fit_Routine<T_real>::fit_spectra(const models:
 
     ArrayTr<T_real> spectra_model = background;
 
-    VectorTr<T_real> result = svd.solve(rhs);
+    VectorTr<T_real> result = _svd.solve(rhs);
 
     for(const auto& itr : *elements_to_fit)
     {
@@ -151,7 +150,7 @@ optimizers::OPTIMIZER_OUTCOME SVD_Fit_Routine<T_real>::fit_spectra(const models:
     {
         std::lock_guard<std::mutex> lock(this->_int_spec_mutex);
         this->_integrated_fitted_spectra.add(spectra_model);
-        //_integrated_background.add(background);
+        this->_integrated_background.add(Spectra<T_real>(background.array()));
     }
 
     out_counts[STR_RESIDUAL] = (_fitmatrix * result - rhs).norm();
@@ -161,6 +160,27 @@ optimizers::OPTIMIZER_OUTCOME SVD_Fit_Routine<T_real>::fit_spectra(const models:
 
 // ----------------------------------------------------------------------------
 
+template<typename T_real>
+bool SVD_Fit_Routine<T_real>::fit_counts(const ArrayTr<T_real>& rhs,
+                                         const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                                         std::unordered_map<std::string, T_real>& out_counts,
+                                         ArrayTr<T_real>& out_model)
+{
+    VectorTr<T_real> result = _svd.solve(rhs.matrix());
+
+    out_model.setZero(this->_energy_range.count());
+    for (const auto& itr : *elements_to_fit)
+    {
+        int idx = _element_row_index.at(itr.first);
+        out_counts[itr.first] = result[idx];
+        out_model += _fitmatrix.col(idx).array() * result[idx];
+    }
+    out_counts[STR_NUM_ITR] = 0;
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
 template<typename T_real>
 void SVD_Fit_Routine<T_real>::initialize(models::Base_Model<T_real>* const model,
                                  const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
@@ -174,6 +194,17 @@ void SVD_Fit_Routine<T_real>::initialize(models::Base_Model<T_real>* const model
 
 // ----------------------------------------------------------------------------
 
+template<typename T_real>
+void SVD_Fit_Routine<T_real>::initialize_with_element_models(const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                                                     const struct Range energy_range,
+                                                     const std::unordered_map<std::string, Spectra<T_real>>& element_models)
+{
+    Matrix_Optimized_Fit_Routine<T_real>::initialize_with_element_models(elements_to_fit, energy_range, element_models);
+    _generate_fitmatrix();
+}
+
+// ----------------------------------------------------------------------------
+
 TEMPLATE_CLASS_DLL_EXPORT SVD_Fit_Routine<float>;
 TEMPLATE_CLASS_DLL_EXPORT SVD_Fit_Routine<double>;
 
@@ -53,6 +53,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "fitting/routines/matrix_optimized_fit_routine.h"
 
 #include <Eigen/Core>
+#include <Eigen/SVD>
 
 namespace fitting
 {
@@ -76,12 +77,22 @@ public:
                                                       std::unordered_map<std::string, T_real>& out_counts);
 
 
+    virtual bool fit_counts(const ArrayTr<T_real>& rhs,
+                            const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                            std::unordered_map<std::string, T_real>& out_counts,
+                            ArrayTr<T_real>& out_model);
+
+
     virtual std::string get_name() { return STR_FIT_SVD; }
 
     virtual void initialize(models::Base_Model<T_real>* const model,
                             const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
                             const struct Range energy_range);
 
+    virtual void initialize_with_element_models(const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                                                const struct Range energy_range,
+                                                const std::unordered_map<std::string, Spectra<T_real>>& element_models);
+
 protected:
 
     void _generate_fitmatrix();
@@ -90,6 +101,8 @@ private:
 
     Eigen::Matrix<T_real, Eigen::Dynamic, Eigen::Dynamic> _fitmatrix;
 
+    Eigen::JacobiSVD<Eigen::Matrix<T_real, Eigen::Dynamic, Eigen::Dynamic> > _svd;
+
     std::unordered_map<std::string, int> _element_row_index;
 
 };
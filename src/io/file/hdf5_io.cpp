@@ -223,6 +223,56 @@ bool HDF5_IO::_open_or_create_group(const std::string name, hid_t parent_id, hid
 
 //-----------------------------------------------------------------------------
 
+hsize_t HDF5_IO::_roi_band_rows(hsize_t num_chan, hsize_t num_cols, hsize_t chunk_rows, size_t value_bytes)
+{
+    // a band spans one chunk row; cap it so the read buffer stays bounded for chunks that span the whole frame
+    const size_t max_band_bytes = 256 * 1024 * 1024;
+    return std::max<hsize_t>(1, std::min<hsize_t>(chunk_rows, max_band_bytes / std::max<hsize_t>(1, num_chan * num_cols * value_bytes)));
+}
+
+//-----------------------------------------------------------------------------
+
+void HDF5_IO::_set_band_chunk_cache(hid_t parent_id, const std::string& name, size_t value_bytes, hid_t dapl_id)
+{
+    // opened and closed here so the dataset is not shared with the cached open that follows
+    hid_t dset_id = H5Dopen2(parent_id, name.c_str(), H5P_DEFAULT);
+    if (dset_id < 0)
+    {
+        return;
+    }
+    hid_t dataspace_id = H5Dget_space(dset_id);
+    hid_t dcpl_id = H5Dget_create_plist(dset_id);
+    hid_t file_type = H5Dget_type(dset_id);
+    hsize_t dims[3] = { 0,0,0 };
+    hsize_t chunk_dims[3] = { 1,1,1 };
+    if (H5Sget_simple_extent_ndims(dataspace_id) == 3 && H5Sget_simple_extent_dims(dataspace_id, &dims[0], nullptr) > -1
+        && H5Pget_layout(dcpl_id) == H5D_CHUNKED && H5Pget_chunk(dcpl_id, 3, chunk_dims) > -1)
+    {
+        hsize_t band_rows = _roi_band_rows(dims[0], dims[2], chunk_dims[1], value_bytes);
+        if (band_rows < chunk_dims[1])
+        {
+            // bands split the chunk rows, cache one chunk row so each chunk is only decompressed once
+            hsize_t chunks_per_row = ((dims[0] + chunk_dims[0] - 1) / chunk_dims[0]) * ((dims[2] + chunk_dims[2] - 1) / chunk_dims[2]);
+            size_t cache_bytes = chunks_per_row * chunk_dims[0] * chunk_dims[1] * chunk_dims[2] * H5Tget_size(file_type);
+            long long avail_mem = get_available_mem();
+            if (avail_mem > 0 && (long long)cache_bytes < avail_mem / 4)
+            {
+                H5Pset_chunk_cache(dapl_id, std::max<size_t>(521, chunks_per_row * 100), cache_bytes, 0.0);
+            }
+            else
+            {
+                logW << name << " chunk row of " << cache_bytes << " bytes does not fit in memory, chunks are decompressed once per band of " << band_rows << " rows\n";
+            }
+        }
+    }
+    H5Tclose(file_type);
+    H5Pclose(dcpl_id);
+    H5Sclose(dataspace_id);
+    H5Dclose(dset_id);
+}
+
+//-----------------------------------------------------------------------------
+
 bool HDF5_IO::_create_memory_space(int rank, const hsize_t* count, hid_t& out_id)
 {
     out_id = H5Screate_simple(rank, count, nullptr);
@@ -508,6 +558,19 @@ bool HDF5_IO::end_save_seq(bool loginfo)
 
 //-----------------------------------------------------------------------------
 
+bool HDF5_IO::flush()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    if (_cur_file_id < 0)
+    {
+        return false;
+    }
+    return H5Fflush(_cur_file_id, H5F_SCOPE_LOCAL) >= 0;
+}
+
+//-----------------------------------------------------------------------------
+
 bool HDF5_IO::_save_extras(hid_t scan_grp_id, std::vector<data_struct::Extra_PV>* extra_pvs)
 {
     hid_t memoryspace_id;
@@ -57,6 +57,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <queue>
 #include <future>
 #include <map>
+#include <set>
 #include <stack>
 #include <type_traits>
 #include "hdf5.h"
@@ -3201,6 +3202,323 @@ public:
  
     //-----------------------------------------------------------------------------
 
+    /**
+    * Integrated spectra for many rois in one sweep over mca_arr. Rows are walked in chunk sized bands and
+    * only the chunk columns holding roi pixels are read, each once, so overlapping rois share the same read.
+    * Returns false if any read fails, the roi spectra are incomplete then.
+    */
+    template<typename T_real>
+    bool load_integrated_spectra_analyzed_h5_rois(std::string path, const std::map<std::string, ROI_Vec>& rois, std::map<std::string, data_struct::Spectra<T_real>>& out_int_spectra)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        bool is_v9 = false;
+        std::chrono::time_point<std::chrono::system_clock> start, end;
+        start = std::chrono::system_clock::now();
+
+        std::stack<std::pair<hid_t, H5_OBJECTS> > close_map;
+
+        logI << path << " rois: " << rois.size() << "\n";
+
+        hid_t    file_id, dset_id, dataspace_id, spec_grp_id, dset_incnt_id, dset_outcnt_id;
+        hid_t   memoryspace_1;
+        hid_t    dset_rt_id, dset_lt_id, dset_scalers, dset_scaler_names;
+        hid_t    dataspace_lt_id, dataspace_rt_id, dataspace_inct_id, dataspace_outct_id, dataspace_scalers, dataspace_scaler_names;
+        herr_t   error;
+        hsize_t dims_in[3] = { 0,0,0 };
+        hsize_t chunk_dims[3] = { 1,1,1 };
+        hsize_t offset_1[1] = { 0 };
+        hsize_t count_1[1] = { 1 };
+
+        hsize_t elt_off = -1, ert_off = -1, in_off = -1, out_off = -1;
+
+        if (false == _open_h5_object(file_id, H5O_FILE, close_map, path, -1, false))
+            return false;
+
+        if (false == _open_h5_object(spec_grp_id, H5O_GROUP, close_map, "/MAPS/Spectra", file_id, false, false))
+        {
+            if (false == _open_h5_object(spec_grp_id, H5O_GROUP, close_map, "/MAPS", file_id))
+            {
+                return false;
+            }
+        }
+
+        // the chunk cache is fixed when mca_arr is opened, so size it for the row bands first
+        hid_t dapl_id = H5Pcreate(H5P_DATASET_ACCESS);
+        close_map.push({ dapl_id, H5O_PROPERTY });
+        _set_band_chunk_cache(spec_grp_id, "mca_arr", sizeof(T_real), dapl_id);
+        dset_id = H5Dopen2(spec_grp_id, "mca_arr", dapl_id);
+        if (dset_id < 0)
+        {
+            _close_h5_objects(close_map);
+            logW << "Failed to open dataset mca_arr\n";
+            return false;
+        }
+        close_map.push({ dset_id, H5O_DATASET });
+
+        dataspace_id = H5Dget_space(dset_id);
+        close_map.push({ dataspace_id, H5O_DATASPACE });
+
+        if (false == _open_h5_object(dset_lt_id, H5O_DATASET, close_map, "Elapsed_Livetime", spec_grp_id, false, false))
+        {
+            if (false == _open_h5_object(dset_scalers, H5O_DATASET, close_map, "scalers", spec_grp_id))
+            {
+                return false;
+            }
+            if (false == _open_h5_object(dset_scaler_names, H5O_DATASET, close_map, "scaler_names", spec_grp_id))
+            {
+                return false;
+            }
+            dataspace_scalers = H5Dget_space(dset_scalers);
+            close_map.push({ dataspace_scalers, H5O_DATASPACE });
+
+            dataspace_scaler_names = H5Dget_space(dset_scaler_names);
+            close_map.push({ dataspace_scaler_names, H5O_DATASPACE });
+            hid_t memtype = H5Dget_type(dset_scaler_names);
+            close_map.push({ memtype, H5O_DATATYPE });
+
+            //  read scaler names and search for elt1, ert1, incnt1, outcnt1
+            hsize_t dims_out[1];
+            H5Sget_simple_extent_dims(dataspace_scaler_names, &dims_out[0], nullptr);
+            char tmp_name[256] = { 0 };
+            memoryspace_1 = H5Screate_simple(1, count_1, nullptr);
+            close_map.push({ memoryspace_1, H5O_DATASPACE });
+            for (hsize_t idx = 0; idx < dims_out[0]; idx++)
+            {
+                offset_1[0] = idx;
+                memset(&tmp_name[0], 0, 254);
+                H5Sselect_hyperslab(dataspace_scaler_names, H5S_SELECT_SET, offset_1, nullptr, count_1, nullptr);
+                error = H5Dread(dset_scaler_names, memtype, memoryspace_1, dataspace_scaler_names, H5P_DEFAULT, (void*)&tmp_name[0]);
+                if (error == 0)
+                {
+                    std::string name = std::string(tmp_name);
+
+                    if (name == STR_ELT + "1")
+                    {
+                        elt_off = idx;
+                    }
+                    else if (name == STR_ERT + "1")
+                    {
+                        ert_off = idx;
+                    }
+                    else if (name == STR_ICR + "1")
+                    {
+                        in_off = idx;
+                    }
+                    else if (name == STR_OCR + "1")
+                    {
+                        out_off = idx;
+                    }
+                }
+            }
+            is_v9 = true;
+        }
+        else
+        {
+            dataspace_lt_id = H5Dget_space(dset_lt_id);
+            close_map.push({ dataspace_lt_id, H5O_DATASPACE });
+
+            if (false == _open_h5_object(dset_rt_id, H5O_DATASET, close_map, "Elapsed_Realtime", spec_grp_id))
+                return false;
+            dataspace_rt_id = H5Dget_space(dset_rt_id);
+            close_map.push({ dataspace_rt_id, H5O_DATASPACE });
+
+            if (false == _open_h5_object(dset_incnt_id, H5O_DATASET, close_map, "Input_Counts", spec_grp_id))
+                return false;
+            dataspace_inct_id = H5Dget_space(dset_incnt_id);
+            close_map.push({ dataspace_inct_id, H5O_DATASPACE });
+
+            if (false == _open_h5_object(dset_outcnt_id, H5O_DATASET, close_map, "Output_Counts", spec_grp_id))
+                return false;
+            dataspace_outct_id = H5Dget_space(dset_outcnt_id);
+            close_map.push({ dataspace_outct_id, H5O_DATASPACE });
+        }
+
+        int rank = H5Sget_simple_extent_ndims(dataspace_id);
+        if (rank != 3)
+        {
+            _close_h5_objects(close_map);
+            logE << "Dataset /MAPS/Spectra/mca_arr  rank != 3. rank = " << rank << ". Can't load dataset. returning" << "\n";
+            return false;
+        }
+
+        if (H5Sget_simple_extent_dims(dataspace_id, &dims_in[0], nullptr) < 0)
+        {
+            _close_h5_objects(close_map);
+            logE << "getting dataset dims for /MAPS/Spectra/mca_arr" << "\n";
+            return false;
+        }
+
+        hid_t dcpl_id = H5Dget_create_plist(dset_id);
+        close_map.push({ dcpl_id, H5O_PROPERTY });
+        if (H5Pget_layout(dcpl_id) == H5D_CHUNKED)
+        {
+            H5Pget_chunk(dcpl_id, 3, chunk_dims);
+        }
+        const hsize_t num_chan = dims_in[0];
+        const hsize_t num_rows = dims_in[1];
+        const hsize_t num_cols = dims_in[2];
+        const hsize_t chunk_cols = std::max<hsize_t>(1, chunk_dims[2]);
+        hsize_t band_rows = _roi_band_rows(num_chan, num_cols, chunk_dims[1], sizeof(T_real));
+
+        // roi pixel lookup: row -> col -> rois holding that pixel
+        std::vector<data_struct::Spectra<T_real>*> roi_spectra;
+        std::vector<std::map<hsize_t, std::vector<size_t>>> row_pixels(num_rows);
+        for (const auto& itr : rois)
+        {
+            data_struct::Spectra<T_real>& int_spectra = out_int_spectra[itr.first];
+            int_spectra.resize(num_chan);
+            int_spectra.setZero(num_chan);
+            int_spectra.elapsed_livetime(0);
+            int_spectra.elapsed_realtime(0);
+            int_spectra.input_counts(0);
+            int_spectra.output_counts(0);
+            size_t roi_idx = roi_spectra.size();
+            roi_spectra.push_back(&int_spectra);
+            for (const auto& pix : itr.second)
+            {
+                if (pix.first < 0 || pix.second < 0 || (hsize_t)pix.second >= num_rows || (hsize_t)pix.first >= num_cols)
+                {
+                    logW << "Roi " << itr.first << " pixel row " << pix.second << " col " << pix.first << " is outside of the dataset, skipping\n";
+                    continue;
+                }
+                row_pixels[pix.second][pix.first].push_back(roi_idx);
+            }
+        }
+
+        std::vector<T_real> buffer;
+        std::vector<T_real> live_time, real_time, in_cnt, out_cnt;
+        data_struct::Spectra<T_real> spectra(num_chan);
+        size_t num_reads = 0;
+        size_t bytes_read = 0;
+
+        for (hsize_t row = 0; row < num_rows; row += band_rows)
+        {
+            hsize_t band_end = std::min(row + band_rows, num_rows);
+            // chunk columns touched by any roi in this band
+            std::set<hsize_t> chunk_col_idxs;
+            for (hsize_t r = row; r < band_end; r++)
+            {
+                for (const auto& pix : row_pixels[r])
+                {
+                    chunk_col_idxs.insert(pix.first / chunk_cols);
+                }
+            }
+
+            auto chunk_itr = chunk_col_idxs.begin();
+            while (chunk_itr != chunk_col_idxs.end())
+            {
+                // merge neighbouring chunk columns into one read
+                hsize_t first_chunk = *chunk_itr;
+                hsize_t last_chunk = first_chunk;
+                for (++chunk_itr; chunk_itr != chunk_col_idxs.end() && *chunk_itr == last_chunk + 1; ++chunk_itr)
+                {
+                    last_chunk = *chunk_itr;
+                }
+                hsize_t col = first_chunk * chunk_cols;
+                hsize_t col_end = std::min((last_chunk + 1) * chunk_cols, num_cols);
+
+                hsize_t offset[3] = { 0, row, col };
+                hsize_t count[3] = { num_chan, band_end - row, col_end - col };
+                hsize_t offset_time[2] = { row, col };
+                hsize_t count_time[2] = { count[1], count[2] };
+                size_t band_pixels = count[1] * count[2];
+
+                buffer.resize(num_chan * band_pixels);
+                live_time.assign(band_pixels, 1.0);
+                real_time.assign(band_pixels, 1.0);
+                in_cnt.assign(band_pixels, 1.0);
+                out_cnt.assign(band_pixels, 1.0);
+
+                hid_t memoryspace_id = H5Screate_simple(3, count, nullptr);
+                H5Sselect_hyperslab(dataspace_id, H5S_SELECT_SET, offset, nullptr, count, nullptr);
+                error = _read_h5d<T_real>(dset_id, memoryspace_id, dataspace_id, H5P_DEFAULT, (void*)buffer.data());
+                H5Sclose(memoryspace_id);
+                if (error < 0)
+                {
+                    _close_h5_objects(close_map);
+                    logE << "Counld not read rows " << row << ":" << band_end << " cols " << col << ":" << col_end << "\n";
+                    return false;
+                }
+                num_reads++;
+                bytes_read += buffer.size() * sizeof(T_real);
+
+                hid_t memoryspace_meta_id = H5Screate_simple(2, count_time, nullptr);
+                if (is_v9)
+                {
+                    hsize_t offset_s[3] = { 0, row, col };
+                    hsize_t count_s[3] = { 1, count[1], count[2] };
+                    std::pair<hsize_t, std::vector<T_real>*> scaler_offsets[4] = { {elt_off, &live_time}, {ert_off, &real_time}, {in_off, &in_cnt}, {out_off, &out_cnt} };
+                    for (auto& s_itr : scaler_offsets)
+                    {
+                        offset_s[0] = s_itr.first;
+                        H5Sselect_hyperslab(dataspace_scalers, H5S_SELECT_SET, offset_s, nullptr, count_s, nullptr);
+                        error = _read_h5d<T_real>(dset_scalers, memoryspace_meta_id, dataspace_scalers, H5P_DEFAULT, (void*)s_itr.second->data());
+                        if (error < 0)
+                        {
+                            s_itr.second->assign(band_pixels, 0.0);
+                        }
+                    }
+                }
+                else
+                {
+                    H5Sselect_hyperslab(dataspace_lt_id, H5S_SELECT_SET, offset_time, nullptr, count_time, nullptr);
+                    H5Sselect_hyperslab(dataspace_rt_id, H5S_SELECT_SET, offset_time, nullptr, count_time, nullptr);
+                    H5Sselect_hyperslab(dataspace_inct_id, H5S_SELECT_SET, offset_time, nullptr, count_time, nullptr);
+                    H5Sselect_hyperslab(dataspace_outct_id, H5S_SELECT_SET, offset_time, nullptr, count_time, nullptr);
+
+                    if (_read_h5d<T_real>(dset_rt_id, memoryspace_meta_id, dataspace_rt_id, H5P_DEFAULT, (void*)real_time.data()) < 0
+                        || _read_h5d<T_real>(dset_lt_id, memoryspace_meta_id, dataspace_lt_id, H5P_DEFAULT, (void*)live_time.data()) < 0
+                        || _read_h5d<T_real>(dset_incnt_id, memoryspace_meta_id, dataspace_inct_id, H5P_DEFAULT, (void*)in_cnt.data()) < 0
+                        || _read_h5d<T_real>(dset_outcnt_id, memoryspace_meta_id, dataspace_outct_id, H5P_DEFAULT, (void*)out_cnt.data()) < 0)
+                    {
+                        H5Sclose(memoryspace_meta_id);
+                        _close_h5_objects(close_map);
+                        logE << "Counld not read elapsed time or counts for rows " << row << ":" << band_end << " cols " << col << ":" << col_end << "\n";
+                        return false;
+                    }
+                }
+                H5Sclose(memoryspace_meta_id);
+
+                for (hsize_t r = row; r < band_end; r++)
+                {
+                    for (auto pix_itr = row_pixels[r].lower_bound(col); pix_itr != row_pixels[r].end() && pix_itr->first < col_end; ++pix_itr)
+                    {
+                        size_t pix_idx = (r - row) * count[2] + (pix_itr->first - col);
+                        for (hsize_t c = 0; c < num_chan; c++)
+                        {
+                            spectra(c) = buffer[(c * band_pixels) + pix_idx];
+                        }
+                        spectra.elapsed_livetime(live_time[pix_idx]);
+                        spectra.elapsed_realtime(real_time[pix_idx]);
+                        spectra.input_counts(in_cnt[pix_idx]);
+                        spectra.output_counts(out_cnt[pix_idx]);
+                        for (size_t roi_idx : pix_itr->second)
+                        {
+                            roi_spectra[roi_idx]->add(spectra);
+                        }
+                    }
+                }
+            }
+        }
+
+        for (auto* int_spectra : roi_spectra)
+        {
+            int_spectra->recalc_elapsed_livetime();
+        }
+
+        _close_h5_objects(close_map);
+
+        end = std::chrono::system_clock::now();
+        std::chrono::duration<double> elapsed_seconds = end - start;
+
+        logI << "reads: " << num_reads << " bytes: " << bytes_read << " elapsed time: " << elapsed_seconds.count() << "s\n";
+
+        return true;
+    }
+ 
+    //-----------------------------------------------------------------------------
+
     /**
     * Loads only Upstream/Downstream Ion chambers and SR_Current
     */
@@ -7157,6 +7475,9 @@ public:
     
     bool end_save_seq(bool loginfo = true);
 
+    //write what was saved so far to disk so other programs can read it while the file stays open
+    bool flush();
+
     //-----------------------------------------------------------------------------
 
     //export integrated spec, fitted, background into csv
@@ -8076,6 +8397,8 @@ private:
     bool _add_exchange_meta(hid_t file_id, std::string exchange_idx, std::string fits_link, std::string normalize_scaler);
 	
     bool _open_h5_object(hid_t &id, H5_OBJECTS obj, std::stack<std::pair<hid_t, H5_OBJECTS> > &close_map, std::string s1, hid_t id2, bool log_error=true, bool close_on_fail=true);
+    hsize_t _roi_band_rows(hsize_t num_chan, hsize_t num_cols, hsize_t chunk_rows, size_t value_bytes);
+    void _set_band_chunk_cache(hid_t parent_id, const std::string& name, size_t value_bytes, hid_t dapl_id);
     bool _open_or_create_group(const std::string name, hid_t parent_id, hid_t& out_id, bool log_error = true, bool close_on_fail = true);
     bool _create_memory_space(int rank, const hsize_t* count, hid_t& out_id);
     bool _open_h5_dataset(const std::string& name, hid_t data_type, hid_t parent_id, int dims_size, const hsize_t* dims, const hsize_t* chunk_dims, hid_t& out_id, hid_t& out_dataspece);
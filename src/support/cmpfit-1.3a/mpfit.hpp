@@ -84,6 +84,13 @@ struct mp_par
 /* Just a placeholder - do not use!! */
 typedef void (*mp_iterproc)(void);
 
+/* Optional hook that evaluates all numerical jacobian columns at once.
+   Column j is evaluated at x with x[ifree[j]] += h[j] and written to
+   out + j*m. Returns < 0 on user break. */
+template <typename _T>
+using mp_columns_func = int (*)(int m, int npar, const _T *x, int nfree, const int *ifree,
+                                const _T *h, _T *out, void *private_data);
+
 /* Definition of MPFIT configuration structure */
 template <typename _T>
 struct mp_config
@@ -116,6 +123,9 @@ struct mp_config
 		     */
   mp_iterproc iterproc; /* Placeholder pointer - must set to 0 */
 
+  mp_columns_func<_T> columns; /* 0, or evaluate one sided numerical
+                                  jacobian columns together (e.g. in parallel) */
+
 };
 
 /* Definition of results structure, for when fit completes */
@@ -361,7 +371,7 @@ int mp_fdjac2(int (*mp_func)(int m, int n, _T *x, _T *fvec, _T **dvec, void *pri
               _T *step, _T *dstep, int *dside,
               int *qulimited, _T *ulimit,
               int *ddebug, _T *ddrtol, _T *ddatol,
-              _T *wa2, _T **dvec)
+              _T *wa2, _T **dvec, mp_columns_func<_T> columns = 0)
 {
 /*
 *     **********
@@ -500,6 +510,41 @@ int mp_fdjac2(int (*mp_func)(int m, int n, _T *x, _T *fvec, _T **dvec, void *pri
            "IPNT", "FUNC", "DERIV_U", "DERIV_N", "DIFF_ABS", "DIFF_REL");
   }
 
+  /* All one sided numerical derivatives can be handed to the columns hook */
+  if (columns && has_numerical_deriv && !has_analytical_deriv) {
+    int one_sided = 1;
+    for (j=0; j<n; j++) {
+      if (dside && dside[ifree[j]] > 1) one_sided = 0;
+    }
+    if (one_sided) {
+      /* wa2 is npar long, hold the steps there */
+      for (j=0; j<n; j++) {
+        int dsidei = (dside)?(dside[ifree[j]]):(0);
+        temp = x[ifree[j]];
+        h = eps * fabs(temp);
+        if (step  &&  step[ifree[j]] > 0) h = step[ifree[j]];
+        if (dstep && dstep[ifree[j]] > 0) h = fabs(dstep[ifree[j]]*temp);
+        if (h == zero)                    h = eps;
+        if ((dside && dsidei == -1) ||
+            (dside && dsidei == 0 &&
+             qulimited && ulimit && qulimited[j] &&
+             (temp > (ulimit[j]-h)))) {
+          h = -h;
+        }
+        wa2[j] = h;
+      }
+      iflag = (*columns)(m, npar, x, n, ifree, wa2, fjac, priv);
+      if (nfev) *nfev = *nfev + n;
+      if (iflag < 0 ) goto DONE;
+      for (j=0; j<n; j++) {
+        for (i=0; i<m; i++) {
+          fjac[i+m*j] = (fjac[i+m*j] - fvec[i])/wa2[j];
+        }
+      }
+      goto DONE;
+    }
+  }
+
   /* Any parameters requiring numerical derivatives */
   if (has_numerical_deriv) for (j=0; j<n; j++) {  /* Loop thru free parms */
     int dsidei = (dside)?(dside[ifree[j]]):(0);
@@ -1808,6 +1853,7 @@ int mpfit(int (*mp_func)(int m, int n, _T *x, _T *fvec, _T **dvec, void *private
   conf.maxfev = 0;
   conf.covtol = (_T)1e-14;
   conf.nofinitecheck = 0;
+  conf.columns = 0;
 
   if (config) {
     /* Transfer any user-specified configurations */
@@ -1823,6 +1869,7 @@ int mpfit(int (*mp_func)(int m, int n, _T *x, _T *fvec, _T **dvec, void *private
     if (config->covtol > 0) conf.covtol = config->covtol;
     if (config->nofinitecheck > 0) conf.nofinitecheck = config->nofinitecheck;
     conf.maxfev = config->maxfev;
+    conf.columns = config->columns;
   }
 
   info = MP_ERR_INPUT; /* = 0 */
@@ -1981,7 +2028,7 @@ int mpfit(int (*mp_func)(int m, int n, _T *x, _T *fvec, _T **dvec, void *private
   iflag = mp_fdjac2(mp_func, m, nfree, ifree, npar, xnew, fvec, fjac, ldfjac,
                     conf.epsfcn, wa4, private_data, &nfev,
                     step, dstep, mpside, qulim, ulim,
-                    ddebug, ddrtol, ddatol, wa2, dvecptr);
+                    ddebug, ddrtol, ddatol, wa2, dvecptr, conf.columns);
   if (iflag < 0) {
     goto CLEANUP;
   }
@@ -887,7 +887,7 @@ void lmmin(const int n, _T* x, const int m, const void* data,
 
     /* Allocate total workspace with just one system call */
     char* ws;
-    if ((ws = (char*)malloc((2*m + 5*n + m*n) * sizeof(_T) + n * sizeof(int))) == NULL)
+    if ((ws = (char*)malloc((2*m + 6*n + m*n) * sizeof(_T) + n * sizeof(int))) == NULL)
     {
         S->outcome = 9;
         return;
@@ -911,6 +911,8 @@ void lmmin(const int n, _T* x, const int m, const void* data,
     pws += n * sizeof(_T) / sizeof(char);
     _T* wf = (_T*)pws;
     pws += m * sizeof(_T) / sizeof(char);
+    _T* steps = (_T*)pws;
+    pws += n * sizeof(_T) / sizeof(char);
     int* Pivot = (int*)pws;
     pws += n * sizeof(int) / sizeof(char);
 
@@ -956,7 +958,22 @@ void lmmin(const int n, _T* x, const int m, const void* data,
     for (int outer = 0;; ++outer) {
 
         /** Calculate the Jacobian. **/
-        for (j = 0; j < n; j++) {
+        if (C->evaluate_columns) {
+            for (j = 0; j < n; j++)
+                steps[j] = MAX(eps * eps, eps * std::fabs(x[j]));
+            (*C->evaluate_columns)(n, x, steps, m, data, fjac, &(S->userbreak));
+            S->nfev += n;
+            if (S->userbreak)
+                goto terminate;
+            for (j = 0; j < n; j++)
+            {
+                for (i = 0; i < m; i++)
+                {
+                    fjac[j * m + i] = (fjac[j * m + i] - fvec[i]) / steps[j];
+                }
+            }
+        }
+        else for (j = 0; j < n; j++) {
             temp = x[j];
             step = MAX(eps * eps, eps * std::fabs(temp));
             x[j] += step; /* replace temporarily */
@@ -47,6 +47,12 @@ struct lm_control_struct
     int verbosity;    /* OR'ed: 1: print some messages; 2: print Jacobian. */
     int n_maxpri;     /* -1, or max number of parameters to print. */
     int m_maxpri;     /* -1, or max number of residuals to print. */
+    void (*evaluate_columns)(const int n, const _T* x, const _T* step,
+                             const int m, const void* data, _T* fjac,
+                             int* userbreak);
+                      /* NULL, or evaluates all n forward difference columns
+                         at once: column j at x with x[j] += step[j], written
+                         to fjac + j*m. Lets the caller run them in parallel. */
 };
 
 /* Collection of output parameters for status info. */
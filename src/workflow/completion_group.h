@@ -0,0 +1,197 @@
+/***
+Copyright (c) 2016, UChicago Argonne, LLC. All rights reserved.
+
+Copyright 2016. UChicago Argonne, LLC. This software was produced
+under U.S. Government contract DE-AC02-06CH11357 for Argonne National
+Laboratory (ANL), which is operated by UChicago Argonne, LLC for the
+U.S. Department of Energy. The U.S. Government has rights to use,
+reproduce, and distribute this software.  NEITHER THE GOVERNMENT NOR
+UChicago Argonne, LLC MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR
+ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  If software is
+modified to produce derivative works, such modified software should
+be clearly marked, so as not to confuse it with the version available
+from ANL.
+
+Additionally, redistribution and use in source and binary forms, with
+or without modification, are permitted provided that the following
+conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the name of UChicago Argonne, LLC, Argonne National
+      Laboratory, ANL, the U.S. Government, nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY UChicago Argonne, LLC AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL UChicago
+Argonne, LLC OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+***/
+
+#ifndef COMPLETION_GROUP_H
+#define COMPLETION_GROUP_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace workflow
+{
+
+//-----------------------------------------------------------------------------
+
+/**
+ * @brief The Completion_Group class : Tracks a batch of pool tasks with shared counters instead of one future
+ *        per task. Wrap each task with track(), queue it with ThreadPool::enqueue_detached and wait() once.
+ *        Tasks returning false or throwing are counted as failed and their messages kept for the caller.
+ */
+class Completion_Group
+{
+public:
+
+    /// workers wake the waiter every progress_step completions to report progress
+    Completion_Group(size_t progress_step = 1) : _added(0), _done(0), _failed(0), _progress_step(progress_step > 0 ? progress_step : 1) {}
+
+    Completion_Group(const Completion_Group&) = delete;
+
+    Completion_Group& operator=(const Completion_Group&) = delete;
+
+    /// count f in this group. f returns bool (false is a failure) or void
+    template<class F>
+    auto track(F&& f)
+    {
+        _added++;
+        return [this, f = std::forward<F>(f)]() mutable
+        {
+            bool ok = true;
+            try
+            {
+                if constexpr (std::is_same<decltype(f()), void>::value)
+                {
+                    f();
+                }
+                else
+                {
+                    ok = (bool)f();
+                }
+            }
+            catch (const std::exception& e)
+            {
+                ok = false;
+                add_error(e.what());
+            }
+            catch (...)
+            {
+                ok = false;
+                add_error("unknown exception");
+            }
+            finished(ok);
+        };
+    }
+
+    /// block until every tracked task ran. progress(done, total) is called on this thread, at most once per progress_step tasks
+    bool wait(const std::function<void(size_t, size_t)>* progress = nullptr)
+    {
+        size_t reported = 0;
+        std::unique_lock<std::mutex> lock(_mutex);
+        for (;;)
+        {
+            _cond.wait(lock, [this, reported] { return _done == _added || _done >= reported + _progress_step; });
+            size_t done = _done;
+            size_t total = _added;
+            if (progress != nullptr && done > reported)
+            {
+                lock.unlock();
+                (*progress)(done, total);
+                lock.lock();
+            }
+            reported = done;
+            if (done == total)
+            {
+                break;
+            }
+        }
+        return _failed == 0;
+    }
+
+    size_t size() const { return _added; }
+
+    size_t num_done() const { return _done; }
+
+    size_t num_failed() const { return _failed; }
+
+    /// messages of the first failed tasks that threw
+    std::vector<std::string> errors()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _errors;
+    }
+
+private:
+
+    void add_error(const char* msg)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_errors.size() < 16)
+        {
+            _errors.push_back(msg);
+        }
+    }
+
+    void finished(bool ok)
+    {
+        // count under the lock and don't touch the group after releasing it: the waiter may return
+        // and destroy the group as soon as it sees the last count
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (false == ok)
+        {
+            _failed++;
+        }
+        size_t done = ++_done;
+        if (done == _added || (done % _progress_step) == 0)
+        {
+            _cond.notify_all();
+        }
+    }
+
+    std::atomic<size_t> _added;
+
+    std::atomic<size_t> _done;
+
+    std::atomic<size_t> _failed;
+
+    size_t _progress_step;
+
+    std::mutex _mutex;
+
+    std::condition_variable _cond;
+
+    std::vector<std::string> _errors;
+};
+
+//-----------------------------------------------------------------------------
+
+} //namespace workflow
+
+#endif
@@ -52,6 +52,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "core/defines.h"
 #include "threadpool.h"
+#include <deque>
 #include <functional>
 
 namespace workflow
@@ -87,8 +88,34 @@ public:
 
     void distribute(T_IN input)
     {
-        std::unique_lock<std::mutex> lock(_queue_mutex);
-        _job_queue.emplace( _thread_pool->enqueue(_dist_func, input) );
+        Result_Slot* slot;
+        {
+            std::unique_lock<std::mutex> lock(_queue_mutex);
+            _results.emplace_back();
+            slot = &_results.back();
+        }
+        // deque keeps slot addresses stable while other blocks are added and popped
+        _thread_pool->enqueue_detached([this, slot, input]()
+        {
+            T_OUT output = T_OUT();
+            bool failed = false;
+            try
+            {
+                output = _dist_func(input);
+            }
+            catch (const std::exception& e)
+            {
+                logE << "Distributor job failed: " << e.what() << "\n";
+                failed = true;
+            }
+            {
+                std::unique_lock<std::mutex> lock(_queue_mutex);
+                slot->output = output;
+                slot->failed = failed;
+                slot->ready = true;
+            }
+            _ready_cond.notify_all();
+        });
     }
 
     std::function<void (T_IN)> get_callback_func()
@@ -101,23 +128,34 @@ public:
         _dist_func = dist_func;
     }
 
-    inline bool is_queue_empty() { return _job_queue.empty(); }
+    /// true once every distributed job finished and was taken
+    inline bool is_queue_empty()
+    {
+        std::unique_lock<std::mutex> lock(_queue_mutex);
+        return _results.empty();
+    }
 
     T_OUT front_pop()
     {
         std::unique_lock<std::mutex> lock(_queue_mutex);
-        auto ret = std::move(_job_queue.front());
-        _job_queue.pop();
-        return ret.get();
+        _ready_cond.wait(lock, [this] { return _results.front().ready; });
+        T_OUT ret = _results.front().output;
+        _results.pop_front();
+        return ret;
     }
 
-    void front_chunk(std::queue<std::future<T_OUT> > *queue)
+    /// move finished outputs to queue, in the order they were distributed. Blocks until the oldest job is done
+    void front_chunk(std::queue<T_OUT> *queue)
     {
         std::unique_lock<std::mutex> lock(_queue_mutex);
-        while(! _job_queue.empty() )
+        _ready_cond.wait(lock, [this] { return _results.empty() || _results.front().ready; });
+        while(! _results.empty() && _results.front().ready)
         {
-            queue->emplace( std::move(_job_queue.front()) );
-            _job_queue.pop();
+            if (false == _results.front().failed)
+            {
+                queue->emplace( std::move(_results.front().output) );
+            }
+            _results.pop_front();
         }
     }
 
@@ -129,9 +167,20 @@ protected:
 
     ThreadPool *_thread_pool;
 
+    // output of one distributed job, filled in by the worker instead of a future per block
+    struct Result_Slot
+    {
+        Result_Slot() : output(), ready(false), failed(false) {}
+        T_OUT output;
+        bool ready;
+        bool failed;
+    };
+
     std::mutex _queue_mutex;
 
-    std::queue<std::future<T_OUT> > _job_queue;
+    std::condition_variable _ready_cond;
+
+    std::deque<Result_Slot> _results;
 
 };
 
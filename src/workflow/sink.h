@@ -158,9 +158,8 @@ protected:
                 _get_func(&_job_queue);
                 while(! _job_queue.empty())
                 {
-                    auto ret = std::move(_job_queue.front());
+                    T_IN input_block = std::move(_job_queue.front());
                     _job_queue.pop();
-                    T_IN input_block = ret.get();
 
                     _callback_func(input_block);
 
@@ -181,12 +180,12 @@ protected:
 
     std::function<bool (void)> _check_func;
 
-    std::function<void (std::queue<std::future<T_IN> > *)> _get_func;
+    std::function<void (std::queue<T_IN> *)> _get_func;
     //std::function<T_IN (void)> _get_func;
 
     std::function<void (T_IN)> _callback_func;
 
-    std::queue<std::future<T_IN> > _job_queue;
+    std::queue<T_IN> _job_queue;
 
     bool _running;
 
@@ -33,10 +33,17 @@ freely, subject to the following restrictions:
 #include <memory>
 #include <thread>
 #include <mutex>
+#include <atomic>
 #include <condition_variable>
 #include <future>
 #include <functional>
 #include <stdexcept>
+#include <algorithm>
+#include <new>
+#include <type_traits>
+#include "core/cpu_budget.h"
+#include "workflow/mpmc_queue.h"
+#include "workflow/completion_group.h"
 
 #if defined _WIN32 || defined __CYGWIN__
 #include <Windows.h>
@@ -46,56 +53,273 @@ freely, subject to the following restrictions:
 
 //#include "task.h"
 
+// move only void() task. Callables up to INLINE_SIZE bytes live inside the task so queueing them doesn't allocate
+class Pool_Task
+{
+public:
+    static const size_t INLINE_SIZE = 96;
+
+    Pool_Task() : _ops(nullptr) {}
+
+    template<class F, class = typename std::enable_if<false == std::is_same<typename std::decay<F>::type, Pool_Task>::value>::type>
+    Pool_Task(F&& f) : _ops(nullptr)
+    {
+        typedef typename std::decay<F>::type Fn;
+        if constexpr (sizeof(Fn) <= INLINE_SIZE && alignof(Fn) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible<Fn>::value)
+        {
+            new (&_storage) Fn(std::forward<F>(f));
+            _ops = inline_ops<Fn>();
+        }
+        else
+        {
+            *reinterpret_cast<Fn**>(&_storage) = new Fn(std::forward<F>(f));
+            _ops = heap_ops<Fn>();
+        }
+    }
+
+    Pool_Task(Pool_Task&& other) noexcept : _ops(nullptr) { *this = std::move(other); }
+
+    Pool_Task& operator=(Pool_Task&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            if (other._ops != nullptr)
+            {
+                other._ops->move(&other._storage, &_storage);
+                _ops = other._ops;
+                other.reset();
+            }
+        }
+        return *this;
+    }
+
+    Pool_Task(const Pool_Task&) = delete;
+
+    Pool_Task& operator=(const Pool_Task&) = delete;
+
+    ~Pool_Task() { reset(); }
+
+    void operator()() { _ops->invoke(&_storage); }
+
+    explicit operator bool() const { return _ops != nullptr; }
+
+private:
+
+    struct Ops
+    {
+        void (*invoke)(void*);
+        void (*move)(void* src, void* dst);
+        void (*destroy)(void*);
+    };
+
+    template<class Fn>
+    static const Ops* inline_ops()
+    {
+        static const Ops ops = { [](void* s) { (*static_cast<Fn*>(s))(); },
+                                 [](void* src, void* dst) { new (dst) Fn(std::move(*static_cast<Fn*>(src))); },
+                                 [](void* s) { static_cast<Fn*>(s)->~Fn(); } };
+        return &ops;
+    }
+
+    template<class Fn>
+    static const Ops* heap_ops()
+    {
+        static const Ops ops = { [](void* s) { (**static_cast<Fn**>(s))(); },
+                                 [](void* src, void* dst) { *static_cast<Fn**>(dst) = *static_cast<Fn**>(src); *static_cast<Fn**>(src) = nullptr; },
+                                 [](void* s) { delete *static_cast<Fn**>(s); } };
+        return &ops;
+    }
+
+    void reset()
+    {
+        if (_ops != nullptr)
+        {
+            _ops->destroy(&_storage);
+            _ops = nullptr;
+        }
+    }
+
+    const Ops* _ops;
+
+    typename std::aligned_storage<INLINE_SIZE, alignof(std::max_align_t)>::type _storage;
+};
+
 class ThreadPool {
 public:
-    ThreadPool(size_t);
+    // pin_numa spreads the workers over the numa nodes in contiguous blocks and pins each to all the cpus of its node, no-op on single node machines.
+    // queue_capacity bounds each lock free task queue, enqueue waits for room once it is full
+    ThreadPool(size_t, bool pin_numa = false, size_t queue_capacity = 16384);
     template<class F, class... Args>
     auto enqueue(F&& f, Args&&... args)
         -> std::future<typename std::result_of<F(Args...)>::type>;
 
+    // queue a task for the workers of one numa node, other nodes only take it once they run out of work
+    template<class F, class... Args>
+    auto enqueue_on_node(size_t node, F&& f, Args&&... args)
+        -> std::future<typename std::result_of<F(Args...)>::type>;
+
+    // queue a task without a future, nothing is allocated for small callables. f must not throw
+    template<class F>
+    void enqueue_detached(F&& f);
+
+    template<class F>
+    void enqueue_detached_on_node(size_t node, F&& f);
+
+    size_t size() const { return workers.size(); }
+
+    // 1 unless the workers were pinned over several numa nodes
+    size_t num_nodes() const { return std::max((size_t)1, node_tasks.size()); }
+
+    // rows are split into contiguous blocks, one per node
+    size_t node_of_row(size_t row, size_t rows) const { return (rows > 0) ? (row * num_nodes()) / rows : 0; }
+
     //void enqueue_task(task* t);
 
     ~ThreadPool();
 private:
+    struct Worker_Info
+    {
+        ThreadPool* pool;
+        size_t node;
+    };
+
+    static Worker_Info& this_worker() { static thread_local Worker_Info info = { nullptr, 0 }; return info; }
+
+    workflow::MPMC_Queue<Pool_Task>* node_queue(size_t node) { return node_tasks.empty() ? tasks.get() : node_tasks[node % node_tasks.size()].get(); }
+
+    void push_task(workflow::MPMC_Queue<Pool_Task>* queue, Pool_Task&& task);
+
+    bool pop_task(size_t node, Pool_Task& task);
+
+    void run_task(Pool_Task& task);
+
     // need to keep track of threads so we can join them
     std::vector< std::thread > workers;
     // the task queue
-    std::queue< std::function<void()> > tasks;
+    std::unique_ptr< workflow::MPMC_Queue<Pool_Task> > tasks;
+    // tasks owned by a numa node, empty unless pinned over several nodes
+    std::vector< std::unique_ptr< workflow::MPMC_Queue<Pool_Task> > > node_tasks;
+    // queued and not yet taken, can dip below 0 while a push is being counted
+    std::atomic<long> pending;
+    std::atomic<size_t> sleepers;
 
-    // synchronization
+    // only used to park idle workers, the queues themselves are lock free
     std::mutex queue_mutex;
     std::condition_variable condition;
-    bool stop;
+    std::atomic<bool> stop;
 };
 
 // the constructor just launches some amount of workers
-inline ThreadPool::ThreadPool(size_t threads)
-    :   stop(false)
+inline ThreadPool::ThreadPool(size_t threads, bool pin_numa, size_t queue_capacity)
+    :   tasks(new workflow::MPMC_Queue<Pool_Task>(queue_capacity)), pending(0), sleepers(0), stop(false)
 {
+    size_t nodes = 1;
+    if (pin_numa && threads > 1)
+    {
+        nodes = std::max((size_t)1, std::min(threads, Cpu_Budget::inst()->numa_nodes().size()));
+    }
+    for (size_t n = 0; nodes > 1 && n < nodes; n++)
+    {
+        node_tasks.emplace_back(new workflow::MPMC_Queue<Pool_Task>(queue_capacity));
+    }
+
     for(size_t i = 0;i<threads;++i)
         workers.emplace_back(
-            [this]
+            [this, i, threads, nodes]
             {
+                size_t node = 0;
+                if (nodes > 1)
+                {
+                    int pinned = Cpu_Budget::inst()->pin_worker(i, threads);
+                    node = (pinned > 0) ? std::min((size_t)pinned, nodes - 1) : 0;
+                }
+                this_worker().pool = this;
+                this_worker().node = node;
                 for(;;)
                 {
-                    std::function<void()> task;
-
+                    Pool_Task task;
+                    bool found = this->pop_task(node, task);
+                    // short pixel tasks come in bursts, look again a few times before parking
+                    for (int spin = 0; false == found && spin < 64; spin++)
                     {
-                        std::unique_lock<std::mutex> lock(this->queue_mutex);
-                        this->condition.wait(lock,
-                            [this]{ return this->stop || !this->tasks.empty(); });
-                        if(this->stop && this->tasks.empty())
-                            return;
-                        task = std::move(this->tasks.front());
-                        this->tasks.pop();
+                        std::this_thread::yield();
+                        found = this->pop_task(node, task);
+                    }
+                    if (found)
+                    {
+                        this->run_task(task);
+                        continue;
                     }
 
-                    task();
+                    std::unique_lock<std::mutex> lock(this->queue_mutex);
+                    this->sleepers++;
+                    this->condition.wait(lock,
+                        [this]{ return this->stop || this->pending > 0; });
+                    this->sleepers--;
+                    if(this->stop && this->pending <= 0)
+                        return;
                 }
             }
         );
 }
 
+inline void ThreadPool::push_task(workflow::MPMC_Queue<Pool_Task>* queue, Pool_Task&& task)
+{
+    // don't allow enqueueing after stopping the pool
+    if(stop)
+        throw std::runtime_error("enqueue on stopped ThreadPool");
+
+    while (false == queue->try_push(std::move(task)))
+    {
+        // full. A worker queueing more work runs one itself so nested enqueues can't deadlock
+        Pool_Task other;
+        if (this_worker().pool == this && pop_task(this_worker().node, other))
+        {
+            run_task(other);
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+    pending++;
+    if (sleepers > 0)
+    {
+        // taking the lock orders this with a worker that is about to park
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+        }
+        condition.notify_one();
+    }
+}
+
+// own node first, then the shared queue, then steal from other nodes
+inline bool ThreadPool::pop_task(size_t node, Pool_Task& task)
+{
+    bool found = (false == node_tasks.empty()) && node_tasks[node]->try_pop(task);
+    if (false == found)
+    {
+        found = tasks->try_pop(task);
+    }
+    for (size_t n = 0; false == found && n < node_tasks.size(); n++)
+    {
+        found = (n != node) && node_tasks[n]->try_pop(task);
+    }
+    if (found)
+    {
+        pending--;
+    }
+    return found;
+}
+
+inline void ThreadPool::run_task(Pool_Task& task)
+{
+    Cpu_Budget::inst()->task_started();
+    task();
+    Cpu_Budget::inst()->task_finished();
+}
+
 // add new work item to the pool
 template<class F, class... Args>
 auto ThreadPool::enqueue(F&& f, Args&&... args)
@@ -103,24 +327,36 @@ auto ThreadPool::enqueue(F&& f, Args&&... args)
 {
     using return_type = typename std::result_of<F(Args...)>::type;
 
-    auto task = std::make_shared< std::packaged_task<return_type()> >(
-            std::bind(std::forward<F>(f), std::forward<Args>(args)...)
-        );
-
-    std::future<return_type> res = task->get_future();
-    {
-        std::unique_lock<std::mutex> lock(queue_mutex);
+    std::packaged_task<return_type()> task(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+    std::future<return_type> res = task.get_future();
+    push_task(tasks.get(), Pool_Task(std::move(task)));
+    return res;
+}
 
-        // don't allow enqueueing after stopping the pool
-        if(stop)
-            throw std::runtime_error("enqueue on stopped ThreadPool");
+template<class F, class... Args>
+auto ThreadPool::enqueue_on_node(size_t node, F&& f, Args&&... args)
+    -> std::future<typename std::result_of<F(Args...)>::type>
+{
+    using return_type = typename std::result_of<F(Args...)>::type;
 
-        tasks.emplace([task](){ (*task)(); });
-    }
-    condition.notify_one();
+    std::packaged_task<return_type()> task(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+    std::future<return_type> res = task.get_future();
+    push_task(node_queue(node), Pool_Task(std::move(task)));
     return res;
 }
 
+template<class F>
+void ThreadPool::enqueue_detached(F&& f)
+{
+    push_task(tasks.get(), Pool_Task(std::forward<F>(f)));
+}
+
+template<class F>
+void ThreadPool::enqueue_detached_on_node(size_t node, F&& f)
+{
+    push_task(node_queue(node), Pool_Task(std::forward<F>(f)));
+}
+
 // the destructor joins all threads
 inline ThreadPool::~ThreadPool()
 {
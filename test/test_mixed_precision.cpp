@@ -0,0 +1,402 @@
+/***
+Copyright (c) 2016, UChicago Argonne, LLC. All rights reserved.
+
+Copyright 2016. UChicago Argonne, LLC. This software was produced
+under U.S. Government contract DE-AC02-06CH11357 for Argonne National
+Laboratory (ANL), which is operated by UChicago Argonne, LLC for the
+U.S. Department of Energy. The U.S. Government has rights to use,
+reproduce, and distribute this software.  NEITHER THE GOVERNMENT NOR
+UChicago Argonne, LLC MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR
+ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  If software is
+modified to produce derivative works, such modified software should
+be clearly marked, so as not to confuse it with the version available
+from ANL.
+
+Additionally, redistribution and use in source and binary forms, with
+or without modification, are permitted provided that the following
+conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the name of UChicago Argonne, LLC, Argonne National
+      Laboratory, ANL, the U.S. Government, nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY UChicago Argonne, LLC AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL UChicago
+Argonne, LLC OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+***/
+
+// Accuracy of --mixed-precision against a pure double fit on test/2_ID_E_dataset.
+// Fits the integrated spectra of every dataset and detector and a few pixels in float, mixed and double with
+// LM without tails, LM with tails (integrated spectra only, they are slow) and NNLS.
+// NNLS has one solution so its element counts are compared to double.
+// LM fits of these spectra have many local minima and the three precisions often end in different ones, some
+// with a lower residual than the double fit, so LM counts are printed only. LM is checked on what mixed precision
+// changes: the model lmmin sees. At the parameters of each double fit the weighted model spectra is evaluated in
+// float and in mixed precision and compared to the double one.
+// Fails if mixed is further from double than pure float, by median or p90, or above the bounds below.
+// Run from the test directory.
+
+#include "io/file/hl_file_io.h"
+#include "io/file/mda_io.h"
+#include "fitting/models/gaussian_model.h"
+#include "fitting/optimizers/lmfit_optimizer.h"
+#include "fitting/optimizers/optimizer.h"
+#include "fitting/routines/param_optimized_fit_routine.h"
+#include "fitting/routines/nnls_fit_routine.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <map>
+
+const std::string dataset_dir = "2_ID_E_dataset/";
+const std::vector<std::string> dataset_files = { "2xfm_0010.mda", "2xfm_0011.mda", "axo_std.mda" };
+const size_t num_detectors = 4;
+const size_t num_pixels = 4;
+
+enum class Fit_Kind { LM_NO_TAILS, LM_WITH_TAILS, NNLS };
+
+//-----------------------------------------------------------------------------
+
+template<typename T_real>
+struct Fit_Input
+{
+    Fit_Input()
+    {
+        io::file::load_element_info<T_real>("../reference/henke.xdr", "../reference/xrf_library.csv");
+    }
+
+    bool load(const std::string& dataset_file, size_t detector_num)
+    {
+        params_override = data_struct::Params_Override<T_real>();
+        if (false == io::file::load_override_params(dataset_dir, -1, &params_override))
+        {
+            return false;
+        }
+        io::file::MDA_IO<T_real> mda_io;
+        data_struct::Spectra_Volume<T_real> volume;
+        if (false == mda_io.load_spectra_volume(dataset_dir + "mda/" + dataset_file, detector_num, &volume, false))
+        {
+            return false;
+        }
+        spectra.clear();
+        spectra.push_back(volume.integrate());
+        for (size_t col = 0; col < std::min(num_pixels, volume.cols()); col++)
+        {
+            spectra.push_back(volume[volume.rows() / 2][col]);
+        }
+        return true;
+    }
+
+    data_struct::Params_Override<T_real> params_override;
+    std::vector<data_struct::Spectra<T_real>> spectra;
+};
+
+//-----------------------------------------------------------------------------
+
+/**
+ * Element counts of one fit and for LM the fitted parameter values and the number of model evaluations
+ */
+struct Fit_Result
+{
+    std::map<std::string, double> counts;
+    std::map<std::string, double> fit_params;
+    size_t evaluations = 0;
+};
+
+//-----------------------------------------------------------------------------
+
+template<typename T_real>
+Fit_Result fit(Fit_Input<T_real>& input, const data_struct::Spectra<T_real>& spectra, Fit_Kind kind, bool mixed_precision)
+{
+    fitting::models::Gaussian_Model<T_real> model;
+    model.update_fit_params_values(&input.params_override.fit_params);
+    fitting::models::Range energy_range = data_struct::get_energy_range<T_real>(spectra.size(), &input.params_override.fit_params);
+    Fit_Result result;
+
+    if (kind == Fit_Kind::NNLS)
+    {
+        fitting::routines::NNLS_Fit_Routine<T_real> fit_routine;
+        fit_routine.set_mixed_precision(mixed_precision);
+        fit_routine.initialize(&model, &input.params_override.elements_to_fit, energy_range);
+        std::unordered_map<std::string, T_real> out_counts;
+        fit_routine.fit_spectra(&model, &spectra, &input.params_override.elements_to_fit, out_counts);
+        for (const auto& itr : input.params_override.elements_to_fit)
+        {
+            if (out_counts.count(itr.first) > 0)
+            {
+                result.counts[itr.first] = (double)out_counts.at(itr.first);
+            }
+        }
+        return result;
+    }
+
+    fitting::optimizers::LMFit_Optimizer<T_real> optimizer;
+    optimizer.set_mixed_precision(mixed_precision);
+    fitting::routines::Param_Optimized_Fit_Routine<T_real> fit_routine;
+    fit_routine.set_optimizer(&optimizer);
+    fit_routine.set_update_coherent_amplitude_on_fit(false);
+
+    model.set_fit_params_preset(kind == Fit_Kind::LM_WITH_TAILS ? fitting::models::Fit_Params_Preset::BATCH_FIT_WITH_TAILS : fitting::models::Fit_Params_Preset::BATCH_FIT_NO_TAILS);
+    fit_routine.initialize(&model, &input.params_override.elements_to_fit, energy_range);
+
+    data_struct::Fit_Parameters<T_real> out_fitp;
+    fit_routine.fit_spectra_parameters(&model, &spectra, &input.params_override.elements_to_fit, true, out_fitp, nullptr);
+
+    for (const auto& itr : input.params_override.elements_to_fit)
+    {
+        if (out_fitp.contains(itr.first))
+        {
+            result.counts[itr.first] = std::pow(10.0, (double)out_fitp.value(itr.first));
+        }
+    }
+    for (const auto& itr : out_fitp)
+    {
+        result.fit_params[itr.first] = (double)itr.second.value;
+    }
+    if (out_fitp.contains(STR_NUM_ITR))
+    {
+        result.evaluations = (size_t)out_fitp.value(STR_NUM_ITR);
+    }
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+/**
+ * Relative error of the weighted float and mixed precision model spectra against double, at the parameters in values.
+ * Weights are the ones LMFit_Optimizer uses so this is how far each precision moves the residuals.
+ */
+void model_errors(Fit_Input<float>& input_float, Fit_Input<double>& input_double, size_t spectra_idx, const std::map<std::string, double>& values,
+                  double& out_float_err, double& out_mixed_err)
+{
+    const data_struct::Spectra<double>& spectra = input_double.spectra[spectra_idx];
+    fitting::models::Range energy_range = data_struct::get_energy_range<double>(spectra.size(), &input_double.params_override.fit_params);
+    data_struct::Fit_Parameters<double> fitp_double;
+    data_struct::Fit_Parameters<float> fitp_float;
+    for (const auto& itr : values)
+    {
+        fitp_double.add_parameter(data_struct::Fit_Param<double>(itr.first, itr.second));
+        fitp_float.add_parameter(data_struct::Fit_Param<float>(itr.first, (float)itr.second));
+    }
+    fitting::models::Gaussian_Model<double> model_double;
+    fitting::models::Gaussian_Model<float> model_float;
+    fitting::optimizers::User_Data<double> ud;
+    fitting::optimizers::fill_user_data(ud, &fitp_double, &spectra, &input_double.params_override.elements_to_fit, &model_double, energy_range, nullptr, 1);
+
+    fitting::models::Model_Workspace<double> workspace_double;
+    data_struct::Spectra<double> spectra_double;
+    model_double.model_spectrum_workspace(&fitp_double, &input_double.params_override.elements_to_fit, energy_range, workspace_double, spectra_double);
+
+    fitting::models::Model_Workspace<float> workspace_float;
+    data_struct::Spectra<float> spectra_float;
+    model_float.model_spectrum_workspace(&fitp_float, &input_float.params_override.elements_to_fit, energy_range, workspace_float, spectra_float);
+
+    // what LMFit_Optimizer sets up for a mixed precision fit, lmmin's double calibration and the double model sum
+    fitting::models::Model_Workspace<float> workspace_mixed;
+    workspace_mixed.double_accumulation = true;
+    workspace_mixed.energy_offset = values.at(STR_ENERGY_OFFSET);
+    workspace_mixed.energy_slope = values.at(STR_ENERGY_SLOPE);
+    workspace_mixed.energy_quad = values.at(STR_ENERGY_QUADRATIC);
+    data_struct::Spectra<float> spectra_mixed;
+    model_float.model_spectrum_workspace(&fitp_float, &input_float.params_override.elements_to_fit, energy_range, workspace_mixed, spectra_mixed);
+
+    double norm = (spectra_double * ud.weights).matrix().norm();
+    out_float_err = ((spectra_float.template cast<double>() - spectra_double) * ud.weights).matrix().norm() / norm;
+    out_mixed_err = ((workspace_mixed.spectra_dp - spectra_double) * ud.weights).matrix().norm() / norm;
+}
+
+//-----------------------------------------------------------------------------
+
+double percentile(std::vector<double> values, double p)
+{
+    if (values.size() == 0)
+    {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, (size_t)(p * (values.size() - 1) + 0.5))];
+}
+
+//-----------------------------------------------------------------------------
+
+struct Errors
+{
+    std::vector<double> float_err;
+    std::vector<double> mixed_err;
+
+    double median(bool mixed) const { return percentile(mixed ? mixed_err : float_err, 0.5); }
+
+    double p90(bool mixed) const { return percentile(mixed ? mixed_err : float_err, 0.9); }
+
+    void print(const std::string& name, const std::string& what) const
+    {
+        logI << name << ": relative " << what << " error against double over " << mixed_err.size() << " values\n";
+        logI << "  float : median " << median(false) << " p90 " << p90(false) << "\n";
+        logI << "  mixed : median " << median(true) << " p90 " << p90(true) << "\n";
+    }
+
+    /// mixed may not be further from double than float and has to stay within the bounds
+    bool check(const std::string& name, double max_median, double max_p90) const
+    {
+        if (mixed_err.size() == 0)
+        {
+            return true;
+        }
+        bool passed = true;
+        if (median(true) > median(false) || p90(true) > p90(false))
+        {
+            logE << name << ": mixed precision is further from double than float\n";
+            passed = false;
+        }
+        if (median(true) > max_median || p90(true) > max_p90)
+        {
+            logE << name << ": mixed precision error above bounds: median " << max_median << " p90 " << max_p90 << "\n";
+            passed = false;
+        }
+        return passed;
+    }
+};
+
+//-----------------------------------------------------------------------------
+
+struct Fit_Case
+{
+    std::string name;
+    Fit_Kind kind;
+    bool fit_pixels;
+    // bounds for mixed against double
+    double max_integrated_median;
+    double max_integrated_p90;
+    double max_pixels_median;
+    double max_pixels_p90;
+
+    // element counts for NNLS, model spectra for LM
+    Errors integrated;
+    Errors pixels;
+    // LM element counts, printed only
+    Errors integrated_counts;
+    Errors pixels_counts;
+    // double, float, mixed
+    double seconds[3] = { 0, 0, 0 };
+    size_t evaluations[3] = { 0, 0, 0 };
+};
+
+//-----------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+    Fit_Input<float> input_float;
+    Fit_Input<double> input_double;
+
+    std::vector<Fit_Case> cases = {
+        { "LM no tails", Fit_Kind::LM_NO_TAILS, true, 0.005, 0.05, 0.02, 1.0 },
+        { "LM with tails", Fit_Kind::LM_WITH_TAILS, false, 0.005, 0.05, 0.0, 0.0 },
+        { "NNLS", Fit_Kind::NNLS, true, 1.0e-5, 1.0e-4, 1.0e-5, 1.0e-4 }
+    };
+
+    bool loaded = false;
+    for (const auto& dataset_file : dataset_files)
+    {
+        for (size_t detector_num = 0; detector_num < num_detectors; detector_num++)
+        {
+            if (false == input_float.load(dataset_file, detector_num) || false == input_double.load(dataset_file, detector_num))
+            {
+                continue;
+            }
+            loaded = true;
+            for (auto& fit_case : cases)
+            {
+                size_t num_spectra = fit_case.fit_pixels ? input_double.spectra.size() : 1;
+                for (size_t i = 0; i < num_spectra; i++)
+                {
+                    std::chrono::time_point<std::chrono::steady_clock> t0 = std::chrono::steady_clock::now();
+                    Fit_Result ref = fit(input_double, input_double.spectra[i], fit_case.kind, false);
+                    std::chrono::time_point<std::chrono::steady_clock> t1 = std::chrono::steady_clock::now();
+                    Fit_Result fp = fit(input_float, input_float.spectra[i], fit_case.kind, false);
+                    std::chrono::time_point<std::chrono::steady_clock> t2 = std::chrono::steady_clock::now();
+                    Fit_Result mp = fit(input_float, input_float.spectra[i], fit_case.kind, true);
+                    std::chrono::time_point<std::chrono::steady_clock> t3 = std::chrono::steady_clock::now();
+                    fit_case.seconds[0] += std::chrono::duration<double>(t1 - t0).count();
+                    fit_case.seconds[1] += std::chrono::duration<double>(t2 - t1).count();
+                    fit_case.seconds[2] += std::chrono::duration<double>(t3 - t2).count();
+                    fit_case.evaluations[0] += ref.evaluations;
+                    fit_case.evaluations[1] += fp.evaluations;
+                    fit_case.evaluations[2] += mp.evaluations;
+
+                    bool is_lm = (fit_case.kind != Fit_Kind::NNLS);
+                    if (is_lm)
+                    {
+                        Errors& models = (i == 0) ? fit_case.integrated : fit_case.pixels;
+                        double float_err = 0.0;
+                        double mixed_err = 0.0;
+                        model_errors(input_float, input_double, i, ref.fit_params, float_err, mixed_err);
+                        models.float_err.push_back(float_err);
+                        models.mixed_err.push_back(mixed_err);
+                    }
+
+                    // elements the double fit found, ignore the ones fitted to the lower bound
+                    Errors& errors = is_lm ? ((i == 0) ? fit_case.integrated_counts : fit_case.pixels_counts) : ((i == 0) ? fit_case.integrated : fit_case.pixels);
+                    double floor = 1.0e-6 * std::max(1.0, (double)input_double.spectra[i].sum());
+                    for (const auto& itr : ref.counts)
+                    {
+                        if (itr.second < floor)
+                        {
+                            continue;
+                        }
+                        errors.float_err.push_back(std::abs(fp.counts[itr.first] - itr.second) / itr.second);
+                        errors.mixed_err.push_back(std::abs(mp.counts[itr.first] - itr.second) / itr.second);
+                    }
+                }
+            }
+        }
+    }
+
+    if (false == loaded)
+    {
+        logE << "No spectra loaded from " << dataset_dir << "\n";
+        return 1;
+    }
+
+    bool passed = true;
+    for (const auto& fit_case : cases)
+    {
+        std::string what = (fit_case.kind == Fit_Kind::NNLS) ? "count" : "weighted model";
+        fit_case.integrated.print(fit_case.name + " integrated spectra", what);
+        fit_case.pixels.print(fit_case.name + " pixels", what);
+        if (fit_case.kind != Fit_Kind::NNLS)
+        {
+            fit_case.integrated_counts.print(fit_case.name + " integrated spectra", "count");
+            fit_case.pixels_counts.print(fit_case.name + " pixels", "count");
+        }
+        logI << fit_case.name << " fit time: double " << fit_case.seconds[0] << "s float " << fit_case.seconds[1] << "s mixed " << fit_case.seconds[2] << "s\n";
+        if (fit_case.evaluations[0] > 0)
+        {
+            // per evaluation, the precisions take a different number of iterations
+            logI << fit_case.name << " model evaluations: double " << fit_case.evaluations[0] << " float " << fit_case.evaluations[1] << " mixed " << fit_case.evaluations[2]
+                 << ", ms each: double " << 1000.0 * fit_case.seconds[0] / fit_case.evaluations[0]
+                 << " float " << 1000.0 * fit_case.seconds[1] / std::max<size_t>(1, fit_case.evaluations[1])
+                 << " mixed " << 1000.0 * fit_case.seconds[2] / std::max<size_t>(1, fit_case.evaluations[2]) << "\n";
+        }
+        passed = fit_case.integrated.check(fit_case.name + " integrated spectra", fit_case.max_integrated_median, fit_case.max_integrated_p90) && passed;
+        passed = fit_case.pixels.check(fit_case.name + " pixels", fit_case.max_pixels_median, fit_case.max_pixels_p90) && passed;
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,191 @@
+/***
+Copyright (c) 2016, UChicago Argonne, LLC. All rights reserved.
+
+Copyright 2016. UChicago Argonne, LLC. This software was produced
+under U.S. Government contract DE-AC02-06CH11357 for Argonne National
+Laboratory (ANL), which is operated by UChicago Argonne, LLC for the
+U.S. Department of Energy. The U.S. Government has rights to use,
+reproduce, and distribute this software.  NEITHER THE GOVERNMENT NOR
+UChicago Argonne, LLC MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR
+ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  If software is
+modified to produce derivative works, such modified software should
+be clearly marked, so as not to confuse it with the version available
+from ANL.
+
+Additionally, redistribution and use in source and binary forms, with
+or without modification, are permitted provided that the following
+conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the name of UChicago Argonne, LLC, Argonne National
+      Laboratory, ANL, the U.S. Government, nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY UChicago Argonne, LLC AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL UChicago
+Argonne, LLC OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+***/
+
+// Counts heap allocations in Gaussian_Model::model_spectrum_workspace once the workspace is sized,
+// checks its spectra against model_spectrum_mp and prints the time of both.
+// Allocations are counted by replacing malloc, so only with glibc.
+// Run from the test directory.
+
+#include "io/file/hl_file_io.h"
+#include "fitting/models/gaussian_model.h"
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdlib>
+
+const std::string dataset_dir = "2_ID_E_dataset/";
+const size_t num_channels = 2048;
+const int num_evaluations = 200;
+
+static std::atomic<size_t> num_allocations(0);
+
+//-----------------------------------------------------------------------------
+
+#if defined(__GLIBC__)
+// Eigen allocates with malloc, not operator new, so count the whole malloc family
+extern "C"
+{
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t num, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+
+void* malloc(size_t size)
+{
+    num_allocations++;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t num, size_t size)
+{
+    num_allocations++;
+    return __libc_calloc(num, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+    num_allocations++;
+    return __libc_realloc(ptr, size);
+}
+
+void* memalign(size_t alignment, size_t size)
+{
+    num_allocations++;
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+    num_allocations++;
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size)
+{
+    num_allocations++;
+    *ptr = __libc_memalign(alignment, size);
+    return (*ptr == nullptr) ? ENOMEM : 0;
+}
+}
+#define ALLOCATIONS_COUNTED 1
+#else
+#define ALLOCATIONS_COUNTED 0
+#endif
+
+//-----------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+    if (false == io::file::load_element_info<double>("../reference/henke.xdr", "../reference/xrf_library.csv"))
+    {
+        return 1;
+    }
+    data_struct::Params_Override<double> params_override;
+    if (false == io::file::load_override_params(dataset_dir, -1, &params_override))
+    {
+        return 1;
+    }
+
+    fitting::models::Gaussian_Model<double> model;
+    model.update_fit_params_values(&params_override.fit_params);
+    data_struct::Fit_Parameters<double> fit_params = model.fit_parameters();
+    for (const auto& itr : params_override.elements_to_fit)
+    {
+        if (false == fit_params.contains(itr.first))
+        {
+            fit_params.add_parameter(data_struct::Fit_Param<double>(itr.first, 3.0));
+        }
+    }
+    fitting::models::Range energy_range = data_struct::get_energy_range<double>(num_channels, &fit_params);
+
+    fitting::models::Model_Workspace<double> workspace;
+    data_struct::Spectra<double> spectra;
+    // sizes the workspace
+    model.model_spectrum_workspace(&fit_params, &params_override.elements_to_fit, energy_range, workspace, spectra);
+
+    size_t allocations_before = num_allocations;
+    std::chrono::time_point<std::chrono::steady_clock> start = std::chrono::steady_clock::now();
+    for (int i = 0; i < num_evaluations; i++)
+    {
+        fit_params[STR_ENERGY_SLOPE].value *= 1.0 + 1.0e-6;
+        model.model_spectrum_workspace(&fit_params, &params_override.elements_to_fit, energy_range, workspace, spectra);
+    }
+    double workspace_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    size_t workspace_allocations = num_allocations - allocations_before;
+
+    allocations_before = num_allocations;
+    start = std::chrono::steady_clock::now();
+    data_struct::Spectra<double> mp_spectra;
+    for (int i = 0; i < num_evaluations; i++)
+    {
+        mp_spectra = model.model_spectrum_mp(&fit_params, &params_override.elements_to_fit, energy_range);
+    }
+    double mp_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    size_t mp_allocations = num_allocations - allocations_before;
+
+    double max_rel_diff = ((spectra - mp_spectra).abs() / mp_spectra.abs().max(1.0)).maxCoeff();
+
+    logI << params_override.elements_to_fit.size() << " elements, " << energy_range.count() << " channels, " << num_evaluations << " evaluations\n";
+    logI << "model_spectrum_workspace: " << workspace_allocations << " allocations " << workspace_seconds << "s\n";
+    logI << "model_spectrum_mp: " << mp_allocations << " allocations " << mp_seconds << "s\n";
+    logI << "max relative difference " << max_rel_diff << "\n";
+
+    bool passed = true;
+    if (ALLOCATIONS_COUNTED == 0)
+    {
+        logW << "Allocations are only counted with glibc\n";
+    }
+    else if (workspace_allocations > 0)
+    {
+        logE << "model_spectrum_workspace allocated " << workspace_allocations << " times after the workspace was sized\n";
+        passed = false;
+    }
+    if (false == (max_rel_diff < 1.0e-9))
+    {
+        logE << "model_spectrum_workspace differs from model_spectrum_mp by " << max_rel_diff << "\n";
+        passed = false;
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,325 @@
+/***
+Copyright (c) 2016, UChicago Argonne, LLC. All rights reserved.
+
+Copyright 2016. UChicago Argonne, LLC. This software was produced
+under U.S. Government contract DE-AC02-06CH11357 for Argonne National
+Laboratory (ANL), which is operated by UChicago Argonne, LLC for the
+U.S. Department of Energy. The U.S. Government has rights to use,
+reproduce, and distribute this software.  NEITHER THE GOVERNMENT NOR
+UChicago Argonne, LLC MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR
+ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  If software is
+modified to produce derivative works, such modified software should
+be clearly marked, so as not to confuse it with the version available
+from ANL.
+
+Additionally, redistribution and use in source and binary forms, with
+or without modification, are permitted provided that the following
+conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the name of UChicago Argonne, LLC, Argonne National
+      Laboratory, ANL, the U.S. Government, nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY UChicago Argonne, LLC AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL UChicago
+Argonne, LLC OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+***/
+
+// Fits several synthetic quantification standards the way the detector routines used to (one shared routine, serially),
+// then with perform_quantification on one thread and on at least two. Fails if any element count or calibration curve
+// value differs from the reference or between the runs, prints the speedup.
+// Run from the test directory, an optional argument sets the thread count of the second run.
+
+#include "core/process_whole.h"
+#include "io/file/mca_io.h"
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <random>
+
+const std::string override_dir = "2_ID_E_dataset/";
+const size_t num_standards = 8;
+const size_t num_channels = 2048;
+const std::vector<std::string> standard_elements = { "Ca", "Fe", "Cu" };
+
+//-----------------------------------------------------------------------------
+
+/**
+ * Writes std_<n>.mca0 modeled from the 2_ID_E override with Poisson noise and a maps_standardinfo.txt listing them.
+ */
+bool write_standards(const std::string& dir)
+{
+    data_struct::Params_Override<double> params_override;
+    if (false == io::file::load_override_params(override_dir, -1, &params_override))
+    {
+        return false;
+    }
+    std::filesystem::copy_file(override_dir + "maps_fit_parameters_override.txt", dir + "maps_fit_parameters_override.txt", std::filesystem::copy_options::overwrite_existing);
+
+    data_struct::Fit_Element_Map_Dict<double> elements_to_fit;
+    for (const auto& name : standard_elements)
+    {
+        elements_to_fit[name] = new data_struct::Fit_Element_Map<double>(name, data_struct::Element_Info_Map<double>::inst()->get_element(name));
+        elements_to_fit[name]->init_energy_ratio_for_detector_element(data_struct::Element_Info_Map<double>::inst()->get_element("Si"));
+    }
+
+    fitting::models::Gaussian_Model<double> model;
+    model.update_fit_params_values(&params_override.fit_params);
+    data_struct::Fit_Parameters<double> fit_params = model.fit_parameters();
+    fitting::models::Range energy_range = data_struct::get_energy_range<double>(num_channels, &fit_params);
+
+    std::unordered_map<std::string, double> pv_map;
+    pv_map[STR_SR_CURRENT] = 100.0;
+    pv_map[STR_US_IC] = 100000.0;
+    pv_map[STR_DS_IC] = 100000.0;
+    pv_map[STR_ENERGY_OFFSET] = fit_params.value(STR_ENERGY_OFFSET);
+    pv_map[STR_ENERGY_SLOPE] = fit_params.value(STR_ENERGY_SLOPE);
+    pv_map[STR_ENERGY_QUADRATIC] = fit_params.value(STR_ENERGY_QUADRATIC);
+
+    std::mt19937 rng(7);
+    std::ofstream info(dir + "maps_standardinfo.txt");
+    for (size_t n = 0; n < num_standards; n++)
+    {
+        std::string weights;
+        for (size_t e = 0; e < standard_elements.size(); e++)
+        {
+            double weight = 0.25 + 0.5 * (double)((n + e) % 4);
+            fit_params.add_parameter(data_struct::Fit_Param<double>(standard_elements[e], std::log10(20000.0 * weight)));
+            weights += (e > 0 ? ", " : "") + std::to_string(weight);
+        }
+        data_struct::Spectra<double> model_spectra = model.model_spectrum(&fit_params, &elements_to_fit, nullptr, energy_range);
+        data_struct::Spectra<double> spectra(num_channels);
+        for (size_t c = energy_range.min; c <= energy_range.max && c < num_channels; c++)
+        {
+            std::poisson_distribution<int> counts(std::max(1.0, model_spectra(c - energy_range.min)));
+            spectra(c) = counts(rng);
+        }
+        spectra.elapsed_livetime(1.0);
+        spectra.elapsed_realtime(1.0);
+        std::string filename = "std_" + std::to_string(n) + ".mca";
+        if (false == io::file::mca::save_integrated_spectra(dir + filename + "0", &spectra, pv_map))
+        {
+            return false;
+        }
+        info << "FILENAME: " << filename << "\n";
+        info << "ELEMENTS_IN_STANDARD: Ca, Fe, Cu\n";
+        info << "WEIGHT: " << weights << "\n";
+    }
+    for (auto& itr : elements_to_fit)
+    {
+        delete itr.second;
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+/**
+ * Sets up detector 0 of dir for the routines under test.
+ */
+bool init_job(const std::string& dir, size_t num_threads, data_struct::Analysis_Job<double>& analysis_job)
+{
+    analysis_job.dataset_directory = dir;
+    analysis_job.quantification_standard_filename = "maps_standardinfo.txt";
+    analysis_job.detector_num_arr = { 0 };
+    analysis_job.fitting_routines = { data_struct::Fitting_Routines::ROI, data_struct::Fitting_Routines::GAUSS_TAILS, data_struct::Fitting_Routines::GAUSS_MATRIX, data_struct::Fitting_Routines::NNLS };
+    analysis_job.num_threads = num_threads;
+    return io::file::init_analysis_job_detectors(&analysis_job);
+}
+
+//-----------------------------------------------------------------------------
+
+/**
+ * Reference counts: every standard fit in order with the detector's shared routines and model.
+ */
+bool shared_routine_counts(const std::string& dir, std::map<std::string, double>& out_counts)
+{
+    data_struct::Analysis_Job<double> analysis_job;
+    if (false == init_job(dir, 1, analysis_job)
+        || false == io::file::load_quantification_standardinfo(dir, analysis_job.quantification_standard_filename, analysis_job.standard_element_weights))
+    {
+        return false;
+    }
+    data_struct::Detector<double>* detector = analysis_job.get_detector(0);
+    data_struct::Params_Override<double>* override_params = &(detector->fit_params_override_dict);
+
+    out_counts.clear();
+    for (auto& standard_itr : analysis_job.standard_element_weights)
+    {
+        data_struct::Quantification_Standard<double> quantification_standard(standard_itr.standard_filename, standard_itr.element_standard_weights);
+        std::unordered_map<std::string, double> pv_map;
+        if (false == io::file::mca::load_integrated_spectra(dir + standard_itr.standard_filename + "0", &quantification_standard.integrated_spectra, pv_map))
+        {
+            return false;
+        }
+        data_struct::Fit_Element_Map_Dict<double> elements_to_fit;
+        for (auto& itr : standard_itr.element_standard_weights)
+        {
+            elements_to_fit[itr.first] = new data_struct::Fit_Element_Map<double>(itr.first, data_struct::Element_Info_Map<double>::inst()->get_element(itr.first));
+            elements_to_fit[itr.first]->init_energy_ratio_for_detector_element(detector->detector_element, standard_itr.disable_Ka_for_quantification, standard_itr.disable_La_for_quantification);
+        }
+        fitting::models::Range energy_range = data_struct::get_energy_range(quantification_standard.integrated_spectra.size(), &(override_params->fit_params));
+
+        for (auto& fit_itr : detector->fit_routines)
+        {
+            for (auto& el_itr : standard_itr.element_standard_weights)
+            {
+                quantification_standard.element_counts[fit_itr.first][el_itr.first] = 0;
+            }
+            analysis_job.apply_fit_routine_options(fit_itr.first, fit_itr.second);
+            detector->model->reset_to_default_fit_params();
+            detector->model->update_fit_params_values(&(override_params->fit_params));
+            fit_itr.second->initialize(detector->model, &elements_to_fit, energy_range);
+            fit_itr.second->fit_spectra(detector->model, &quantification_standard.integrated_spectra, &elements_to_fit, quantification_standard.element_counts.at(fit_itr.first));
+            quantification_standard.normalize_counts_by_time(fit_itr.first);
+            for (const auto& itr : quantification_standard.element_counts.at(fit_itr.first))
+            {
+                out_counts[standard_itr.standard_filename + " " + data_struct::Fitting_Routine_To_Str.at(fit_itr.first) + " " + itr.first] = itr.second;
+            }
+        }
+        for (auto& itr : elements_to_fit)
+        {
+            delete itr.second;
+        }
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+/**
+ * Quantifies detector 0 of dir on num_threads, returns the seconds it took or -1.
+ */
+double quantify(const std::string& dir, size_t num_threads, std::map<std::string, double>& out_counts, std::map<std::string, double>& out_curves)
+{
+    data_struct::Analysis_Job<double> analysis_job;
+    if (false == init_job(dir, num_threads, analysis_job))
+    {
+        return -1.0;
+    }
+
+    std::chrono::time_point<std::chrono::steady_clock> start = std::chrono::steady_clock::now();
+    if (false == perform_quantification(&analysis_job, false))
+    {
+        return -1.0;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    data_struct::Detector<double>* detector = analysis_job.get_detector(0);
+    out_counts.clear();
+    for (const auto& std_itr : detector->quantification_standards)
+    {
+        for (const auto& routine_itr : std_itr.second.element_counts)
+        {
+            for (const auto& itr : routine_itr.second)
+            {
+                out_counts[std_itr.first + " " + data_struct::Fitting_Routine_To_Str.at(routine_itr.first) + " " + itr.first] = itr.second;
+            }
+        }
+    }
+    out_curves.clear();
+    for (const auto& routine_itr : detector->fitting_quant_map)
+    {
+        std::string routine = data_struct::Fitting_Routine_To_Str.at(routine_itr.first);
+        for (const auto& scaler_itr : routine_itr.second.quant_scaler_map)
+        {
+            for (const auto& shell_itr : scaler_itr.second.curve_quant_map)
+            {
+                for (const auto& quant : shell_itr.second)
+                {
+                    out_curves[routine + " " + scaler_itr.first + " " + std::to_string((int)shell_itr.first) + " " + std::to_string(quant.Z)] = quant.calib_curve_val;
+                }
+            }
+        }
+        for (const auto& itr : routine_itr.second.quantifier_map)
+        {
+            out_curves[routine + " quantifier " + itr.first] = itr.second;
+        }
+    }
+    return seconds;
+}
+
+//-----------------------------------------------------------------------------
+
+/**
+ * Exact comparison of two runs, logs every value that differs.
+ */
+bool same_values(const std::string& label, const std::map<std::string, double>& expected, const std::map<std::string, double>& actual)
+{
+    bool passed = (expected.size() == actual.size());
+    if (false == passed)
+    {
+        logE << label << ": " << expected.size() << " values expected, " << actual.size() << " found\n";
+    }
+    for (const auto& itr : expected)
+    {
+        double value = actual.count(itr.first) > 0 ? actual.at(itr.first) : std::nan("");
+        // NaN only matches NaN
+        if (false == (value == itr.second || (std::isnan(value) && std::isnan(itr.second) && actual.count(itr.first) > 0)))
+        {
+            logE << label << ": " << itr.first << " expected " << itr.second << ", found " << value << "\n";
+            passed = false;
+        }
+    }
+    return passed;
+}
+
+//-----------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+    if (false == io::file::load_element_info<double>("../reference/henke.xdr", "../reference/xrf_library.csv"))
+    {
+        return 1;
+    }
+    std::string dir = (std::filesystem::temp_directory_path() / "xrf_maps_quant_workers").string() + DIR_END_CHAR;
+    std::filesystem::create_directories(dir);
+    if (false == write_standards(dir))
+    {
+        logE << "Could not write the standards to " << dir << "\n";
+        return 1;
+    }
+
+    // the pooled run must use more than one worker even on a single core machine
+    size_t num_threads = std::max((size_t)2, (argc > 1) ? (size_t)std::stoul(argv[1]) : (size_t)std::thread::hardware_concurrency());
+    std::map<std::string, double> reference_counts;
+    std::map<std::string, double> serial_counts;
+    std::map<std::string, double> pooled_counts;
+    std::map<std::string, double> serial_curves;
+    std::map<std::string, double> pooled_curves;
+    bool reference_ok = shared_routine_counts(dir, reference_counts);
+    double serial_seconds = quantify(dir, 1, serial_counts, serial_curves);
+    double pooled_seconds = quantify(dir, num_threads, pooled_counts, pooled_curves);
+    std::filesystem::remove_all(dir);
+    if (false == reference_ok || serial_seconds < 0.0 || pooled_seconds < 0.0 || reference_counts.size() == 0)
+    {
+        logE << "Quantification failed\n";
+        return 1;
+    }
+
+    logI << num_standards << " standards, " << reference_counts.size() << " element counts, " << serial_curves.size() << " calibration values\n";
+    logI << "1 thread " << serial_seconds << "s, " << num_threads << " threads " << pooled_seconds << "s, speedup " << serial_seconds / pooled_seconds << "\n";
+
+    bool passed = same_values("1 thread counts", reference_counts, serial_counts);
+    passed = same_values(std::to_string(num_threads) + " thread counts", reference_counts, pooled_counts) && passed;
+    passed = same_values(std::to_string(num_threads) + " thread calibration", serial_curves, pooled_curves) && passed;
+    return passed ? 0 : 1;
+}
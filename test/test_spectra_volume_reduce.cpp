@@ -0,0 +1,170 @@
+/***
+Copyright (c) 2016, UChicago Argonne, LLC. All rights reserved.
+
+Copyright 2016. UChicago Argonne, LLC. This software was produced
+under U.S. Government contract DE-AC02-06CH11357 for Argonne National
+Laboratory (ANL), which is operated by UChicago Argonne, LLC for the
+U.S. Department of Energy. The U.S. Government has rights to use,
+reproduce, and distribute this software.  NEITHER THE GOVERNMENT NOR
+UChicago Argonne, LLC MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR
+ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  If software is
+modified to produce derivative works, such modified software should
+be clearly marked, so as not to confuse it with the version available
+from ANL.
+
+Additionally, redistribution and use in source and binary forms, with
+or without modification, are permitted provided that the following
+conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the name of UChicago Argonne, LLC, Argonne National
+      Laboratory, ANL, the U.S. Government, nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY UChicago Argonne, LLC AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL UChicago
+Argonne, LLC OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+***/
+
+// Times Spectra_Volume::integrate, generate_max_spectra and integrate_and_max_spectra on a synthetic volume
+// with 1 thread and with more. Fails if any result depends on the thread count, if the fused pass differs
+// from the two separate ones or if the integrated spectra is off from a double sum.
+// An optional argument sets the thread count of the second run.
+
+#include "data_struct/spectra_volume.h"
+#include "core/cpu_budget.h"
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <thread>
+
+const size_t rows = 100;
+const size_t cols = 400;
+const size_t num_channels = 2048;
+const int num_runs = 3;
+
+struct Reduce_Result
+{
+    data_struct::Spectra<float> int_spectra;
+    data_struct::Spectra<float> max_spectra;
+    data_struct::Spectra<float> max_10_spectra;
+    data_struct::Spectra<float> fused_int_spectra;
+    data_struct::Spectra<float> fused_max_spectra;
+    data_struct::Spectra<float> fused_max_10_spectra;
+    double separate_seconds;
+    double fused_seconds;
+};
+
+//-----------------------------------------------------------------------------
+
+/**
+ * Best of num_runs for the separate and the fused calls on num_threads.
+ */
+Reduce_Result reduce(data_struct::Spectra_Volume<float>& volume, size_t num_threads)
+{
+    Cpu_Budget::inst()->set_num_threads(num_threads);
+    Reduce_Result result;
+    result.separate_seconds = std::numeric_limits<double>::max();
+    result.fused_seconds = std::numeric_limits<double>::max();
+    for (int r = 0; r < num_runs; r++)
+    {
+        std::chrono::time_point<std::chrono::steady_clock> start = std::chrono::steady_clock::now();
+        result.int_spectra = volume.integrate();
+        volume.generate_max_spectra(result.max_spectra, result.max_10_spectra);
+        result.separate_seconds = std::min(result.separate_seconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+        start = std::chrono::steady_clock::now();
+        volume.integrate_and_max_spectra(result.fused_int_spectra, result.fused_max_spectra, result.fused_max_10_spectra);
+        result.fused_seconds = std::min(result.fused_seconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+bool same_spectra(const std::string& label, const data_struct::Spectra<float>& a, const data_struct::Spectra<float>& b)
+{
+    bool same = (a.size() == b.size() && (a == b).all()
+                 && a.elapsed_livetime() == b.elapsed_livetime() && a.elapsed_realtime() == b.elapsed_realtime()
+                 && a.input_counts() == b.input_counts() && a.output_counts() == b.output_counts());
+    if (false == same)
+    {
+        logE << label << " differ\n";
+    }
+    return same;
+}
+
+//-----------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+    // the second run must use more than one thread even on a single core machine
+    size_t num_threads = std::max((size_t)2, (argc > 1) ? (size_t)std::stoul(argv[1]) : (size_t)std::thread::hardware_concurrency());
+
+    data_struct::Spectra_Volume<float> volume;
+    volume.resize_and_zero(rows, cols, num_channels);
+    data_struct::ArrayTr<double> expected = data_struct::ArrayTr<double>::Zero(num_channels);
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> counts(0.0f, 50.0f);
+    for (size_t i = 0; i < rows; i++)
+    {
+        for (size_t j = 0; j < cols; j++)
+        {
+            data_struct::Spectra<float>& spectra = volume[i][j];
+            for (size_t k = 0; k < num_channels; k++)
+            {
+                spectra[k] = std::floor(counts(rng));
+            }
+            spectra.elapsed_livetime(0.1f);
+            spectra.elapsed_realtime(0.11f);
+            spectra.input_counts(1000.0f);
+            spectra.output_counts(900.0f);
+            expected += spectra.cast<double>();
+        }
+    }
+
+    Reduce_Result serial = reduce(volume, 1);
+    Reduce_Result threaded = reduce(volume, num_threads);
+
+    logI << rows << " x " << cols << " pixels x " << num_channels << " channels, float, best of " << num_runs << "\n";
+    logI << "integrate + generate_max_spectra: 1 thread " << serial.separate_seconds << "s, " << num_threads << " threads " << threaded.separate_seconds << "s\n";
+    logI << "integrate_and_max_spectra: 1 thread " << serial.fused_seconds << "s, " << num_threads << " threads " << threaded.fused_seconds << "s\n";
+
+    bool passed = same_spectra("integrate with 1 and " + std::to_string(num_threads) + " threads", serial.int_spectra, threaded.int_spectra);
+    passed = same_spectra("max spectra with 1 and " + std::to_string(num_threads) + " threads", serial.max_spectra, threaded.max_spectra) && passed;
+    passed = same_spectra("max 10 spectra with 1 and " + std::to_string(num_threads) + " threads", serial.max_10_spectra, threaded.max_10_spectra) && passed;
+    passed = same_spectra("integrate and integrate_and_max_spectra", serial.int_spectra, threaded.fused_int_spectra) && passed;
+    passed = same_spectra("generate_max_spectra and integrate_and_max_spectra", serial.max_spectra, threaded.fused_max_spectra) && passed;
+    passed = same_spectra("generate_max_spectra and integrate_and_max_spectra 10", serial.max_10_spectra, threaded.fused_max_10_spectra) && passed;
+
+    double max_rel_diff = ((serial.int_spectra.cast<double>() - expected).abs() / expected.max(1.0)).maxCoeff();
+    logI << "integrated spectra max relative difference to a double sum " << max_rel_diff << "\n";
+    if (false == (max_rel_diff < 1.0e-5))
+    {
+        logE << "integrated spectra is off by " << max_rel_diff << "\n";
+        passed = false;
+    }
+    if (false == (std::abs(serial.int_spectra.elapsed_realtime() - 0.11 * rows * cols) < 1.0e-3 * 0.11 * rows * cols))
+    {
+        logE << "integrated real time " << serial.int_spectra.elapsed_realtime() << "\n";
+        passed = false;
+    }
+    return passed ? 0 : 1;
+}